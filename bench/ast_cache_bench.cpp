@@ -0,0 +1,106 @@
+// Time to get the tokens and the flat AST of a source file: a fresh lex and
+// parse with cParser against loading the AST cache file written from it.
+// Both must give the same number of nodes and tokens.
+#include "../include/ast_cache.h"
+#include "../include/flat_ast.h"
+#include "../include/lexer.h"
+#include "../include/log.h"
+#include "../include/parser.h"
+
+#include "llvm/Support/FileSystem.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+static const int FUNCTION_COUNT = 4000;
+static const int RUN_COUNT = 5;
+
+static std::string make_source() {
+    std::string source = "type Pair = int * int;\n\n";
+    for (int i = 0; i < FUNCTION_COUNT; ++i) {
+        std::string name = "kernel_" + std::to_string(i);
+        source += "// Kernel " + std::to_string(i) + "\n";
+        source += "func " + name + "(a: int) -> int {\n";
+        source += "    let x: int = a * " + std::to_string(i) + " + 17;\n";
+        source += "    let y: int;\n";
+        source += "    y = x * 7 - a;\n";
+        source += "    return y - x * 3;\n";
+        source += "}\n\n";
+    }
+    return source;
+}
+
+// Best of RUN_COUNT, in ms
+template <typename Function>
+static double time_best(Function function) {
+    double best_ms = 0.0;
+    for (int run = 0; run < RUN_COUNT; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best_ms) { best_ms = elapsed.count(); }
+    }
+    return best_ms;
+}
+
+int main() {
+    cLogger::get().set_level(LOG_WARNING);
+
+    std::string source = make_source();
+
+    llvm::SmallString<256> file_name;
+    llvm::sys::fs::createTemporaryFile("ast_cache_bench", "dpa", file_name);
+
+    cLexer lexer(source);
+    lexer.lex();
+    std::vector<sToken> tokens = lexer.get_tokens();
+    cParser parser(source, tokens);
+    cFlatAST ast;
+    if (!parser.parse_flat(ast) || !cASTCacheFile::write(std::string(file_name), source, tokens, ast)) {
+        std::cerr << "Could not write the AST cache" << std::endl;
+        return 1;
+    }
+
+    size_t parsed_nodes = 0, parsed_tokens = 0;
+    double parse_ms = time_best([&]() {
+        cLexer lexer(source);
+        lexer.lex();
+        parsed_tokens = lexer.get_tokens().size();
+        cParser parser(source, lexer.take_tokens());
+        cFlatAST ast;
+        parser.parse_flat(ast);
+        parsed_nodes = ast.size();
+    });
+
+    size_t loaded_nodes = 0, loaded_tokens = 0;
+    double load_ms = time_best([&]() {
+        std::unique_ptr<cASTCacheFile> cache = cASTCacheFile::open(std::string(file_name));
+        if (!cache || !cache->matches(source)) { return; }
+        cFlatAST ast;
+        cache->load(ast);
+        std::vector<sToken> tokens;
+        if (!cache->load_tokens(tokens)) { return; }
+        loaded_nodes = ast.size();
+        loaded_tokens = tokens.size();
+    });
+
+    llvm::sys::fs::remove(file_name);
+
+    if (loaded_nodes != parsed_nodes || loaded_tokens != parsed_tokens) {
+        std::cerr << "The AST cache doesn't hold the parsed AST" << std::endl;
+        return 1;
+    }
+
+    double megabytes = source.size() / 1e6;
+    std::cout << "Tokens and flat AST of " << FUNCTION_COUNT << " functions (" << std::fixed << std::setprecision(2) << megabytes << " MB, "
+              << parsed_tokens << " tokens, " << parsed_nodes << " nodes), best of " << RUN_COUNT << std::endl;
+    std::cout << "  lex + parse  " << std::setw(8) << parse_ms << " ms  " << std::setw(8) << std::setprecision(1) << megabytes / (parse_ms / 1e3) << " MB/s" << std::endl;
+    std::cout << "  cache load   " << std::setw(8) << std::setprecision(2) << load_ms << " ms  " << std::setw(8) << std::setprecision(1) << megabytes / (load_ms / 1e3) << " MB/s"
+              << "  (" << parse_ms / load_ms << "x)" << std::defaultfloat << std::endl;
+    return 0;
+}
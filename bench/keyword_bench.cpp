@@ -0,0 +1,115 @@
+// Keyword classification throughput: the perfect hash of classify_identifier
+// against the chain of comparisons the lexer used before, over the same
+// identifiers. Both must classify every identifier the same way.
+#include "../include/lexer.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+static const size_t IDENTIFIER_COUNT = 2000000;
+static const int RUN_COUNT = 5;
+
+static const char* KEYWORD_TEXTS[] = { "func", "let", "type", "true", "false", "return", "match", "case", "where", "forall", "import" };
+// Identifiers that share a length and first or last chars with a keyword
+static const char* NEAR_MISSES[] = { "funk", "lot", "typo", "tree", "falls", "retort", "match_", "cast", "where2", "formal", "impart",
+                                     "x", "value", "count", "sum", "index", "result", "buffer", "left", "right" };
+
+// Compares with each keyword in turn, not inlined in the loop so both
+// classifiers are called the same way
+__attribute__((noinline)) static eTokenType classify_identifier_chain(std::string_view identifier) {
+    if (identifier == "func") { return TOK_DEF; }
+    else if (identifier == "let") { return TOK_VARDECL; }
+    else if (identifier == "type") { return TOK_TYPEDECL; }
+    else if (identifier == "true") { return TOK_TRUE; }
+    else if (identifier == "false") { return TOK_FALSE; }
+    else if (identifier == "return") { return TOK_RETURN; }
+    else if (identifier == "match") { return TOK_MATCH; }
+    else if (identifier == "case") { return TOK_CASE; }
+    else if (identifier == "where") { return TOK_WHERE; }
+    else if (identifier == "forall") { return TOK_FORALL; }
+    else if (identifier == "import") { return TOK_IMPORT; }
+    return TOK_IDENTIFIER;
+}
+
+static std::string random_identifier(std::mt19937& random) {
+    static const char FIRST[] = "abcdefghijklmnopqrstuvwxyz_";
+    static const char REST[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+
+    std::string identifier(1 + random() % 12, ' ');
+    identifier[0] = FIRST[random() % (sizeof(FIRST) - 1)];
+    for (size_t i = 1; i < identifier.size(); ++i) { identifier[i] = REST[random() % (sizeof(REST) - 1)]; }
+    return identifier;
+}
+
+// Keywords with the given percentage, random names or near misses otherwise
+static std::vector<std::string> make_identifiers(unsigned keyword_percent, bool near_misses) {
+    std::mt19937 random(42);
+    std::vector<std::string> identifiers;
+    identifiers.reserve(IDENTIFIER_COUNT);
+
+    for (size_t i = 0; i < IDENTIFIER_COUNT; ++i) {
+        if (random() % 100 < keyword_percent) {
+            identifiers.push_back(KEYWORD_TEXTS[random() % (sizeof(KEYWORD_TEXTS) / sizeof(KEYWORD_TEXTS[0]))]);
+        } else if (near_misses) {
+            identifiers.push_back(NEAR_MISSES[random() % (sizeof(NEAR_MISSES) / sizeof(NEAR_MISSES[0]))]);
+        } else {
+            identifiers.push_back(random_identifier(random));
+        }
+    }
+    return identifiers;
+}
+
+struct sRunResult {
+    double identifiers_per_second;
+    int64_t checksum;
+};
+
+// Best of RUN_COUNT runs
+static sRunResult run_classifier(eTokenType (*classify)(std::string_view), const std::vector<std::string_view>& identifiers) {
+    sRunResult result = { 0.0, 0 };
+    for (int run = 0; run < RUN_COUNT; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        int64_t checksum = 0;
+        for (std::string_view identifier : identifiers) { checksum += classify(identifier); }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double identifiers_per_second = identifiers.size() / elapsed.count();
+        if (identifiers_per_second > result.identifiers_per_second) { result.identifiers_per_second = identifiers_per_second; }
+        result.checksum = checksum;
+    }
+    return result;
+}
+
+// False if the classifiers disagree
+static bool run_mix(const char* name, unsigned keyword_percent, bool near_misses) {
+    std::vector<std::string> storage = make_identifiers(keyword_percent, near_misses);
+    std::vector<std::string_view> identifiers(storage.begin(), storage.end());
+
+    sRunResult chain = run_classifier(classify_identifier_chain, identifiers);
+    sRunResult hash = run_classifier(classify_identifier, identifiers);
+
+    std::cout << "  " << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(1)
+              << "if-chain " << std::setw(6) << chain.identifiers_per_second / 1e6 << " M/s   "
+              << "hash " << std::setw(6) << hash.identifiers_per_second / 1e6 << " M/s" << std::endl;
+
+    if (chain.checksum != hash.checksum) {
+        std::cerr << "Classifiers disagree on " << name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    std::cout << "Keyword classification, " << IDENTIFIER_COUNT << " identifiers, best of " << RUN_COUNT << std::endl;
+
+    bool agreed = run_mix("random identifiers, 10% keywords", 10, false);
+    agreed = run_mix("near misses, 30% keywords", 30, true) && agreed;
+
+    return agreed ? 0 : 1;
+}
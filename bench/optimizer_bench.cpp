@@ -0,0 +1,122 @@
+// Runtime of the code generated at each optimization level: a chain of
+// integer kernels (kernel -> blend -> mix, with a ',' tuple in mix) is
+// compiled with the JIT and mix is called in a loop. Every level must
+// compute the same checksum.
+#include "../include/jit.h"
+#include "../include/lexer.h"
+#include "../include/log.h"
+#include "../include/parser.h"
+
+#include "llvm/IR/InstIterator.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string_view>
+
+
+static const int CALL_COUNT = 50000000;
+static const int RUN_COUNT = 3;
+
+static const char* KERNELS =
+    "func kernel(a: int) -> int {\n"
+    "    let x: int = a * 31 + 17;\n"
+    "    let y: int = x * 7 - a;\n"
+    "    return y - x * 3;\n"
+    "}\n"
+    "\n"
+    "func blend(a: int) -> int {\n"
+    "    let k: int = kernel(a);\n"
+    "    let l: int = kernel(k + a);\n"
+    "    return k - l * 3;\n"
+    "}\n"
+    "\n"
+    "func mix(a: int) -> int {\n"
+    "    let m: int = blend(a);\n"
+    "    let n: int = blend(m - a);\n"
+    "    m, n;\n"
+    "    return m + n;\n"
+    "}\n";
+
+struct sLevel {
+    const char* name;
+    eOptLevel opt_level;
+};
+
+static const sLevel LEVELS[] = {
+    { "-O0", OPT_O0 },
+    { "-O1", OPT_O1 },
+    { "-O2", OPT_O2 },
+    { "-O3", OPT_O3 },
+    { "-Os", OPT_OS },
+};
+
+static size_t count_allocas(const llvm::Module& module) {
+    size_t count = 0;
+    for (const llvm::Function& function : module) {
+        for (const llvm::Instruction& instruction : llvm::instructions(function)) { count += llvm::isa<llvm::AllocaInst>(instruction); }
+    }
+    return count;
+}
+
+// False if the kernels can't be compiled at this level
+static bool run_level(const sLevel& level, int64_t& checksum) {
+    sCompilerOptions options;
+    options.opt_level = level.opt_level;
+
+    cLexer lexer(KERNELS);
+    lexer.lex();
+    cParser parser(KERNELS, lexer.take_tokens());
+    parser.m_code_generator->configure(options);
+    if (!parser.parse()) { return false; }
+
+    // Same pipelines as --jit
+    std::shared_ptr<cCodeGenerator> code_generator = parser.m_code_generator;
+    code_generator->optimize_module();
+    size_t allocas = count_allocas(*code_generator->m_Module);
+
+    std::unique_ptr<cJIT> engine = cJIT::create(*code_generator->m_TargetMachine);
+    if (!engine || !engine->add_module(code_generator)) { return false; }
+    int (*mix)(int) = (int (*)(int))engine->lookup("mix");
+    if (!mix) { return false; }
+
+    double best_ms = 0.0;
+    for (int run = 0; run < RUN_COUNT; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        int value = 0;
+        checksum = 0;
+        for (int i = 0; i < CALL_COUNT; ++i) {
+            value = mix((int)((unsigned)value + (unsigned)i));
+            checksum += value;
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best_ms) { best_ms = elapsed.count(); }
+    }
+
+    std::cout << "  " << level.name << std::fixed << std::setprecision(0) << std::setw(8) << best_ms << " ms   "
+              << allocas << " allocas   checksum " << checksum << std::endl;
+    return true;
+}
+
+int main() {
+    cLogger::get().set_level(LOG_WARNING);
+
+    std::cout << "Generated code runtime, " << CALL_COUNT << " calls of mix, best of " << RUN_COUNT << std::endl;
+
+    int64_t expected_checksum = 0;
+    for (const sLevel& level : LEVELS) {
+        int64_t checksum = 0;
+        if (!run_level(level, checksum)) {
+            std::cerr << "Could not compile the kernels at " << level.name << std::endl;
+            return 1;
+        }
+
+        if (&level == LEVELS) { expected_checksum = checksum; }
+        else if (checksum != expected_checksum) {
+            std::cerr << "Checksum at " << level.name << " differs from -O0" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+
+
+// Bump pointer allocator, everything is released at once when the arena is
+// destroyed or reset. Destructors of the allocated objects are never run,
+// they must not own any resource (no std::string, std::vector, unique_ptr...)
+class cArena {
+public:
+    cArena();
+    ~cArena() = default;
+
+    cArena(const cArena&) = delete;
+    cArena& operator=(const cArena&) = delete;
+
+    inline void* allocate(size_t size, size_t alignment) {
+        uintptr_t current = (uintptr_t)this->m_current;
+        uintptr_t aligned = (current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+        if (aligned + size <= (uintptr_t)this->m_end) {
+            this->m_current = (char*)(aligned + size);
+            this->m_bytes_allocated += size;
+            return (void*)aligned;
+        }
+
+        return this->allocate_slow(size, alignment);
+    }
+
+    template <typename T, typename... Args>
+    inline T* create(Args&&... args) {
+        return new (this->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Copies the elements in the arena, the array lives as long as the arena
+    template <typename T>
+    llvm::ArrayRef<T> copy_array(const std::vector<T>& elements) {
+        static_assert(std::is_trivially_copyable<T>::value, "Arena arrays hold trivially copyable elements");
+        if (elements.empty()) { return llvm::ArrayRef<T>(); }
+
+        T* data = (T*)this->allocate(elements.size() * sizeof(T), alignof(T));
+        memcpy((void*)data, elements.data(), elements.size() * sizeof(T));
+        return llvm::ArrayRef<T>(data, elements.size());
+    }
+
+    // Releases every allocation but keeps the first block for reuse
+    void reset();
+
+    inline size_t get_bytes_allocated() const { return m_bytes_allocated; }
+
+private:
+    void* allocate_slow(size_t size, size_t alignment);
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    std::vector<std::unique_ptr<char[]>> m_large_blocks;
+    char* m_current;
+    char* m_end;
+    size_t m_bytes_allocated;
+};
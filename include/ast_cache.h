@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flat_ast.h"
+#include "lexer.h"
+#include "source_file.h"
+
+
+// Binary cache of the tokens and the flat AST of a source file, so tools
+// reading the same source again skip lexing and parsing. Mapped and validated
+// once, then each AST array is copied in one block: there is no allocation per
+// node or token. Symbols are stored as indices in the string table of the
+// file, interned once per string on load.
+//
+// The sections follow the header in this order, each padded to 4 bytes:
+//  tokens      per token, as LEB128 varints: zigzag type, offset from the end
+//              of the previous token, length, line delta, symbol + 1 (0 for
+//              none). Most tokens take 5 bytes
+//  kinds       one byte per node
+//  payloads, lhs, rhs, extra, roots
+//  strings     offset, length in the characters
+//  characters
+// The file is only used for the source it was written from (size and hash)
+// by the same build of the compiler, see get_compiler_build_id.
+static const char AST_CACHE_MAGIC[4] = { 'D', 'P', 'A', '\0' };
+// Bumped on any change of the layout, or of the node kinds and their children
+static const uint32_t AST_CACHE_VERSION = 1;
+static const char AST_CACHE_FILE_EXTENSION[] = ".dpa";
+
+struct sASTCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t build_hash;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint32_t token_count;
+    uint32_t token_bytes;
+    uint32_t node_count;
+    uint32_t extra_count;
+    uint32_t root_count;
+    uint32_t string_count;
+    uint32_t char_count;
+};
+
+struct sASTCacheString { uint32_t offset, length; };
+
+
+class cASTCacheFile {
+public:
+    // Returns nullptr if the file can't be mapped or isn't a valid cache
+    static std::unique_ptr<cASTCacheFile> open(const std::string& file_path);
+    static bool write(const std::string& file_path, std::string_view source, const std::vector<sToken>& tokens, const cFlatAST& ast);
+
+    // Written from this source by this build of the compiler
+    bool matches(std::string_view source) const;
+    // Replaces the AST
+    void load(cFlatAST& ast) const;
+    // Replaces the tokens. They are only checked when decoded, false leaves
+    // them empty
+    bool load_tokens(std::vector<sToken>& tokens) const;
+
+    inline uint32_t get_node_count() const { return m_header->node_count; }
+    inline uint32_t get_token_count() const { return m_header->token_count; }
+
+    cASTCacheFile(const cASTCacheFile&) = delete;
+    cASTCacheFile& operator=(const cASTCacheFile&) = delete;
+
+    ~cASTCacheFile() = default;
+private:
+    explicit cASTCacheFile(std::unique_ptr<cSourceFile> mapping);
+
+    // Sizes, symbols, kinds of the roots and of every child slot. Children
+    // come before their parent so walking a loaded AST always terminates
+    bool validate() const;
+    // Symbol of each string of the file, in this process
+    std::vector<symbol_t> intern_strings() const;
+
+    std::unique_ptr<cSourceFile> m_mapping;
+    const sASTCacheHeader* m_header = nullptr;
+    const uint8_t* m_tokens = nullptr;
+    const uint8_t* m_kinds = nullptr;
+    const uint32_t* m_payloads = nullptr;
+    const node_index_t* m_lhs = nullptr;
+    const node_index_t* m_rhs = nullptr;
+    const node_index_t* m_extra = nullptr;
+    const node_index_t* m_roots = nullptr;
+    const sASTCacheString* m_strings = nullptr;
+    const char* m_chars = nullptr;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ast_cache.h"
+#include "compiler_options.h"
+#include "flat_ast.h"
+#include "lexer.h"
+#include "types/dep_type.h"
+
+
+enum eCompilationStage {
+    STAGE_PARSE,
+    STAGE_IMPORT,
+    STAGE_RESOLVE,
+    STAGE_CHECK,
+    STAGE_LOWER,
+    STAGE_EMIT,
+
+    STAGE_COUNT,
+};
+
+const char* get_stage_name(eCompilationStage stage);
+
+// A whole source file through explicit stages. Parsing builds the complete
+// flat AST before anything is lowered, so functions and types can be used
+// before their definition.
+//  parse    source -> flat AST
+//  import   declarations of the imported modules, from their interface files
+//  resolve  every name refers to a declaration, no duplicate declarations
+//  check    type of every expression, against declarations and signatures
+//  lower    flat AST -> LLVM module, per function passes
+//  emit     module pipeline, object file
+class cCompilationUnit {
+public:
+    // The source must outlive the unit
+    cCompilationUnit(std::string_view source, const sCompilerOptions& options);
+
+    // Runs the stages in order up to last_stage, each is timed. Stops at the
+    // first failing stage
+    bool run(eCompilationStage last_stage, const std::string& object_file_name);
+    // Runs a single stage, timed, the previous ones must have succeeded
+    bool run_stage(eCompilationStage stage, const std::string& object_file_name);
+
+    // Loads the tokens and AST from the AST cache file when it matches the
+    // source, writes it after parsing otherwise, see cASTCacheFile
+    inline void set_ast_cache(const std::string& file_name) { m_ast_cache_file_name = file_name; }
+
+    bool parse();
+    // Interfaces are looked up in the import paths of the options
+    bool import_modules();
+    bool resolve_names();
+    bool type_check();
+    bool lower();
+    bool emit(const std::string& object_file_name);
+
+    // Interface of the functions and types of the source, imported ones
+    // excluded, see cInterfaceFile
+    bool write_interface(const std::string& file_name) const;
+
+    inline const cFlatAST& get_ast() const { return m_ast; }
+    // Only kept with an AST cache: lexed before parsing, or decoded from the
+    // cache on the first call. Empty otherwise, the parser streams them
+    const std::vector<sToken>& get_tokens();
+    inline std::shared_ptr<cCodeGenerator> get_code_generator() const { return m_code_generator; }
+    // Checked type of an expression node, TYPE_NONE before type checking
+    inline type_id_t get_node_type(node_index_t node) const { return node < m_node_types.size() ? m_node_types[node] : TYPE_NONE; }
+    inline double get_stage_time(eCompilationStage stage) const { return m_stage_times[stage]; }
+
+    cCompilationUnit(const cCompilationUnit&) = delete;
+    cCompilationUnit& operator=(const cCompilationUnit&) = delete;
+
+    ~cCompilationUnit() = default;
+private:
+    bool load_ast_cache();
+    bool write_ast_cache() const;
+    // Replaces the streaming parser
+    void lex_ahead();
+
+    bool resolve_type(node_index_t type);
+    bool resolve_expression(node_index_t node, std::vector<symbol_t>& scope);
+    bool check_type_cycle(node_index_t type_decl, std::vector<node_index_t>& pending);
+
+    // Declared types replaced by their definition, recursively
+    type_id_t expand_type(type_id_t type);
+    type_id_t check_expression(node_index_t node, std::vector<std::pair<symbol_t, type_id_t>>& scope, type_id_t return_type);
+
+    std::string_view m_source;
+    sCompilerOptions m_options;
+
+    std::unique_ptr<cLexer> m_lexer;
+    std::unique_ptr<cParser> m_parser;
+    cFlatAST m_ast;
+    std::vector<sToken> m_tokens;
+    std::string m_ast_cache_file_name;
+    // Loaded from, still holds the tokens until get_tokens
+    std::unique_ptr<cASTCacheFile> m_ast_cache;
+    // Roots from the source, the imported declarations come after
+    size_t m_source_root_count = 0;
+
+    // Filled by name resolution
+    std::unordered_map<symbol_t, node_index_t> m_functions;
+    std::unordered_map<symbol_t, node_index_t> m_type_decls;
+
+    // Filled by type checking, indexed by node
+    std::vector<type_id_t> m_node_types;
+    std::unordered_map<type_id_t, type_id_t> m_expanded_types;
+
+    std::shared_ptr<cCodeGenerator> m_code_generator;
+    double m_stage_times[STAGE_COUNT];
+};
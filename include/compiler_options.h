@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+#define DEPLANG_COMPILER_VERSION "0.1.0"
+
+// Hash of the compiler executable, computed once. Caches keyed on it are never
+// read by another build, whatever part of the compiler changed
+uint64_t get_compiler_build_id();
+
+enum eOptLevel {
+    OPT_O0,
+    OPT_O1,
+    OPT_O2,
+    OPT_O3,
+    OPT_OS,
+};
+
+enum eRelocModel {
+    RELOC_STATIC,
+    RELOC_PIC,
+    RELOC_DYNAMIC_NO_PIC,
+};
+
+// Options shared by every stage of the compilation
+struct sCompilerOptions {
+    eOptLevel opt_level = OPT_O0;
+
+    // "native" is resolved to the host cpu when the target machine is created
+    std::string cpu = "generic";
+    // Comma separated "+feature" / "-feature" list, appended to the host
+    // features when the cpu is native
+    std::string features;
+    eRelocModel reloc_model = RELOC_PIC;
+
+    // Directories searched in order for the interface files of imports
+    std::vector<std::string> import_paths;
+};
+
+// -O0, -O1, -O2, -O3 or -Os, false for anything else
+inline bool parse_opt_level(std::string_view arg, eOptLevel& opt_level) {
+    if (arg == "-O0") { opt_level = OPT_O0; }
+    else if (arg == "-O1") { opt_level = OPT_O1; }
+    else if (arg == "-O2") { opt_level = OPT_O2; }
+    else if (arg == "-O3") { opt_level = OPT_O3; }
+    else if (arg == "-Os") { opt_level = OPT_OS; }
+    else { return false; }
+    return true;
+}
+
+// -march=<cpu>, -mcpu=<cpu>, -mattr=<features>, -fPIC, -fno-pic or
+// -relocation-model=<static|pic|dynamic-no-pic>, false for anything else
+inline bool parse_target_option(std::string_view arg, sCompilerOptions& options) {
+    auto value_of = [&arg](std::string_view prefix) -> bool {
+        return arg.substr(0, prefix.size()) == prefix;
+    };
+
+    // -march and -mcpu are the same thing for us, the cpu selects the ISA
+    // and the scheduling model
+    if (value_of("-march=")) { options.cpu = arg.substr(7); }
+    else if (value_of("-mcpu=")) { options.cpu = arg.substr(6); }
+    else if (value_of("-mattr=")) {
+        if (!options.features.empty()) { options.features += ','; }
+        options.features += arg.substr(7);
+    }
+    else if (arg == "-fPIC" || arg == "-relocation-model=pic") { options.reloc_model = RELOC_PIC; }
+    else if (arg == "-fno-pic" || arg == "-relocation-model=static") { options.reloc_model = RELOC_STATIC; }
+    else if (arg == "-relocation-model=dynamic-no-pic") { options.reloc_model = RELOC_DYNAMIC_NO_PIC; }
+    else { return false; }
+    return true;
+}
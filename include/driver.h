@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "compiler_options.h"
+
+
+// Compiles each source file to <output_directory>/<stem>.o through the staged
+// pipeline of cCompilationUnit, on a pool of at most `workers` threads (one per
+// core when 0). Every file gets its own unit, so its own context and module,
+// nothing is shared between files but the interner and the type table.
+// Each file also gets its interface, <output_directory>/<stem>.dpi, and the
+// output directory is searched first for imports: a file importing another
+// input file is compiled after it, in a later wave of the pool.
+// Prints the status of each file in input order and the throughput of the
+// whole build, returns false if any file failed.
+bool compile_files(const std::vector<std::string>& file_paths, const sCompilerOptions& options, const std::string& output_directory, unsigned workers);
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "parser.h"
+
+
+// Flat AST: the nodes of a unit in parallel arrays, children referenced by
+// 32-bit indices instead of pointers. Codegen and printing walk it with a
+// switch on the node kind, no virtual dispatch.
+static const node_index_t NODE_NONE = UINT32_MAX;
+
+// Operands of each node kind
+//  NODE_INT, NODE_FLOAT, NODE_BOOL  payload: literal bits
+//  NODE_VARIABLE                    payload: name
+//  NODE_BINARY                      payload: operator chars, lhs, rhs
+//  NODE_RETURN                      lhs: expression
+//  NODE_VARDECL                     payload: name, lhs: type, rhs: initializer or NODE_NONE
+//  NODE_ASSIGN                      payload: name, lhs: expression
+//  NODE_CALL                        payload: callee, lhs: first argument in extra, rhs: argument count
+//  NODE_TYPE                        payload: type name or operator, lhs/rhs: operands or NODE_NONE
+//  NODE_PARAM                       payload: name, lhs: type
+//  NODE_FUNCTION                    payload: name, lhs: position in extra of
+//                                   [return type, param count, params..., body count, body...]
+//  NODE_TYPEDECL                    payload: name, lhs: type
+//  NODE_IMPORT                      payload: module name
+//  NODE_EXTERN                      payload: name, lhs: position in extra of
+//                                   [return type, param count, params...],
+//                                   a function of an imported module
+enum eFlatNodeKind : uint8_t {
+    NODE_INT,
+    NODE_FLOAT,
+    NODE_BOOL,
+    NODE_VARIABLE,
+    NODE_BINARY,
+    NODE_RETURN,
+    NODE_VARDECL,
+    NODE_ASSIGN,
+    NODE_CALL,
+    NODE_TYPE,
+    NODE_PARAM,
+    NODE_FUNCTION,
+    NODE_TYPEDECL,
+    NODE_IMPORT,
+    NODE_EXTERN,
+};
+
+// Whether the payload is a symbol, the others are literal bits or operators
+inline bool has_symbol_payload(eFlatNodeKind kind) {
+    return kind != NODE_INT && kind != NODE_FLOAT && kind != NODE_BOOL && kind != NODE_BINARY && kind != NODE_RETURN;
+}
+
+// Operators are at most 4 chars, packed in the payload
+inline uint32_t encode_operator(std::string_view op) {
+    uint32_t packed = 0;
+    memcpy(&packed, op.data(), op.size() < 4 ? op.size() : 4);
+    return packed;
+}
+
+
+class cFlatAST {
+public:
+    cFlatAST() = default;
+    ~cFlatAST() = default;
+
+    node_index_t add_node(eFlatNodeKind kind, uint32_t payload, node_index_t lhs = NODE_NONE, node_index_t rhs = NODE_NONE);
+    // Appends a list of node indices to the extra array, returns its position
+    uint32_t add_extra(const std::vector<node_index_t>& indices);
+    inline void add_root(node_index_t node) { m_roots.push_back(node); }
+
+    inline eFlatNodeKind get_kind(node_index_t node) const { return (eFlatNodeKind)m_kinds[node]; }
+    inline uint32_t get_payload(node_index_t node) const { return m_payloads[node]; }
+    inline node_index_t get_lhs(node_index_t node) const { return m_lhs[node]; }
+    inline node_index_t get_rhs(node_index_t node) const { return m_rhs[node]; }
+    inline node_index_t get_extra(uint32_t position) const { return m_extra[position]; }
+
+    inline int get_int(node_index_t node) const { return (int)m_payloads[node]; }
+    float get_float(node_index_t node) const;
+    // Slice of the packed payload, valid until the next node is added
+    std::string_view get_operator(node_index_t node) const;
+
+    // Top level type declarations and function definitions, in source order
+    inline const std::vector<node_index_t>& get_roots() const { return m_roots; }
+    inline size_t size() const { return m_kinds.size(); }
+    size_t get_memory_usage() const;
+
+    void clear();
+
+private:
+    // Reads and writes the arrays directly
+    friend class cASTCacheFile;
+
+    std::vector<uint8_t> m_kinds;
+    std::vector<uint32_t> m_payloads;
+    std::vector<node_index_t> m_lhs;
+    std::vector<node_index_t> m_rhs;
+
+    std::vector<node_index_t> m_extra;
+    std::vector<node_index_t> m_roots;
+};
+
+
+// Declarations first so functions and types can be used before their
+// definition, then the functions in order. Stops at the first error
+bool codegen_flat(const cFlatAST& ast, std::shared_ptr<cCodeGenerator> code_generator);
+// Defines every declared type, dependencies first, and declares every function,
+// imported ones included
+bool codegen_flat_declarations(const cFlatAST& ast, std::shared_ptr<cCodeGenerator> code_generator);
+// Defines every declared type, dependencies first
+bool codegen_flat_named_types(const cFlatAST& ast, std::shared_ptr<cCodeGenerator> code_generator);
+
+// Declaration only, the definition may live in another module. Returns the
+// existing declaration if there is one
+llvm::Function* codegen_flat_prototype(const cFlatAST& ast, node_index_t function, std::shared_ptr<cCodeGenerator> code_generator);
+llvm::Function* codegen_flat_function(const cFlatAST& ast, node_index_t function, std::shared_ptr<cCodeGenerator> code_generator);
+sTypedValue codegen_flat_expression(const cFlatAST& ast, node_index_t node, std::shared_ptr<cCodeGenerator> code_generator);
+type_id_t resolve_flat_type(const cFlatAST& ast, node_index_t type);
+// Names of the functions called in the subtree, in call order with repeats
+void collect_flat_callees(const cFlatAST& ast, node_index_t node, std::vector<symbol_t>& callees);
+llvm::Type* codegen_flat_type(const cFlatAST& ast, node_index_t type, std::shared_ptr<cCodeGenerator> code_generator);
+
+void print_flat(const cFlatAST& ast);
+void print_flat_node(const cFlatAST& ast, node_index_t node, int depth);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "compiler_options.h"
+#include "flat_ast.h"
+
+
+// Incremental code generation of a flat unit, one object fragment per
+// function. The fingerprint of a function covers its own nodes, the signatures
+// of the functions it calls and the declared types it uses, recursively, plus
+// the compiler build and options. Fragments are kept in an object cache
+// directory under their fingerprint, only the functions without one are
+// lowered and emitted, so editing a body regenerates that function and editing
+// a signature or a type regenerates its users.
+// The unit is written as a thin archive referencing the fragments.
+bool codegen_flat_incremental(const cFlatAST& ast, const sCompilerOptions& options, const std::string& cache_directory, const std::string& archive_file_name);
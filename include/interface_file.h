@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flat_ast.h"
+#include "source_file.h"
+
+
+// Binary interface of a module: the signatures of its functions and its
+// declared types, what a module importing it needs to check and lower its
+// calls. Read in place from the mapping, nothing is parsed.
+//
+// Every field is a native 32-bit integer, the arrays follow the header in
+// this order:
+//  type nodes  name, lhs, rhs: a type name or operator and its operands,
+//              INTERFACE_NONE for names. Operands come before their node,
+//              equal types share their node
+//  params      name, type
+//  functions   name, return type, first param, param count
+//  type decls  name, type
+//  strings     offset, length in the characters
+//  characters
+// Names are indices in the strings.
+static const char INTERFACE_MAGIC[4] = { 'D', 'P', 'I', '\0' };
+// Bumped on any change of the layout
+static const uint32_t INTERFACE_VERSION = 1;
+static const uint32_t INTERFACE_NONE = UINT32_MAX;
+static const char INTERFACE_FILE_EXTENSION[] = ".dpi";
+
+struct sInterfaceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t type_node_count;
+    uint32_t param_count;
+    uint32_t function_count;
+    uint32_t type_decl_count;
+    uint32_t string_count;
+    uint32_t char_count;
+};
+
+struct sInterfaceTypeNode { uint32_t name, lhs, rhs; };
+struct sInterfaceParam { uint32_t name, type; };
+struct sInterfaceFunction { uint32_t name, return_type, first_param, param_count; };
+struct sInterfaceTypeDecl { uint32_t name, type; };
+struct sInterfaceString { uint32_t offset, length; };
+
+
+class cInterfaceFile {
+public:
+    // Returns nullptr if the file can't be mapped or isn't a valid interface
+    static std::unique_ptr<cInterfaceFile> open(const std::string& file_path);
+    // Interface of the functions and type declarations among the roots
+    static bool write(const cFlatAST& ast, const std::vector<node_index_t>& roots, const std::string& file_path);
+
+    // Adds the declarations as NODE_TYPEDECL and NODE_EXTERN roots
+    void import_into(cFlatAST& ast) const;
+
+    inline uint32_t get_function_count() const { return m_header->function_count; }
+    inline uint32_t get_type_decl_count() const { return m_header->type_decl_count; }
+    std::string_view get_string(uint32_t string) const;
+
+    cInterfaceFile(const cInterfaceFile&) = delete;
+    cInterfaceFile& operator=(const cInterfaceFile&) = delete;
+
+    ~cInterfaceFile() = default;
+private:
+    explicit cInterfaceFile(std::unique_ptr<cSourceFile> mapping);
+
+    // Every count and index in bounds, so the accessors don't check
+    bool validate() const;
+    // Memoized in the vectors, indexed like the file
+    symbol_t import_string(uint32_t string, std::vector<symbol_t>& symbols) const;
+    node_index_t import_type(cFlatAST& ast, uint32_t type, std::vector<symbol_t>& symbols, std::vector<node_index_t>& types) const;
+
+    std::unique_ptr<cSourceFile> m_mapping;
+    const sInterfaceHeader* m_header = nullptr;
+    const sInterfaceTypeNode* m_type_nodes = nullptr;
+    const sInterfaceParam* m_params = nullptr;
+    const sInterfaceFunction* m_functions = nullptr;
+    const sInterfaceTypeDecl* m_type_decls = nullptr;
+    const sInterfaceString* m_strings = nullptr;
+    const char* m_chars = nullptr;
+};
+
+// Modules imported by the source, in order, found by lexing it without parsing
+std::vector<std::string> find_imports(std::string_view source);
+// <path>/<module>.dpi in the first import path that has it, empty if none does
+std::string find_interface_file(std::string_view module, const std::vector<std::string>& import_paths);
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+
+typedef uint32_t symbol_t;
+
+// Interned by the interner constructor, in this order, so their ids are fixed
+enum eBuiltinSymbol : symbol_t {
+    SYM_INT           = 0,
+    SYM_FLOAT         = 1,
+    SYM_BOOL          = 2,
+    SYM_VOID          = 3,
+
+    // Type operators
+    SYM_PRODUCT       = 4,
+    SYM_SUM           = 5,
+    SYM_ARROW         = 6,
+
+    SYM_BUILTIN_COUNT = 7,
+
+    SYM_NONE          = UINT32_MAX,
+};
+
+
+// Open addressing map from strings to symbols. Keys are views, the owner
+// keeps the characters alive.
+class cSymbolMap {
+public:
+    cSymbolMap();
+
+    // SYM_NONE if the string isn't in the map
+    inline symbol_t find(std::string_view str, uint64_t hash) const {
+        size_t mask = this->m_entries.size() - 1;
+        for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+            const sEntry& entry = this->m_entries[slot];
+            if (entry.symbol == SYM_NONE) { return SYM_NONE; }
+            if (entry.hash == hash && entry.length == str.size() && memcmp(entry.data, str.data(), str.size()) == 0) {
+                return entry.symbol;
+            }
+        }
+    }
+
+    void insert(std::string_view str, uint64_t hash, symbol_t symbol);
+
+    static inline uint64_t hash_string(std::string_view str) {
+        uint64_t hash = 0x9E3779B97F4A7C15ull ^ str.size();
+        size_t i = 0;
+        for (; i + 8 <= str.size(); i += 8) {
+            uint64_t chunk;
+            memcpy(&chunk, str.data() + i, 8);
+            hash = (hash ^ chunk) * 0xFF51AFD7ED558CCDull;
+        }
+        for (; i < str.size(); ++i) { hash = (hash ^ (uint8_t)str[i]) * 0x100000001B3ull; }
+        return hash ^ (hash >> 29);
+    }
+private:
+    struct sEntry {
+        uint64_t hash;
+        const char* data;
+        uint32_t length;
+        symbol_t symbol;
+    };
+
+    void grow();
+
+    std::vector<sEntry> m_entries;
+    size_t m_count;
+};
+
+
+// Process wide string table, every distinct name is stored once and
+// identified by a stable symbol id. Ids are dense and never reused.
+// Interning takes a lock, reading a symbol back doesn't.
+class cStringInterner {
+public:
+    static cStringInterner& get();
+
+    symbol_t intern(std::string_view str);
+    std::string_view get_string(symbol_t symbol) const;
+    size_t size() const;
+
+    cStringInterner(const cStringInterner&) = delete;
+    cStringInterner& operator=(const cStringInterner&) = delete;
+private:
+    cStringInterner();
+    ~cStringInterner();
+
+    // Chunk k holds STRING_CHUNK_BASE << k views, so 32 chunks cover every
+    // symbol_t and a chunk never moves once allocated
+    static const uint32_t STRING_CHUNK_BASE = 1024;
+    static const uint32_t STRING_CHUNK_COUNT = 32;
+    static inline uint32_t get_chunk(symbol_t symbol) { return 31 - __builtin_clz(symbol / STRING_CHUNK_BASE + 1); }
+    static inline uint32_t get_chunk_start(uint32_t chunk) { return STRING_CHUNK_BASE * ((1u << chunk) - 1); }
+
+    const char* store(std::string_view str);
+
+    // Characters are copied into fixed blocks so views stay valid
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_block_used;
+    std::vector<std::unique_ptr<char[]>> m_large_strings;
+
+    cSymbolMap m_symbols;
+    // Written under the lock, the count is published after the view so
+    // readers below it see complete views
+    std::atomic<std::string_view*> m_string_chunks[STRING_CHUNK_COUNT];
+    std::atomic<uint32_t> m_string_count;
+
+    std::mutex m_mutex;
+};
+
+inline symbol_t intern_string(std::string_view str) { return cStringInterner::get().intern(str); }
+
+
+// Unsynchronized front cache for the global interner, owned by a single
+// lexer so hits don't take the interner lock. Cached views point into the
+// lexer's source, which must outlive the cache.
+class cSymbolCache {
+public:
+    inline symbol_t intern(std::string_view str) {
+        uint64_t hash = cSymbolMap::hash_string(str);
+        symbol_t symbol = this->m_symbols.find(str, hash);
+        if (symbol != SYM_NONE) { return symbol; }
+
+        symbol = intern_string(str);
+        this->m_symbols.insert(str, hash, symbol);
+        return symbol;
+    }
+private:
+    cSymbolMap m_symbols;
+};
+inline std::string_view get_symbol_string(symbol_t symbol) { return cStringInterner::get().get_string(symbol); }
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+
+#include "flat_ast.h"
+#include "parser.h"
+
+
+// In memory compilation and execution of the generated module with ORC LLJIT,
+// no object file and no link step.
+// Modules are compiled whole on the first lookup. Units added from the flat
+// AST are lazy: each function is lowered and compiled on its first call,
+// calls go through stubs until then.
+class cJIT {
+public:
+    // Same cpu, features and codegen level as the target machine of the code
+    // generator. Returns nullptr if the JIT can't be created for the host
+    static std::unique_ptr<cJIT> create(const llvm::TargetMachine& target_machine);
+
+    // Takes the module and the context of the code generator, nothing can be
+    // generated with it afterwards
+    bool add_module(std::shared_ptr<cCodeGenerator> code_generator);
+    // Each function of the checked unit is lowered on its first call, alone
+    // in a module, with the options, target machine and optimizer of
+    // configured. The AST must outlive the JIT
+    bool add_lazy_unit(const cFlatAST& ast, std::shared_ptr<const cCodeGenerator> configured);
+
+    // Functions of a lazy unit are stubs. Null if the symbol is missing
+    void* lookup(std::string_view name);
+
+    cJIT(const cJIT&) = delete;
+    cJIT& operator=(const cJIT&) = delete;
+
+    ~cJIT() = default;
+private:
+    explicit cJIT(std::unique_ptr<llvm::orc::LLJIT> jit);
+
+    std::unique_ptr<llvm::orc::LLJIT> m_jit;
+
+    // Stubs and call through trampolines of add_lazy_unit, created with it
+    std::unique_ptr<llvm::orc::LazyCallThroughManager> m_call_through;
+    std::unique_ptr<llvm::orc::IndirectStubsManager> m_stubs;
+    // Function bodies of the lazy units, the stubs live in the main dylib
+    llvm::orc::JITDylib* m_bodies = nullptr;
+};
+
+// Entry points take no parameter and return int, float, bool or void.
+// Builtin return type of the function, TYPE_NONE if it can't be an entry point
+type_id_t get_entry_return_type(const llvm::Function& function);
+type_id_t get_entry_return_type(const cFlatAST& ast, node_index_t function);
+// Calls the entry point and prints its result
+void call_entry(void* address, type_id_t return_type);
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "interner.h"
+
 enum eTokenType {
     TOK_EOF           = -1,
     TOK_UNKNOWN       = -2,
@@ -37,33 +41,81 @@ enum eTokenType {
 
     TOK_TRUE          = -21,
     TOK_FALSE         = -22,
+
+    TOK_MATCH         = -23,
+    TOK_CASE          = -24,
+    TOK_WHERE         = -25,
+    TOK_FORALL        = -26,
+
+    TOK_IMPORT        = -27,
 };
 
 std::string get_token_type_string(eTokenType token_type);
 
+// Keyword token type for the given identifier, TOK_IDENTIFIER if it isn't one
+eTokenType classify_identifier(std::string_view identifier);
+
+// Tokens don't own their text, they are a slice of the source buffer
+// Identifiers also carry their interned symbol, SYM_NONE otherwise
 struct sToken {
-    eTokenType token_type;   
-    std::string value;
+    eTokenType token_type;
+    uint32_t offset;
+    uint32_t length;
     int line_number;
+    symbol_t symbol;
+
+    inline std::string_view get_value(std::string_view source) const { return source.substr(offset, length); }
+};
+
+void print_tokens(std::string_view source, const std::vector<sToken>& tokens);
+
+
+// What the lexer does with the comments it scans
+enum eCommentMode {
+    COMMENTS_KEEP,   // Emitted as TOK_COMMENT tokens
+    COMMENTS_DROP,   // Skipped, the parser never sees them
+    COMMENTS_TRIVIA, // Skipped, recorded in the trivia table
+};
+
+// A comment and the index of the token following it
+struct sTrivia {
+    uint32_t token_index;
+    sToken comment;
 };
 
 
 class cLexer {
 public:
-    cLexer(std::string input_str);
+    // The lexer doesn't own the input, it must outlive the lexer
+    cLexer(std::string_view input_str, eCommentMode comment_mode = COMMENTS_DROP);
 
+    // Next non comment token unless comments are kept
     sToken get_next_token();
     void lex();
     inline char consume_char();
     inline char peek_char() const;
     void print_tokens() const;
     const std::vector<sToken>& get_tokens();
+    // Moves the lexed tokens out of the lexer
+    std::vector<sToken> take_tokens();
+    inline std::string_view get_input() const { return m_input_str; }
+    inline std::string_view get_token_value(const sToken& token) const { return token.get_value(m_input_str); }
+    // Comments in source order, only filled in COMMENTS_TRIVIA mode
+    inline const std::vector<sTrivia>& get_trivia() const { return m_trivia; }
 
     ~cLexer() = default;
 private:
-    std::string m_input_str;
-    int m_current_pos;
+    sToken scan_token();
+
+    std::string_view m_input_str;
+    size_t m_current_pos;
     std::vector<sToken> m_tokens;
     int m_current_line_count;
+    cSymbolCache m_symbol_cache;
+
+    eCommentMode m_comment_mode;
+    std::vector<sTrivia> m_trivia;
+    // Tokens returned by get_next_token so far
+    uint32_t m_token_count;
 };
 
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+
+
+enum eLogLevel {
+    LOG_ERROR,
+    LOG_WARNING,
+    LOG_INFO,
+    LOG_DEBUG,
+    // Per token, per operation... only for small inputs
+    LOG_TRACE,
+};
+
+enum eLogCategory {
+    LOG_DRIVER,
+    LOG_LEXER,
+    LOG_PARSER,
+    LOG_CODEGEN,
+    LOG_TYPES,
+
+    LOG_CATEGORY_COUNT,
+};
+
+// Most verbose level compiled in, messages above it are discarded at compile
+// time. Debug builds use -DDEPLANG_LOG_MAX_LEVEL=LOG_TRACE
+#ifndef DEPLANG_LOG_MAX_LEVEL
+# define DEPLANG_LOG_MAX_LEVEL LOG_INFO
+#endif
+
+
+// Runtime filter of the compiled in messages: a level and a set of categories.
+// Messages go to stderr as ::[Category]::Level: message
+class cLogger {
+public:
+    static cLogger& get();
+
+    inline bool is_enabled(eLogLevel level, eLogCategory category) const {
+        return level <= m_level && (m_categories & (1u << category));
+    }
+
+    inline void set_level(eLogLevel level) { m_level = level; }
+    inline void set_categories(uint32_t categories) { m_categories = categories; }
+
+    // Writes the prefix of a message
+    std::ostream& begin(eLogLevel level, eLogCategory category);
+
+    cLogger(const cLogger&) = delete;
+    cLogger& operator=(const cLogger&) = delete;
+private:
+    cLogger();
+
+    eLogLevel m_level;
+    uint32_t m_categories;
+};
+
+// error, warning, info, debug or trace, false for anything else
+bool parse_log_level(std::string_view name, eLogLevel& level);
+// Comma separated category names (driver, lexer, parser, codegen, types or all),
+// false on an unknown name
+bool parse_log_categories(std::string_view names, uint32_t& categories);
+
+
+// Usable as a condition for blocks that print more than a message:
+//  if (DEPLANG_LOG_ENABLED(LOG_DEBUG, LOG_CODEGEN)) { module->print(llvm::errs(), nullptr); }
+#define DEPLANG_LOG_ENABLED(level, category) ((level) <= DEPLANG_LOG_MAX_LEVEL && cLogger::get().is_enabled(level, category))
+
+// The message is only evaluated when it is printed
+#define DEPLANG_LOG(level, category, msg)                                                   \
+    do {                                                                                    \
+        if constexpr ((level) <= DEPLANG_LOG_MAX_LEVEL) {                                   \
+            if (cLogger::get().is_enabled(level, category)) {                               \
+                cLogger::get().begin(level, category) << msg << std::endl;                  \
+            }                                                                               \
+        }                                                                                   \
+    } while (0)
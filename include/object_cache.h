@@ -0,0 +1,49 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "compiler_options.h"
+
+
+// On disk cache of object files, content addressed: the key is a hash of
+// everything the object depends on (source bytes, compiler build, target
+// triple, cpu, features and options). A hit skips every stage.
+// Entries are written to a temporary file and renamed, so concurrent
+// compilers can share a directory.
+class cObjectCache {
+public:
+    // The directory is created on the first store
+    explicit cObjectCache(const std::string& directory);
+
+    // The dependencies are files the object also depends on, interface files
+    // of the imports, hashed by content. The pipeline names the frontend that
+    // produced it
+    std::string compute_key(std::string_view source, const sCompilerOptions& options, const std::vector<std::string>& dependencies = {}, std::string_view pipeline = {}) const;
+
+    // An entry is the object and the other outputs of the compilation, one
+    // file per extension. Copies the cached files to file_names, a miss
+    // unless every one of them is cached
+    bool fetch(const std::string& key, const std::vector<std::string>& file_names);
+    bool store(const std::string& key, const std::vector<std::string>& file_names);
+    // Unique file next to the entry of the key, empty on error. Written, then
+    // moved in with insert, it saves the copy of store
+    std::string create_temporary(const std::string& key, std::string_view extension = ".o");
+    // The temporary file is removed on error
+    bool insert(const std::string& key, const std::string& temporary_file_name, std::string_view extension = ".o");
+
+    // Hits and misses of every run that used the directory
+    void print_statistics(std::ostream& out) const;
+
+    // Where the entry of the key is, whether it exists or not
+    std::string get_entry_path(const std::string& key, std::string_view extension = ".o") const;
+    inline const std::string& get_directory() const { return m_directory; }
+
+private:
+    // Hit and miss counters of the directory, locked between processes
+    void record_lookup(bool hit);
+
+    std::string m_directory;
+};
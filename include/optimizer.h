@@ -0,0 +1,51 @@
+#pragma once
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "compiler_options.h"
+
+
+// Optimization pipelines of the new pass manager for one -O level.
+// The function pipeline runs on each function right after it is generated,
+// the module pipeline once on the whole module before emission.
+// With llvm::TimePassesIsEnabled the passes are timed, the report is printed
+// when the optimizer is destroyed. With the profiler enabled every pass is a
+// scope of the trace.
+class cOptimizer {
+public:
+    // The target machine tunes the pipelines (cost model of the vectorizers...), can be null
+    cOptimizer(eOptLevel opt_level, llvm::TargetMachine* target_machine);
+    ~cOptimizer() = default;
+
+    cOptimizer(const cOptimizer&) = delete;
+    cOptimizer& operator=(const cOptimizer&) = delete;
+
+    void optimize_function(llvm::Function& function);
+    void optimize_module(llvm::Module& module);
+
+    inline eOptLevel get_opt_level() const { return m_opt_level; }
+
+private:
+    eOptLevel m_opt_level;
+
+    llvm::PassInstrumentationCallbacks m_instrumentation;
+    std::unique_ptr<llvm::TimePassesHandler> m_time_passes;
+
+    llvm::LoopAnalysisManager m_loop_analyses;
+    llvm::FunctionAnalysisManager m_function_analyses;
+    llvm::CGSCCAnalysisManager m_cgscc_analyses;
+    llvm::ModuleAnalysisManager m_module_analyses;
+    llvm::PassBuilder m_pass_builder;
+
+    llvm::FunctionPassManager m_function_passes;
+    llvm::ModulePassManager m_module_passes;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+#include "compiler_options.h"
+#include "flat_ast.h"
+
+
+// Parallel code generation of a flat unit. The functions are split in
+// contiguous chunks in source order, one chunk per job, chunk sizes differ by
+// at most one function. Each job lowers its
+// chunk with its own code generator (own context and module), optimizes it and
+// emits <output_prefix>.<chunk>.o, so the output doesn't depend on scheduling.
+// Every job declares all the types and functions of the unit, calls to other
+// chunks are resolved at link time.
+bool codegen_flat_parallel(const cFlatAST& ast, const sCompilerOptions& options, unsigned jobs, const std::string& output_prefix);
@@ -4,7 +4,10 @@
 #include <locale>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "llvm/ADT/APFloat.h"
@@ -24,6 +27,8 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
 
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/SubtargetFeature.h"
 #include "llvm/MC/TargetRegistry.h"
 
 #include "llvm/Support/FileSystem.h"
@@ -36,14 +41,30 @@
 #include "llvm/Support/Host.h"
 
 
+#include "../include/arena.h"
+#include "../include/compiler_options.h"
+#include "../include/interner.h"
 #include "../include/lexer.h"
+#include "../include/log.h"
+#include "../include/optimizer.h"
+#include "../include/profiler.h"
+#include "../include/types/dep_type.h"
 
 
 // @TODO: Change Macro
 # define DEPLANG_PARSER_ERROR(err) std::cerr << "::[Parser]::Error: " << err << std::endl
 
 
-struct sTypedValue;
+// Small value type, an empty value (null llvm::Value) signals an error
+struct sTypedValue {
+    llvm::Value* value;
+    llvm::Type* type;
+
+    sTypedValue() : value(nullptr), type(nullptr) {}
+    sTypedValue(llvm::Value* value, llvm::Type* type) : value(value), type(type) {}
+
+    explicit operator bool() const { return value != nullptr; }
+};
 
 
 class cCodeGenerator {
@@ -54,27 +75,64 @@ public:
     std::unique_ptr<llvm::IRBuilder<>> m_Builder;
 
     std::unique_ptr<llvm::Module> m_Module;
-    std::map<std::string, sTypedValue*> m_NamedValues;
-    std::map<std::string, llvm::Type*> m_NamedTypes;
+    std::unordered_map<symbol_t, sTypedValue> m_NamedValues;
+    // Lowering of each canonical type, indexed by type_id_t. The builtin
+    // primitives are seeded on construction, declared types are added by
+    // define_named_type, composite types are filled on first use
+    std::vector<llvm::Type*> m_LoweredTypes;
+    // Type id of each type name met so far, indexed by symbol_t, so lookups
+    // don't go through the type table lock
+    std::vector<type_id_t> m_NamedTypeIds;
+
+    // Target and optimizer for the options, must be called before any
+    // function is generated to get the per function passes
+    void configure(const sCompilerOptions& options);
+    // Shares the target machine and optimizer of a configured generator, for
+    // modules generated one after the other. Not for concurrent use
+    void configure(const cCodeGenerator& configured);
+    inline const sCompilerOptions& get_options() const { return m_options; }
+
+    // Runs the per function pipeline, no-op at -O0 or on invalid functions
+    void optimize_function(llvm::Function& function);
+    void optimize_module();
+    // Runs the module pipeline and writes the object file, false on error
+    bool emit_object_code(const std::string& object_file_name);
+
+    std::shared_ptr<llvm::TargetMachine> m_TargetMachine;
 
     void delete_named_values();
+    void define_named_type(symbol_t name, llvm::Type* type);
     ~cCodeGenerator() = default;
 
     // ~cCodeGenerator() = default;
 private:
+    sCompilerOptions m_options;
+    std::shared_ptr<cOptimizer> m_optimizer;
 };
 
-inline llvm::Type* get_llvm_type(const std::string& type, std::shared_ptr<cCodeGenerator> code_generator);
+// Builtin or declared type, reports an error and returns null on a miss
+llvm::Type* get_llvm_type(symbol_t type, std::shared_ptr<cCodeGenerator> code_generator);
+// Memoized, each canonical type is lowered once per code generator
+llvm::Type* lower_type(type_id_t type, std::shared_ptr<cCodeGenerator> code_generator);
 
 // @TODO: Implement
-sTypedValue* build_ir_operation(sTypedValue* l, sTypedValue* r, std::string op, std::shared_ptr<cCodeGenerator> code_generator);
+sTypedValue build_ir_operation(sTypedValue l, sTypedValue r, std::string_view op, std::shared_ptr<cCodeGenerator> code_generator);
+// The ',' operator, both values stored in a struct on the stack
+sTypedValue build_ir_tuple(sTypedValue l, sTypedValue r, std::shared_ptr<cCodeGenerator> code_generator);
+// Binds a declared variable to its initializer, or to zero of the declared
+// type without one: the type checker only knows the declared type until it
+// is assigned. Both null when the type couldn't be generated
+sTypedValue build_ir_variable_declaration(symbol_t name, sTypedValue initializer, llvm::Type* declared_type, std::shared_ptr<cCodeGenerator> code_generator);
 
 
+// AST nodes are allocated in the parser's arena and released with it, their
+// destructors are never run. Children are raw pointers into the same arena.
 class ExprAST {
 public:
-    virtual ~ExprAST() = default;
-    virtual sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) = 0;
+    virtual sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) = 0;
     virtual void print() = 0;
+protected:
+    ~ExprAST() = default;
 };
 
 
@@ -85,7 +143,7 @@ public:
     LiteralIntExprAST(const std::string& value) : m_value(std::stoi(value)) {}
     inline const int get_value() { return m_value; }
 
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
 
     void print() override;
 private:
@@ -97,9 +155,8 @@ class LiteralFloatExprAST : public ExprAST {
 public:
     LiteralFloatExprAST(const std::string& value) : m_value(std::stof(value)) {}
     inline const float get_value() { return m_value; }
-    std::unique_ptr<ExprAST> parse_type_expr();
 
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
     void print() override;
 private:
     float m_value;
@@ -110,7 +167,7 @@ public:
     LiteralBoolExprAST(bool value) : m_value(value) {}
     inline const bool get_value() { return m_value; }
 
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
     void print() override;
 private:
     bool m_value;
@@ -119,67 +176,71 @@ private:
 // Name
 class VariableExprAST : public ExprAST {
 public:
-    VariableExprAST(const std::string& name);
+    VariableExprAST(symbol_t name);
 
-    const std::string& get_name();
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    symbol_t get_name();
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
     void print() override;
 private:
-    std::string m_name;
+    symbol_t m_name;
 };
 
 // Type
 class TypeExrAST : public ExprAST {
 public:
-    TypeExrAST(const std::string& name, std::unique_ptr<TypeExrAST> lhs, std::unique_ptr<TypeExrAST> rhs);
-    TypeExrAST(const std::string& name);
+    TypeExrAST(symbol_t name, TypeExrAST* lhs, TypeExrAST* rhs);
+    TypeExrAST(symbol_t name);
 
     // @TODO: Change to real type
-    const std::string& get_primitive_type();
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    symbol_t get_primitive_type();
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
 
+    // Canonical type of the expression, TYPE_NONE if it isn't a valid type
+    type_id_t resolve_type();
     llvm::Type* register_type(std::shared_ptr<cCodeGenerator> code_generator);
     void print() override;
 
-    bool type_check(const TypeExrAST* other_type_expr);
+    bool type_check(TypeExrAST* other_type_expr);
 private:
-    std::string m_prim_type;
-    std::unique_ptr<TypeExrAST> m_left, m_right;
+    symbol_t m_prim_type;
+    TypeExrAST *m_left, *m_right;
+    type_id_t m_type_id;
 };
 
 // Expr Op Expr
 class BinaryExprAST : public ExprAST {
 public:
-    BinaryExprAST(std::string op, std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs);
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    // The operator is a slice of the source
+    BinaryExprAST(std::string_view op, ExprAST* lhs, ExprAST* rhs);
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
     void print() override;
 private:
-    std::string m_op;
-    std::unique_ptr<ExprAST> m_lhs, m_rhs;
+    std::string_view m_op;
+    ExprAST *m_lhs, *m_rhs;
 };
 
 class ReturnExprAST : public ExprAST {
 public:
-    ReturnExprAST(std::unique_ptr<ExprAST> expression);
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    ReturnExprAST(ExprAST* expression);
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
     void print() override;
 private:
-    std::unique_ptr<ExprAST> m_expression;
+    ExprAST* m_expression;
 };
 
 // Function parameter expression
 // function_parameter := identifier ":" identifier
 class FunctionParameterAST {
 public:
-    FunctionParameterAST(const std::string& param_name, std::unique_ptr<TypeExrAST> param_type);
-    inline const std::string& get_param_name();
+    FunctionParameterAST(symbol_t param_name, TypeExrAST* param_type);
+    inline symbol_t get_param_name();
     
     // @TODO: Change type
-    inline const std::string& get_primitive_type();
-    std::unique_ptr<TypeExrAST> m_type_expr;
+    inline symbol_t get_primitive_type();
+    TypeExrAST* m_type_expr;
 
 private:
-    std::string m_param_name;
+    symbol_t m_param_name;
 };
 
 // Function definition
@@ -188,18 +249,22 @@ private:
 // "}"
 class FunctionDefinitionAST {
 public: 
-    FunctionDefinitionAST(const std::string& function_name, std::vector<std::unique_ptr<FunctionParameterAST>> parameters, std::unique_ptr<TypeExrAST> return_type, std::vector<std::unique_ptr<ExprAST>> function_body);
+    // Parameters and body are arrays in the arena
+    FunctionDefinitionAST(symbol_t function_name, llvm::ArrayRef<FunctionParameterAST*> parameters, TypeExrAST* return_type, llvm::ArrayRef<ExprAST*> function_body);
 
-    inline const std::string& get_function_name();
+    inline symbol_t get_function_name();
 
-    llvm::Function* codegen(std::shared_ptr<cCodeGenerator> code_generator);
+    // Declares the function, then codegen fills in the body of the
+    // declaration
+    llvm::Function* codegen_prototype(std::shared_ptr<cCodeGenerator> code_generator);
+    llvm::Function* codegen(std::shared_ptr<cCodeGenerator> code_generator, llvm::Function* func);
 
     void print();
 private:
-    std::string m_function_name;
-    std::vector<std::unique_ptr<FunctionParameterAST>> m_parameters;
-    std::unique_ptr<TypeExrAST> m_return_type;
-    std::vector<std::unique_ptr<ExprAST>> m_function_body;
+    symbol_t m_function_name;
+    llvm::ArrayRef<FunctionParameterAST*> m_parameters;
+    TypeExrAST* m_return_type;
+    llvm::ArrayRef<ExprAST*> m_function_body;
 };
 
 
@@ -207,34 +272,34 @@ private:
 // @Check: Does it need to be an ExprAST
 class VariableDeclarationExprAST: public ExprAST {
 public:
-    VariableDeclarationExprAST(const std::string& variable_name, std::unique_ptr<TypeExrAST> variable_type);
-    VariableDeclarationExprAST(const std::string& variable_name, std::unique_ptr<TypeExrAST> variable_type, std::unique_ptr<ExprAST> expression);
+    VariableDeclarationExprAST(symbol_t variable_name, TypeExrAST* variable_type);
+    VariableDeclarationExprAST(symbol_t variable_name, TypeExrAST* variable_type, ExprAST* expression);
 
-    inline const std::string& get_variable_name();
+    inline symbol_t get_variable_name();
 
     // @TODO: Change type
-    inline const std::string& get_primitive_type();
+    inline symbol_t get_primitive_type();
 
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
     void print() override;
 
 private:
-    std::string m_variable_name;
-    std::unique_ptr<TypeExrAST> m_variable_type;
-    std::unique_ptr<ExprAST> m_expression;
+    symbol_t m_variable_name;
+    TypeExrAST* m_variable_type;
+    ExprAST* m_expression;
 };
 
 
 // Callee([args])
 class CallExprAST : public ExprAST {
 public:
-    CallExprAST(const std::string& callee, std::vector<std::unique_ptr<ExprAST>> args);
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    CallExprAST(symbol_t callee, llvm::ArrayRef<ExprAST*> args);
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
     void print() override;
 
 private:
-    std::string m_callee;
-    std::vector<std::unique_ptr<ExprAST>> m_args;
+    symbol_t m_callee;
+    llvm::ArrayRef<ExprAST*> m_args;
 };
 
 
@@ -242,83 +307,112 @@ private:
 // identifier '=' expr
 class AssignmentExprAST : public ExprAST {
 public:
-    AssignmentExprAST(const std::string& variable, std::unique_ptr<ExprAST> rhs);
+    AssignmentExprAST(symbol_t variable, ExprAST* rhs);
 
-    inline const std::string& get_variable_name();
-    sTypedValue* codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
+    inline symbol_t get_variable_name();
+    sTypedValue codegen(std::shared_ptr<cCodeGenerator> code_generator) override;
     void print() override;
 
 private:
-    std::string m_variable;
-    std::unique_ptr<ExprAST> m_rhs;
+    symbol_t m_variable;
+    ExprAST* m_rhs;
 };
 
 // Custom type declaration
 // type identifier '=' type_expr
 class TypeDeclarationExprAST {
 public:
-    TypeDeclarationExprAST(const std::string& type_name, std::unique_ptr<TypeExrAST> type_def);
+    TypeDeclarationExprAST(symbol_t type_name, TypeExrAST* type_def);
 
     llvm::Type* codegen(std::shared_ptr<cCodeGenerator> code_generator);
 private:
-    std::string m_type_name;
-    std::unique_ptr<TypeExrAST> m_type_definition;
+    symbol_t m_type_name;
+    TypeExrAST* m_type_definition;
 };
 
 
-struct sTypedValue {
-    llvm::Value* value;
-    llvm::Type* type;
-    sTypedValue(llvm::Value* value, llvm::Type* type) {
-        this->value = value; this->type = type;
-    }
-    ~sTypedValue() = default;
-};
 
 
+class cFlatAST;
+// Index of a node in a cFlatAST, see flat_ast.h
+typedef uint32_t node_index_t;
 
 
 class cParser {
 public:
-    cParser(std::vector<sToken> tokens);
+    // Tokens are slices of source, it must outlive the parser
+    // Comments must have been stripped by the lexer, see eCommentMode
+    cParser(std::string_view source, std::vector<sToken> tokens);
+
+    // Streaming mode: tokens are pulled from the lexer on demand, lex() must
+    // not have been called. The lexer must outlive the parser.
+    cParser(cLexer* lexer);
 
     sToken get_next_token();
     const sToken& peek_next_token();
+    inline std::string_view get_token_value(const sToken& token) const { return token.get_value(m_source); }
 
-    std::unique_ptr<ExprAST> parse_number_expr();
-    std::unique_ptr<ExprAST> parse_paren_expr();
-    std::unique_ptr<ExprAST> parse_expression();
-    std::unique_ptr<ExprAST> parse_identifier_expr();
-    std::unique_ptr<ExprAST> parse_primary();
-    std::unique_ptr<TypeExrAST> parse_type();
-    std::unique_ptr<TypeDeclarationExprAST> parse_type_declaration();
-
-    std::unique_ptr<ReturnExprAST> parse_return_expr();
-
-    std::unique_ptr<ExprAST> parse_binop_expression(int expr_prec, std::unique_ptr<ExprAST> lhs);
-
-    std::unique_ptr<TypeExrAST> parse_type_expression(int expr_prec, std::unique_ptr<TypeExrAST> lhs);
+    inline cArena& get_arena() { return m_arena; }
 
-    std::unique_ptr<FunctionParameterAST> parse_function_parameter();
-    std::unique_ptr<FunctionDefinitionAST> parse_function_definition();
+    int get_binop_precedence(std::string_view op);
+    int get_type_operator_precedence(std::string_view op);
 
-    std::unique_ptr<VariableDeclarationExprAST> parse_variable_declaration();
+    void emit_object_code(std::string file_name);
 
-    int get_binop_precedence(std::string op);
-    int get_type_operator_precedence(std::string op);
+    // Generates the definitions once the whole input is parsed, false at the
+    // first error. Tree nodes are owned by the parser's arena
+    bool parse();
 
-    void emit_object_code(std::string file_name);
+    // Same grammar, emitted in the flat representation instead of
+    // generating the definitions
+    bool parse_flat(cFlatAST& ast);
 
-    void parse();
     std::shared_ptr<cCodeGenerator> m_code_generator;
     
 
     ~cParser() = default;
 
 private:
+    // One recursive descent grammar for both representations, the builder
+    // makes the nodes. See sTreeBuilder and sFlatBuilder in parser.cpp
+    template <typename Builder> bool parse_definitions(Builder& builder);
+    template <typename Builder> typename Builder::expr_t parse_number_expr(Builder& builder);
+    template <typename Builder> typename Builder::expr_t parse_paren_expr(Builder& builder);
+    template <typename Builder> typename Builder::expr_t parse_expression(Builder& builder);
+    template <typename Builder> typename Builder::expr_t parse_identifier_expr(Builder& builder);
+    template <typename Builder> typename Builder::expr_t parse_primary(Builder& builder);
+    template <typename Builder> typename Builder::type_t parse_type(Builder& builder);
+    template <typename Builder> typename Builder::type_t parse_full_type(Builder& builder);
+    template <typename Builder> typename Builder::type_decl_t parse_type_declaration(Builder& builder);
+    template <typename Builder> bool parse_import(Builder& builder);
+    template <typename Builder> typename Builder::expr_t parse_return_expr(Builder& builder);
+    template <typename Builder> typename Builder::expr_t parse_binop_expression(Builder& builder, int expr_prec, typename Builder::expr_t lhs);
+    template <typename Builder> typename Builder::type_t parse_type_expression(Builder& builder, int expr_prec, typename Builder::type_t lhs);
+    template <typename Builder> typename Builder::param_t parse_function_parameter(Builder& builder);
+    template <typename Builder> typename Builder::function_t parse_function_definition(Builder& builder);
+    template <typename Builder> typename Builder::expr_t parse_variable_declaration(Builder& builder);
+
+    sToken pull_token();
+    void fill_lookahead(size_t count);
+    void pop_lookahead();
+
+    std::string_view m_source;
+
+    // Every AST node of the unit, released in bulk with the parser
+    cArena m_arena;
+
+    // Token source, the lexer in streaming mode, the token vector otherwise
+    cLexer* m_lexer;
     std::vector<sToken> m_tokens;
+    size_t m_current_index;
+
+    // Tokens pulled from the source but not consumed yet
+    static const size_t LOOKAHEAD_SIZE = 4;
+    sToken m_lookahead[LOOKAHEAD_SIZE];
+    size_t m_lookahead_start;
+    size_t m_lookahead_count;
+
     sToken m_current_token;
-    int m_current_index;
 
     std::string m_target_triple;
 };
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+struct sProfileEvent {
+    std::string name;
+    std::string detail;
+    // "compiler" for our own scopes, "pass" for the LLVM passes
+    const char* category;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint32_t thread;
+};
+
+// Process wide recorder of timed scopes, on a monotonic clock. Disabled by
+// default, scopes then only cost a check of the flag.
+// Scopes nest per thread, the events are written as a Chrome trace
+// (chrome://tracing, Perfetto) like clang's -ftime-trace.
+class cProfiler {
+public:
+    static cProfiler& get();
+
+    void enable();
+    inline bool is_enabled() const { return m_enabled; }
+
+    void begin(std::string_view name, std::string_view detail = {}, const char* category = "compiler");
+    // Closes the innermost scope opened by the thread
+    void end();
+
+    bool write_trace(const std::string& file_path) const;
+    // Total, count and average of each compiler scope, the passes are left to
+    // the LLVM pass timing report
+    void print_summary(std::ostream& out) const;
+
+    cProfiler(const cProfiler&) = delete;
+    cProfiler& operator=(const cProfiler&) = delete;
+private:
+    cProfiler();
+
+    uint64_t now() const;
+
+    bool m_enabled;
+    std::chrono::steady_clock::time_point m_start;
+
+    std::vector<sProfileEvent> m_events;
+    uint32_t m_thread_count;
+    mutable std::mutex m_mutex;
+};
+
+
+// Profiler scope for the lifetime of the timer. The elapsed time is measured
+// even when the profiler is disabled
+class cScopedTimer {
+public:
+    cScopedTimer(std::string_view name, std::string_view detail = {});
+    ~cScopedTimer();
+
+    // Closes the scope early, returns the elapsed time in ns
+    double stop();
+
+    cScopedTimer(const cScopedTimer&) = delete;
+    cScopedTimer& operator=(const cScopedTimer&) = delete;
+private:
+    std::chrono::steady_clock::time_point m_start;
+    bool m_recording;
+    bool m_stopped;
+};
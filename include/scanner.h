@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Character classes used by the lexer, ASCII only so the result doesn't
+// depend on the current locale (bytes >= 0x80 belong to no class)
+enum eCharClass : uint8_t {
+    CHAR_SPACE       = 1 << 0,
+    CHAR_NEWLINE     = 1 << 1,
+    CHAR_ALPHA       = 1 << 2,
+    CHAR_DIGIT       = 1 << 3,
+    CHAR_UNDERSCORE  = 1 << 4,
+
+    CHAR_IDENT_START = CHAR_ALPHA | CHAR_UNDERSCORE,
+    CHAR_IDENT       = CHAR_ALPHA | CHAR_DIGIT | CHAR_UNDERSCORE,
+};
+
+constexpr uint8_t get_char_class(unsigned ch) {
+    uint8_t char_class = 0;
+    if (ch == ' ' || (ch >= '\t' && ch <= '\r')) { char_class |= CHAR_SPACE; }
+    if (ch == '\n') { char_class |= CHAR_NEWLINE; }
+    if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')) { char_class |= CHAR_ALPHA; }
+    if (ch >= '0' && ch <= '9') { char_class |= CHAR_DIGIT; }
+    if (ch == '_') { char_class |= CHAR_UNDERSCORE; }
+    return char_class;
+}
+
+struct sCharClassTable {
+    uint8_t classes[256];
+};
+
+constexpr sCharClassTable build_char_class_table() {
+    sCharClassTable table = {};
+    for (unsigned ch = 0; ch < 256; ++ch) { table.classes[ch] = get_char_class(ch); }
+    return table;
+}
+
+inline constexpr sCharClassTable CHAR_CLASS_TABLE = build_char_class_table();
+
+inline bool has_char_class(char ch, uint8_t char_class) { return CHAR_CLASS_TABLE.classes[(uint8_t)ch] & char_class; }
+
+// Scanners over data[pos, size), each returns the position of the first
+// char outside the run. They use AVX2 when the cpu has it, SSE2 otherwise,
+// on full vectors and fall back to the table for the remaining chars.
+
+// Whitespace run, newline_count receives the number of '\n' skipped
+size_t scan_whitespace(const char* data, size_t pos, size_t size, int& newline_count);
+
+// [A-Za-z0-9_]*
+size_t scan_identifier_tail(const char* data, size_t pos, size_t size);
+
+// [0-9]*
+size_t scan_digits(const char* data, size_t pos, size_t size);
+
+// Position of the next '\n', or size
+size_t scan_line_end(const char* data, size_t pos, size_t size);
+
+// One implementation of the scanners above
+struct sScanners {
+    const char* name;
+    size_t (*scan_whitespace)(const char* data, size_t pos, size_t size, int& newline_count);
+    size_t (*scan_identifier_tail)(const char* data, size_t pos, size_t size);
+    size_t (*scan_digits)(const char* data, size_t pos, size_t size);
+    size_t (*scan_line_end)(const char* data, size_t pos, size_t size);
+};
+
+// The implementation the scanners dispatch to, picked once from the cpu
+// features
+const sScanners& get_scanners();
+// Each implementation, null if the build or the cpu doesn't support it
+const sScanners* get_scalar_scanners();
+const sScanners* get_sse2_scanners();
+const sScanners* get_avx2_scanners();
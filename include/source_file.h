@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+
+// Read-only view over a source file mapped into memory.
+// The lexer reads directly from the mapping, nothing is copied.
+class cSourceFile {
+public:
+    // Returns nullptr if the file can't be opened or mapped
+    static std::unique_ptr<cSourceFile> open(const std::string& file_path);
+
+    inline std::string_view get_content() const { return std::string_view(m_data, m_size); }
+    inline const std::string& get_path() const { return m_path; }
+    inline size_t get_size() const { return m_size; }
+
+    cSourceFile(const cSourceFile&) = delete;
+    cSourceFile& operator=(const cSourceFile&) = delete;
+
+    ~cSourceFile();
+private:
+    cSourceFile(const std::string& file_path, const char* data, size_t size);
+
+    std::string m_path;
+    const char* m_data;
+    size_t m_size;
+};
@@ -1,4 +1,86 @@
 # pragma once
 
+#include <cstdint>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "../interner.h"
+
+
+// Canonical types: every distinct type is created once in the type table and
+// identified by its type_id_t, two types are equal iff their ids are equal
+typedef uint32_t type_id_t;
+
+enum eTypeKind : uint8_t {
+    TYPE_PRIMITIVE, // int, float, bool, void
+    TYPE_NAMED,     // User declared type, resolved at lowering
+    TYPE_PRODUCT,   // lhs * rhs
+    TYPE_SUM,       // lhs | rhs, see cTypeTable::get_sum
+    TYPE_FUNCTION,  // lhs -> rhs
+    TYPE_DEPENDENT, // forall name. rhs
+};
+
+// Builtin primitives have fixed ids
+enum eBuiltinType : type_id_t {
+    TYPE_INT   = 0,
+    TYPE_FLOAT = 1,
+    TYPE_BOOL  = 2,
+    TYPE_VOID  = 3,
+
+    TYPE_BUILTIN_COUNT = 4,
+    TYPE_NONE = UINT32_MAX,
+};
+
+struct sDepType {
+    eTypeKind kind;
+    // Primitive and named types, binder of dependent types
+    symbol_t name;
+    // Operands of the composite types, TYPE_NONE otherwise
+    type_id_t lhs;
+    type_id_t rhs;
+
+    inline bool operator==(const sDepType& other) const {
+        return kind == other.kind && name == other.name && lhs == other.lhs && rhs == other.rhs;
+    }
+};
+
+
+// Process wide table of the canonical types, the types are never freed
+class cTypeTable {
+public:
+    static cTypeTable& get();
+
+    // Builtin type for the builtin symbols, named type otherwise
+    type_id_t get_named(symbol_t name);
+    type_id_t get_product(type_id_t lhs, type_id_t rhs);
+    // Unions are normalized: nested sums are flattened, operands sorted by id
+    // and deduplicated, then stored as a right leaning chain.
+    // a | (c | b) | a  =>  a | (b | c)
+    type_id_t get_sum(type_id_t lhs, type_id_t rhs);
+    type_id_t get_function(type_id_t param, type_id_t result);
+    type_id_t get_dependent(symbol_t binder, type_id_t body);
+
+    // Ids stay valid for the lifetime of the program
+    sDepType get_type(type_id_t type) const;
+    std::string to_string(type_id_t type) const;
+    size_t size() const;
+
+    cTypeTable(const cTypeTable&) = delete;
+    cTypeTable& operator=(const cTypeTable&) = delete;
+private:
+    cTypeTable();
+
+    type_id_t get_or_create(const sDepType& type);
+    void collect_sum_operands(type_id_t type, std::vector<type_id_t>& operands) const;
+    std::string to_string_unlocked(type_id_t type) const;
+
+    struct sDepTypeHash {
+        size_t operator()(const sDepType& type) const;
+    };
+
+    std::vector<sDepType> m_types;
+    std::unordered_map<sDepType, type_id_t, sDepTypeHash> m_ids;
+    mutable std::mutex m_mutex;
+};
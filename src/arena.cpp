@@ -0,0 +1,34 @@
+#include "../include/arena.h"
+
+static const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+// Bigger allocations get a block of their own so the current block isn't wasted
+static const size_t ARENA_LARGE_ALLOCATION = ARENA_BLOCK_SIZE / 4;
+
+
+cArena::cArena() : m_current(nullptr), m_end(nullptr), m_bytes_allocated(0) {}
+
+void* cArena::allocate_slow(size_t size, size_t alignment) {
+    if (size + alignment > ARENA_LARGE_ALLOCATION) {
+        this->m_large_blocks.emplace_back(new char[size + alignment]);
+        uintptr_t block = (uintptr_t)this->m_large_blocks.back().get();
+
+        this->m_bytes_allocated += size;
+        return (void*)((block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+
+    this->m_blocks.emplace_back(new char[ARENA_BLOCK_SIZE]);
+    this->m_current = this->m_blocks.back().get();
+    this->m_end = this->m_current + ARENA_BLOCK_SIZE;
+
+    return this->allocate(size, alignment);
+}
+
+void cArena::reset() {
+    this->m_large_blocks.clear();
+    this->m_bytes_allocated = 0;
+    if (this->m_blocks.empty()) { return; }
+
+    this->m_blocks.resize(1);
+    this->m_current = this->m_blocks.front().get();
+    this->m_end = this->m_current + ARENA_BLOCK_SIZE;
+}
@@ -0,0 +1,338 @@
+#include "../include/ast_cache.h"
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "../include/compiler_options.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+
+// Byte offsets of the arrays, from the counts of the header
+struct sASTCacheLayout {
+    uint64_t tokens, kinds, payloads, lhs, rhs, extra, roots, strings, chars, size;
+};
+
+static sASTCacheLayout get_layout(const sASTCacheHeader& header) {
+    auto align = [](uint64_t offset) { return (offset + 3) & ~(uint64_t)3; };
+
+    sASTCacheLayout layout;
+    layout.tokens = sizeof(sASTCacheHeader);
+    layout.kinds = align(layout.tokens + header.token_bytes);
+    layout.payloads = align(layout.kinds + header.node_count);
+    layout.lhs = layout.payloads + (uint64_t)header.node_count * sizeof(uint32_t);
+    layout.rhs = layout.lhs + (uint64_t)header.node_count * sizeof(node_index_t);
+    layout.extra = layout.rhs + (uint64_t)header.node_count * sizeof(node_index_t);
+    layout.roots = layout.extra + (uint64_t)header.extra_count * sizeof(node_index_t);
+    layout.strings = layout.roots + (uint64_t)header.root_count * sizeof(node_index_t);
+    layout.chars = layout.strings + (uint64_t)header.string_count * sizeof(sASTCacheString);
+    layout.size = layout.chars + header.char_count;
+    return layout;
+}
+
+
+cASTCacheFile::cASTCacheFile(std::unique_ptr<cSourceFile> mapping) : m_mapping(std::move(mapping)) {
+    const char* data = this->m_mapping->get_content().data();
+    this->m_header = (const sASTCacheHeader*)data;
+    if (this->m_mapping->get_size() < sizeof(sASTCacheHeader)) { return; }
+
+    // Only read by validate if the size matches the layout
+    sASTCacheLayout layout = get_layout(*this->m_header);
+    this->m_tokens = (const uint8_t*)(data + layout.tokens);
+    this->m_kinds = (const uint8_t*)(data + layout.kinds);
+    this->m_payloads = (const uint32_t*)(data + layout.payloads);
+    this->m_lhs = (const node_index_t*)(data + layout.lhs);
+    this->m_rhs = (const node_index_t*)(data + layout.rhs);
+    this->m_extra = (const node_index_t*)(data + layout.extra);
+    this->m_roots = (const node_index_t*)(data + layout.roots);
+    this->m_strings = (const sASTCacheString*)(data + layout.strings);
+    this->m_chars = data + layout.chars;
+}
+
+std::unique_ptr<cASTCacheFile> cASTCacheFile::open(const std::string& file_path) {
+    std::unique_ptr<cSourceFile> mapping = cSourceFile::open(file_path);
+    if (!mapping) { return nullptr; }
+
+    std::unique_ptr<cASTCacheFile> cache(new cASTCacheFile(std::move(mapping)));
+    if (!cache->validate()) {
+        std::cerr << "Invalid AST cache file: " << file_path << std::endl;
+        return nullptr;
+    }
+    return cache;
+}
+
+// Kinds each child slot can hold, as the parser builds them. Expressions and
+// statements are the kinds up to NODE_CALL
+static bool is_expression_kind(uint8_t kind) { return kind <= NODE_CALL; }
+static bool is_type_kind(uint8_t kind) { return kind == NODE_TYPE; }
+static bool is_param_kind(uint8_t kind) { return kind == NODE_PARAM; }
+static bool is_root_kind(uint8_t kind) { return kind == NODE_FUNCTION || kind == NODE_TYPEDECL || kind == NODE_IMPORT || kind == NODE_EXTERN; }
+
+bool cASTCacheFile::validate() const {
+    size_t size = this->m_mapping->get_size();
+    if (size < sizeof(sASTCacheHeader)) { return false; }
+
+    const sASTCacheHeader& header = *this->m_header;
+    if (memcmp(header.magic, AST_CACHE_MAGIC, sizeof(AST_CACHE_MAGIC)) != 0 || header.version != AST_CACHE_VERSION) { return false; }
+    if (get_layout(header).size != size) { return false; }
+
+    for (uint32_t i = 0; i < header.string_count; ++i) {
+        if ((uint64_t)this->m_strings[i].offset + this->m_strings[i].length > header.char_count) { return false; }
+    }
+
+    for (node_index_t node = 0; node < header.node_count; ++node) {
+        if (this->m_kinds[node] > NODE_EXTERN) { return false; }
+        eFlatNodeKind kind = (eFlatNodeKind)this->m_kinds[node];
+        if (has_symbol_payload(kind) && this->m_payloads[node] >= header.string_count) { return false; }
+
+        node_index_t lhs = this->m_lhs[node], rhs = this->m_rhs[node];
+        // Earlier node of one of the kinds the slot can hold
+        auto is_child = [this, node](node_index_t child, bool (*is_kind)(uint8_t)) {
+            return child < node && is_kind(this->m_kinds[child]);
+        };
+        // Count nodes at position in extra
+        auto are_children = [this, &header, &is_child](uint64_t position, uint64_t count, bool (*is_kind)(uint8_t)) {
+            if (position + count > header.extra_count) { return false; }
+            for (uint64_t i = 0; i < count; ++i) {
+                if (!is_child(this->m_extra[position + i], is_kind)) { return false; }
+            }
+            return true;
+        };
+
+        bool valid = true;
+        switch (kind) {
+        case NODE_INT:
+        case NODE_FLOAT:
+        case NODE_BOOL:
+        case NODE_VARIABLE:
+        case NODE_IMPORT:
+            break;
+
+        case NODE_BINARY:
+            valid = is_child(lhs, is_expression_kind) && is_child(rhs, is_expression_kind);
+            break;
+        case NODE_RETURN:
+        case NODE_ASSIGN:
+            valid = is_child(lhs, is_expression_kind);
+            break;
+        case NODE_VARDECL:
+            valid = is_child(lhs, is_type_kind) && (rhs == NODE_NONE || is_child(rhs, is_expression_kind));
+            break;
+        case NODE_CALL:
+            valid = are_children(lhs, rhs, is_expression_kind);
+            break;
+
+        // Named types have no operands, operators two
+        case NODE_TYPE:
+            valid = (lhs == NODE_NONE && rhs == NODE_NONE) || (is_child(lhs, is_type_kind) && is_child(rhs, is_type_kind));
+            break;
+        case NODE_PARAM:
+        case NODE_TYPEDECL:
+            valid = is_child(lhs, is_type_kind);
+            break;
+
+        // [return type, param count, params..., body count, body...]
+        case NODE_FUNCTION:
+        case NODE_EXTERN: {
+            uint64_t position = lhs;
+            if (position + 2 > header.extra_count || !is_child(this->m_extra[position], is_type_kind)) { return false; }
+            uint64_t param_count = this->m_extra[position + 1];
+            position += 2;
+            if (!are_children(position, param_count, is_param_kind)) { return false; }
+            position += param_count;
+            if (kind == NODE_EXTERN) { break; }
+
+            if (position + 1 > header.extra_count) { return false; }
+            uint64_t body_count = this->m_extra[position];
+            valid = are_children(position + 1, body_count, is_expression_kind);
+            break;
+        }
+        }
+        if (!valid) { return false; }
+    }
+
+    for (uint32_t i = 0; i < header.root_count; ++i) {
+        if (this->m_roots[i] >= header.node_count || !is_root_kind(this->m_kinds[this->m_roots[i]])) { return false; }
+    }
+    return true;
+}
+
+bool cASTCacheFile::matches(std::string_view source) const {
+    return this->m_header->build_hash == get_compiler_build_id()
+        && this->m_header->source_size == source.size()
+        && this->m_header->source_hash == llvm::xxHash64(llvm::StringRef(source.data(), source.size()));
+}
+
+std::vector<symbol_t> cASTCacheFile::intern_strings() const {
+    std::vector<symbol_t> symbols(this->m_header->string_count);
+    for (uint32_t i = 0; i < this->m_header->string_count; ++i) {
+        symbols[i] = intern_string(std::string_view(this->m_chars + this->m_strings[i].offset, this->m_strings[i].length));
+    }
+    return symbols;
+}
+
+void cASTCacheFile::load(cFlatAST& ast) const {
+    const sASTCacheHeader& header = *this->m_header;
+    std::vector<symbol_t> symbols = this->intern_strings();
+
+    ast.m_kinds.assign(this->m_kinds, this->m_kinds + header.node_count);
+    ast.m_payloads.assign(this->m_payloads, this->m_payloads + header.node_count);
+    ast.m_lhs.assign(this->m_lhs, this->m_lhs + header.node_count);
+    ast.m_rhs.assign(this->m_rhs, this->m_rhs + header.node_count);
+    ast.m_extra.assign(this->m_extra, this->m_extra + header.extra_count);
+    ast.m_roots.assign(this->m_roots, this->m_roots + header.root_count);
+
+    for (node_index_t node = 0; node < header.node_count; ++node) {
+        if (has_symbol_payload((eFlatNodeKind)ast.m_kinds[node])) { ast.m_payloads[node] = symbols[ast.m_payloads[node]]; }
+    }
+}
+
+// Sets value and moves data past it, false past the end
+static bool read_varint(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (uint32_t shift = 0; shift < 35 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) { return true; }
+    }
+    return false;
+}
+
+static void write_varint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool cASTCacheFile::load_tokens(std::vector<sToken>& tokens) const {
+    const sASTCacheHeader& header = *this->m_header;
+    std::vector<symbol_t> symbols = this->intern_strings();
+    const uint8_t* data = this->m_tokens;
+    const uint8_t* end = data + header.token_bytes;
+
+    tokens.clear();
+    tokens.reserve(header.token_count);
+    auto invalid = [this, &tokens]() {
+        tokens.clear();
+        std::cerr << "Invalid tokens in AST cache file: " << this->m_mapping->get_path() << std::endl;
+        return false;
+    };
+
+    uint64_t offset = 0;
+    int64_t line_number = 0;
+    for (uint32_t i = 0; i < header.token_count; ++i) {
+        uint32_t type, gap, length, line_delta, symbol;
+        if (!read_varint(data, end, type) || !read_varint(data, end, gap) || !read_varint(data, end, length) ||
+            !read_varint(data, end, line_delta) || !read_varint(data, end, symbol)) { return invalid(); }
+
+        offset += gap;
+        line_number += line_delta;
+        if (offset + length > header.source_size || line_number > INT32_MAX || symbol > header.string_count) { return invalid(); }
+
+        sToken token;
+        token.token_type = (eTokenType)(int32_t)((type >> 1) ^ -(type & 1));
+        token.offset = (uint32_t)offset;
+        token.length = length;
+        token.line_number = (int)line_number;
+        token.symbol = symbol ? symbols[symbol - 1] : SYM_NONE;
+        tokens.push_back(token);
+        offset += length;
+    }
+
+    return data == end || invalid();
+}
+
+
+// Writing
+template <typename T>
+static void write_array(llvm::raw_ostream& out, const std::vector<T>& array) {
+    out.write((const char*)array.data(), array.size() * sizeof(T));
+}
+
+bool cASTCacheFile::write(const std::string& file_path, std::string_view source, const std::vector<sToken>& tokens, const cFlatAST& ast) {
+    // Symbols of this process to indices in the file
+    std::unordered_map<symbol_t, uint32_t> string_indices;
+    std::vector<sASTCacheString> strings;
+    std::string chars;
+    auto add_string = [&](symbol_t symbol) {
+        auto inserted = string_indices.emplace(symbol, (uint32_t)strings.size());
+        if (inserted.second) {
+            std::string_view str = get_symbol_string(symbol);
+            strings.push_back({ (uint32_t)chars.size(), (uint32_t)str.size() });
+            chars.append(str);
+        }
+        return inserted.first->second;
+    };
+
+    std::string token_bytes;
+    uint32_t token_end = 0;
+    int line_number = 0;
+    for (const sToken& token : tokens) {
+        int32_t type = token.token_type;
+        write_varint(token_bytes, ((uint32_t)type << 1) ^ (uint32_t)(type >> 31));
+        write_varint(token_bytes, token.offset - token_end);
+        write_varint(token_bytes, token.length);
+        write_varint(token_bytes, token.line_number - line_number);
+        write_varint(token_bytes, token.symbol == SYM_NONE ? 0 : add_string(token.symbol) + 1);
+
+        token_end = token.offset + token.length;
+        line_number = token.line_number;
+    }
+
+    std::vector<uint32_t> payloads(ast.m_payloads);
+    for (node_index_t node = 0; node < payloads.size(); ++node) {
+        if (has_symbol_payload((eFlatNodeKind)ast.m_kinds[node])) { payloads[node] = add_string(payloads[node]); }
+    }
+
+    sASTCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AST_CACHE_MAGIC, sizeof(AST_CACHE_MAGIC));
+    header.version = AST_CACHE_VERSION;
+    header.build_hash = get_compiler_build_id();
+    header.source_hash = llvm::xxHash64(llvm::StringRef(source.data(), source.size()));
+    header.source_size = source.size();
+    header.token_count = tokens.size();
+    header.token_bytes = token_bytes.size();
+    header.node_count = ast.m_kinds.size();
+    header.extra_count = ast.m_extra.size();
+    header.root_count = ast.m_roots.size();
+    header.string_count = strings.size();
+    header.char_count = chars.size();
+    sASTCacheLayout layout = get_layout(header);
+
+    // Readers never see a partial file
+    llvm::SmallString<256> temporary;
+    int fd;
+    if (llvm::sys::fs::createUniqueFile(file_path + ".tmp%%%%%%", fd, temporary)) {
+        std::cerr << "Could not create " << file_path << std::endl;
+        return false;
+    }
+
+    llvm::raw_fd_ostream out(fd, true);
+    out.write((const char*)&header, sizeof(header));
+    out << token_bytes;
+    out.write_zeros(layout.kinds - layout.tokens - header.token_bytes);
+    write_array(out, ast.m_kinds);
+    out.write_zeros(layout.payloads - layout.kinds - header.node_count);
+    write_array(out, payloads);
+    write_array(out, ast.m_lhs);
+    write_array(out, ast.m_rhs);
+    write_array(out, ast.m_extra);
+    write_array(out, ast.m_roots);
+    write_array(out, strings);
+    out << chars;
+    out.close();
+
+    bool failed = out.has_error();
+    out.clear_error();
+    if (failed || llvm::sys::fs::rename(temporary, file_path)) {
+        llvm::sys::fs::remove(temporary);
+        std::cerr << "Could not write " << file_path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,483 @@
+#include "../include/compilation_unit.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "../include/interface_file.h"
+
+#include "llvm/Support/FileSystem.h"
+
+
+const char* get_stage_name(eCompilationStage stage) {
+    switch (stage) {
+    case STAGE_PARSE:   return "Syntactic analysis";
+    case STAGE_IMPORT:  return "Imports";
+    case STAGE_RESOLVE: return "Name resolution";
+    case STAGE_CHECK:   return "Type checking";
+    case STAGE_LOWER:   return "Code generation";
+    case STAGE_EMIT:    return "Object emission";
+    default:            return "Unknown stage";
+    }
+}
+
+cCompilationUnit::cCompilationUnit(std::string_view source, const sCompilerOptions& options) : m_source(source), m_options(options) {
+    // Tokens are streamed to the parser, the lexer is owned by the unit
+    this->m_lexer = std::make_unique<cLexer>(source);
+    this->m_parser = std::make_unique<cParser>(this->m_lexer.get());
+    this->m_code_generator = this->m_parser->m_code_generator;
+
+    for (double& stage_time : this->m_stage_times) { stage_time = 0.0; }
+}
+
+bool cCompilationUnit::run(eCompilationStage last_stage, const std::string& object_file_name) {
+    for (int stage = STAGE_PARSE; stage <= last_stage; ++stage) {
+        if (!this->run_stage((eCompilationStage)stage, object_file_name)) { return false; }
+    }
+
+    return true;
+}
+
+bool cCompilationUnit::run_stage(eCompilationStage stage, const std::string& object_file_name) {
+    DEPLANG_LOG(LOG_TRACE, LOG_DRIVER, get_stage_name(stage));
+    // Also in the -ftime-report summary
+    cScopedTimer timer(get_stage_name(stage));
+
+    bool succeeded = false;
+    switch (stage) {
+    case STAGE_PARSE:   succeeded = this->parse(); break;
+    case STAGE_IMPORT:  succeeded = this->import_modules(); break;
+    case STAGE_RESOLVE: succeeded = this->resolve_names(); break;
+    case STAGE_CHECK:   succeeded = this->type_check(); break;
+    case STAGE_LOWER:   succeeded = this->lower(); break;
+    case STAGE_EMIT:    succeeded = this->emit(object_file_name); break;
+    default: break;
+    }
+
+    this->m_stage_times[stage] = timer.stop();
+
+    DEPLANG_LOG(LOG_DEBUG, LOG_DRIVER, get_stage_name(stage) << (succeeded ? "" : " failed") << ", elapsed time: " << this->m_stage_times[stage] << " ns");
+    return succeeded;
+}
+
+
+// Parsing
+bool cCompilationUnit::parse() {
+    if (this->m_ast_cache_file_name.empty()) {
+        bool succeeded = this->m_parser->parse_flat(this->m_ast);
+        this->m_source_root_count = this->m_ast.get_roots().size();
+        return succeeded;
+    }
+
+    bool cached = this->load_ast_cache();
+    if (!cached) { this->lex_ahead(); }
+    bool succeeded = cached || this->m_parser->parse_flat(this->m_ast);
+    this->m_source_root_count = this->m_ast.get_roots().size();
+
+    if (DEPLANG_LOG_ENABLED(LOG_DEBUG, LOG_LEXER)) { print_tokens(this->m_source, this->get_tokens()); }
+    if (succeeded && !cached) { this->write_ast_cache(); }
+    return succeeded;
+}
+
+void cCompilationUnit::lex_ahead() {
+    this->m_lexer->lex();
+    this->m_tokens = this->m_lexer->take_tokens();
+
+    std::shared_ptr<cCodeGenerator> code_generator = this->m_parser->m_code_generator;
+    this->m_parser = std::make_unique<cParser>(this->m_source, this->m_tokens);
+    this->m_parser->m_code_generator = code_generator;
+}
+
+const std::vector<sToken>& cCompilationUnit::get_tokens() {
+    // Most runs never look at them
+    if (this->m_ast_cache) {
+        this->m_ast_cache->load_tokens(this->m_tokens);
+        this->m_ast_cache.reset();
+    }
+    return this->m_tokens;
+}
+
+bool cCompilationUnit::load_ast_cache() {
+    if (!llvm::sys::fs::exists(this->m_ast_cache_file_name)) { return false; }
+
+    std::unique_ptr<cASTCacheFile> cache = cASTCacheFile::open(this->m_ast_cache_file_name);
+    if (!cache || !cache->matches(this->m_source)) {
+        DEPLANG_LOG(LOG_INFO, LOG_PARSER, "AST cache " << this->m_ast_cache_file_name << " is stale");
+        return false;
+    }
+
+    cache->load(this->m_ast);
+    DEPLANG_LOG(LOG_INFO, LOG_PARSER, "Loaded " << cache->get_node_count() << " nodes from " << this->m_ast_cache_file_name);
+    this->m_ast_cache = std::move(cache);
+    return true;
+}
+
+bool cCompilationUnit::write_ast_cache() const {
+    if (!cASTCacheFile::write(this->m_ast_cache_file_name, this->m_source, this->m_tokens, this->m_ast)) { return false; }
+    DEPLANG_LOG(LOG_INFO, LOG_PARSER, "Wrote " << this->m_ast.size() << " nodes to " << this->m_ast_cache_file_name);
+    return true;
+}
+
+
+// Imports
+bool cCompilationUnit::import_modules() {
+    std::unordered_set<symbol_t> imported;
+
+    // Importing adds roots
+    for (size_t i = 0; i < this->m_source_root_count; ++i) {
+        node_index_t root = this->m_ast.get_roots()[i];
+        if (this->m_ast.get_kind(root) != NODE_IMPORT) { continue; }
+
+        symbol_t module = this->m_ast.get_payload(root);
+        if (!imported.insert(module).second) { continue; }
+
+        std::string file_name = find_interface_file(get_symbol_string(module), this->m_options.import_paths);
+        if (file_name.empty()) {
+            DEPLANG_PARSER_ERROR("No interface file for module " << get_symbol_string(module));
+            return false;
+        }
+
+        std::unique_ptr<cInterfaceFile> interface = cInterfaceFile::open(file_name);
+        if (!interface) { return false; }
+
+        interface->import_into(this->m_ast);
+        DEPLANG_LOG(LOG_DEBUG, LOG_PARSER, "Imported " << interface->get_function_count() << " functions and "
+                    << interface->get_type_decl_count() << " types from " << file_name);
+    }
+
+    return true;
+}
+
+bool cCompilationUnit::write_interface(const std::string& file_name) const {
+    const std::vector<node_index_t>& roots = this->m_ast.get_roots();
+    std::vector<node_index_t> source_roots(roots.begin(), roots.begin() + std::min(this->m_source_root_count, roots.size()));
+    return cInterfaceFile::write(this->m_ast, source_roots, file_name);
+}
+
+
+// Name resolution
+bool cCompilationUnit::resolve_names() {
+    for (node_index_t root : this->m_ast.get_roots()) {
+        eFlatNodeKind kind = this->m_ast.get_kind(root);
+        if (kind == NODE_IMPORT) { continue; }
+
+        symbol_t name = this->m_ast.get_payload(root);
+        auto& declarations = kind == NODE_TYPEDECL ? this->m_type_decls : this->m_functions;
+
+        if (!declarations.emplace(name, root).second) {
+            DEPLANG_PARSER_ERROR("Redefinition of " << get_symbol_string(name));
+            return false;
+        }
+    }
+
+    std::vector<node_index_t> pending;
+    std::vector<symbol_t> scope;
+    for (node_index_t root : this->m_ast.get_roots()) {
+        if (this->m_ast.get_kind(root) == NODE_TYPEDECL) {
+            if (!this->resolve_type(this->m_ast.get_lhs(root))) { return false; }
+            if (!this->check_type_cycle(root, pending)) { return false; }
+            continue;
+        }
+        if (this->m_ast.get_kind(root) == NODE_IMPORT) { continue; }
+
+        uint32_t position = this->m_ast.get_lhs(root);
+        if (!this->resolve_type(this->m_ast.get_extra(position++))) { return false; }
+
+        scope.clear();
+        uint32_t param_count = this->m_ast.get_extra(position++);
+        for (uint32_t i = 0; i < param_count; ++i) {
+            node_index_t param = this->m_ast.get_extra(position++);
+            if (!this->resolve_type(this->m_ast.get_lhs(param))) { return false; }
+            scope.push_back(this->m_ast.get_payload(param));
+        }
+        // Imported, checked when its module was compiled
+        if (this->m_ast.get_kind(root) == NODE_EXTERN) { continue; }
+
+        uint32_t body_count = this->m_ast.get_extra(position++);
+        for (uint32_t i = 0; i < body_count; ++i) {
+            if (!this->resolve_expression(this->m_ast.get_extra(position++), scope)) { return false; }
+        }
+    }
+
+    return true;
+}
+
+bool cCompilationUnit::resolve_type(node_index_t type) {
+    node_index_t lhs = this->m_ast.get_lhs(type), rhs = this->m_ast.get_rhs(type);
+    if (lhs != NODE_NONE && rhs != NODE_NONE) { return this->resolve_type(lhs) && this->resolve_type(rhs); }
+
+    symbol_t name = this->m_ast.get_payload(type);
+    if (name < SYM_PRODUCT || this->m_type_decls.count(name)) { return true; }
+
+    DEPLANG_PARSER_ERROR("Unknown type " << get_symbol_string(name));
+    return false;
+}
+
+bool cCompilationUnit::resolve_expression(node_index_t node, std::vector<symbol_t>& scope) {
+    const cFlatAST& ast = this->m_ast;
+    auto in_scope = [&scope](symbol_t name) { return std::find(scope.begin(), scope.end(), name) != scope.end(); };
+
+    switch (ast.get_kind(node)) {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_BOOL:
+        return true;
+
+    case NODE_VARIABLE:
+        if (in_scope(ast.get_payload(node))) { return true; }
+        DEPLANG_PARSER_ERROR("Variable " << get_symbol_string(ast.get_payload(node)) << " not found");
+        return false;
+
+    case NODE_BINARY:
+        return this->resolve_expression(ast.get_lhs(node), scope) && this->resolve_expression(ast.get_rhs(node), scope);
+
+    case NODE_RETURN:
+        return ast.get_lhs(node) == NODE_NONE || this->resolve_expression(ast.get_lhs(node), scope);
+
+    case NODE_VARDECL:
+        if (!this->resolve_type(ast.get_lhs(node))) { return false; }
+        if (ast.get_rhs(node) != NODE_NONE && !this->resolve_expression(ast.get_rhs(node), scope)) { return false; }
+        scope.push_back(ast.get_payload(node));
+        return true;
+
+    case NODE_ASSIGN:
+        if (!in_scope(ast.get_payload(node))) {
+            DEPLANG_PARSER_ERROR("Variable " << get_symbol_string(ast.get_payload(node)) << " not found");
+            return false;
+        }
+        return this->resolve_expression(ast.get_lhs(node), scope);
+
+    case NODE_CALL: {
+        auto callee = this->m_functions.find(ast.get_payload(node));
+        if (callee == this->m_functions.end()) {
+            DEPLANG_PARSER_ERROR("Function " << get_symbol_string(ast.get_payload(node)) << " not found");
+            return false;
+        }
+
+        uint32_t param_count = ast.get_extra(ast.get_lhs(callee->second) + 1);
+        uint32_t first_arg = ast.get_lhs(node), arg_count = ast.get_rhs(node);
+        if (param_count != arg_count) {
+            DEPLANG_PARSER_ERROR("Expected " << param_count << ", got " << arg_count << " arguments calling " << get_symbol_string(ast.get_payload(node)));
+            return false;
+        }
+
+        for (uint32_t i = 0; i < arg_count; ++i) {
+            if (!this->resolve_expression(ast.get_extra(first_arg + i), scope)) { return false; }
+        }
+        return true;
+    }
+
+    default:
+        DEPLANG_PARSER_ERROR("Node " << node << " is not an expression");
+        return false;
+    }
+}
+
+// Declared types can't be lowered if they contain themselves
+bool cCompilationUnit::check_type_cycle(node_index_t type_decl, std::vector<node_index_t>& pending) {
+    if (std::find(pending.begin(), pending.end(), type_decl) != pending.end()) {
+        DEPLANG_PARSER_ERROR("Type " << get_symbol_string(this->m_ast.get_payload(type_decl)) << " is defined in terms of itself");
+        return false;
+    }
+    pending.push_back(type_decl);
+
+    std::vector<node_index_t> stack = { this->m_ast.get_lhs(type_decl) };
+    while (!stack.empty()) {
+        node_index_t type = stack.back();
+        stack.pop_back();
+
+        if (this->m_ast.get_lhs(type) != NODE_NONE && this->m_ast.get_rhs(type) != NODE_NONE) {
+            stack.push_back(this->m_ast.get_lhs(type));
+            stack.push_back(this->m_ast.get_rhs(type));
+            continue;
+        }
+
+        auto dependency = this->m_type_decls.find(this->m_ast.get_payload(type));
+        if (dependency != this->m_type_decls.end() && !this->check_type_cycle(dependency->second, pending)) { return false; }
+    }
+
+    pending.pop_back();
+    return true;
+}
+
+
+// Type checking
+bool cCompilationUnit::type_check() {
+    this->m_node_types.assign(this->m_ast.size(), TYPE_NONE);
+
+    std::vector<std::pair<symbol_t, type_id_t>> scope;
+    for (node_index_t root : this->m_ast.get_roots()) {
+        if (this->m_ast.get_kind(root) != NODE_FUNCTION) { continue; }
+
+        uint32_t position = this->m_ast.get_lhs(root);
+        type_id_t return_type = this->expand_type(resolve_flat_type(this->m_ast, this->m_ast.get_extra(position++)));
+
+        scope.clear();
+        uint32_t param_count = this->m_ast.get_extra(position++);
+        for (uint32_t i = 0; i < param_count; ++i) {
+            node_index_t param = this->m_ast.get_extra(position++);
+            scope.emplace_back(this->m_ast.get_payload(param), this->expand_type(resolve_flat_type(this->m_ast, this->m_ast.get_lhs(param))));
+        }
+
+        uint32_t body_count = this->m_ast.get_extra(position++);
+        for (uint32_t i = 0; i < body_count; ++i) {
+            if (this->check_expression(this->m_ast.get_extra(position++), scope, return_type) == TYPE_NONE) {
+                DEPLANG_PARSER_ERROR("In function " << get_symbol_string(this->m_ast.get_payload(root)));
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+type_id_t cCompilationUnit::expand_type(type_id_t type) {
+    auto expanded = this->m_expanded_types.find(type);
+    if (expanded != this->m_expanded_types.end()) { return expanded->second; }
+
+    cTypeTable& type_table = cTypeTable::get();
+    sDepType dep_type = type_table.get_type(type);
+
+    type_id_t result = type;
+    switch (dep_type.kind) {
+    case TYPE_NAMED: {
+        auto type_decl = this->m_type_decls.find(dep_type.name);
+        if (type_decl != this->m_type_decls.end()) { result = this->expand_type(resolve_flat_type(this->m_ast, this->m_ast.get_lhs(type_decl->second))); }
+        break;
+    }
+    case TYPE_PRODUCT:  result = type_table.get_product(this->expand_type(dep_type.lhs), this->expand_type(dep_type.rhs)); break;
+    case TYPE_SUM:      result = type_table.get_sum(this->expand_type(dep_type.lhs), this->expand_type(dep_type.rhs)); break;
+    case TYPE_FUNCTION: result = type_table.get_function(this->expand_type(dep_type.lhs), this->expand_type(dep_type.rhs)); break;
+    default: break;
+    }
+
+    this->m_expanded_types[type] = result;
+    return result;
+}
+
+// Type of the expression, TYPE_NONE after reporting an error. Statements
+// without a value have the void type
+type_id_t cCompilationUnit::check_expression(node_index_t node, std::vector<std::pair<symbol_t, type_id_t>>& scope, type_id_t return_type) {
+    const cFlatAST& ast = this->m_ast;
+    cTypeTable& type_table = cTypeTable::get();
+    auto lookup = [&scope](symbol_t name) {
+        for (auto it = scope.rbegin(); it != scope.rend(); ++it) {
+            if (it->first == name) { return it->second; }
+        }
+        return (type_id_t)TYPE_NONE;
+    };
+
+    type_id_t type = TYPE_NONE;
+    switch (ast.get_kind(node)) {
+    case NODE_INT:   type = TYPE_INT; break;
+    case NODE_FLOAT: type = TYPE_FLOAT; break;
+    case NODE_BOOL:  type = TYPE_BOOL; break;
+
+    case NODE_VARIABLE:
+        type = lookup(ast.get_payload(node));
+        if (type == TYPE_NONE) { DEPLANG_PARSER_ERROR("Unknown variable " << get_symbol_string(ast.get_payload(node))); }
+        break;
+
+    case NODE_BINARY: {
+        type_id_t l = this->check_expression(ast.get_lhs(node), scope, return_type);
+        type_id_t r = this->check_expression(ast.get_rhs(node), scope, return_type);
+        if (l == TYPE_NONE || r == TYPE_NONE) { return TYPE_NONE; }
+
+        std::string_view op = ast.get_operator(node);
+        if (op == ",") { type = type_table.get_product(l, r); break; }
+
+        if (op != "+" && op != "-" && op != "*" && op != "<" && op != ">") {
+            DEPLANG_PARSER_ERROR("Operator " << op << " is not supported");
+        } else if (l != r || (l != TYPE_INT && l != TYPE_FLOAT)) {
+            DEPLANG_PARSER_ERROR("Operator " << op << " on " << type_table.to_string(l) << " and " << type_table.to_string(r));
+        } else {
+            type = (op == "<" || op == ">") ? (type_id_t)TYPE_BOOL : l;
+        }
+        break;
+    }
+
+    case NODE_RETURN:
+        type = TYPE_VOID;
+        if (ast.get_lhs(node) != NODE_NONE) { type = this->check_expression(ast.get_lhs(node), scope, return_type); }
+        if (type == TYPE_NONE) { return TYPE_NONE; }
+
+        if (type != return_type) {
+            DEPLANG_PARSER_ERROR("Returning " << type_table.to_string(type) << ", expected " << type_table.to_string(return_type));
+            type = TYPE_NONE;
+        }
+        break;
+
+    case NODE_VARDECL: {
+        type = this->expand_type(resolve_flat_type(ast, ast.get_lhs(node)));
+
+        if (ast.get_rhs(node) != NODE_NONE) {
+            type_id_t value_type = this->check_expression(ast.get_rhs(node), scope, return_type);
+            if (value_type == TYPE_NONE) { return TYPE_NONE; }
+
+            if (value_type != type) {
+                DEPLANG_PARSER_ERROR("Initializing " << get_symbol_string(ast.get_payload(node)) << ": " << type_table.to_string(type) << " with " << type_table.to_string(value_type));
+                return TYPE_NONE;
+            }
+        }
+        scope.emplace_back(ast.get_payload(node), type);
+        break;
+    }
+
+    // The variable keeps its declared type
+    case NODE_ASSIGN: {
+        type = lookup(ast.get_payload(node));
+        if (type == TYPE_NONE) {
+            DEPLANG_PARSER_ERROR("Unknown variable " << get_symbol_string(ast.get_payload(node)));
+            return TYPE_NONE;
+        }
+
+        type_id_t value_type = this->check_expression(ast.get_lhs(node), scope, return_type);
+        if (value_type == TYPE_NONE) { return TYPE_NONE; }
+
+        if (value_type != type) {
+            DEPLANG_PARSER_ERROR("Type mismatch assigning " << get_symbol_string(ast.get_payload(node)) << ": " << type_table.to_string(type) << " with " << type_table.to_string(value_type));
+            return TYPE_NONE;
+        }
+        break;
+    }
+
+    case NODE_CALL: {
+        node_index_t callee = this->m_functions[ast.get_payload(node)];
+        uint32_t position = ast.get_lhs(callee);
+        node_index_t callee_return_type = ast.get_extra(position++);
+        uint32_t first_param = position + 1;
+
+        uint32_t first_arg = ast.get_lhs(node), arg_count = ast.get_rhs(node);
+        for (uint32_t i = 0; i < arg_count; ++i) {
+            type_id_t arg_type = this->check_expression(ast.get_extra(first_arg + i), scope, return_type);
+            if (arg_type == TYPE_NONE) { return TYPE_NONE; }
+
+            type_id_t param_type = this->expand_type(resolve_flat_type(ast, ast.get_lhs(ast.get_extra(first_param + i))));
+            if (arg_type != param_type) {
+                DEPLANG_PARSER_ERROR("Argument " << i << " of " << get_symbol_string(ast.get_payload(node)) << ": expected " << type_table.to_string(param_type) << ", got " << type_table.to_string(arg_type));
+                return TYPE_NONE;
+            }
+        }
+
+        type = this->expand_type(resolve_flat_type(ast, callee_return_type));
+        break;
+    }
+
+    default:
+        DEPLANG_PARSER_ERROR("Node " << node << " is not an expression");
+        break;
+    }
+
+    if (type != TYPE_NONE) { this->m_node_types[node] = type; }
+    return type;
+}
+
+
+// Lowering and emission
+bool cCompilationUnit::lower() {
+    this->m_code_generator->configure(this->m_options);
+    return codegen_flat(this->m_ast, this->m_code_generator);
+}
+
+bool cCompilationUnit::emit(const std::string& object_file_name) {
+    return this->m_code_generator->emit_object_code(object_file_name);
+}
@@ -0,0 +1,17 @@
+#include "../include/compiler_options.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/xxhash.h"
+
+
+uint64_t get_compiler_build_id() {
+    static const uint64_t build_id = [] {
+        std::string executable = llvm::sys::fs::getMainExecutable(nullptr, nullptr);
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> content = llvm::MemoryBuffer::getFile(executable);
+        // Only this file is known to be from this build
+        if (!content) { return llvm::xxHash64(DEPLANG_COMPILER_VERSION " " __DATE__ " " __TIME__); }
+        return llvm::xxHash64((*content)->getBuffer());
+    }();
+    return build_id;
+}
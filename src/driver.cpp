@@ -0,0 +1,184 @@
+#include "../include/driver.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <unordered_map>
+
+#include "../include/compilation_unit.h"
+#include "../include/interface_file.h"
+#include "../include/source_file.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+
+struct sFileResult {
+    std::string object_file_name;
+    std::string interface_file_name;
+    // Input files imported by this one
+    std::vector<size_t> dependencies;
+    bool succeeded = false;
+    // Stage of the first error, STAGE_COUNT if the file couldn't be read or
+    // an import failed
+    eCompilationStage failed_stage = STAGE_COUNT;
+    size_t source_size = 0;
+    double time_ns = 0;
+};
+
+// The stages without the banners of cCompilationUnit::run, files are compiled
+// concurrently
+static void compile_file(const std::string& file_path, const sCompilerOptions& options, sFileResult& result) {
+    cScopedTimer timer("Compile file", file_path);
+    DEPLANG_LOG(LOG_DEBUG, LOG_DRIVER, "Compiling " << file_path);
+
+    std::unique_ptr<cSourceFile> source_file = cSourceFile::open(file_path);
+    if (source_file) {
+        result.source_size = source_file->get_size();
+
+        cCompilationUnit unit(source_file->get_content(), options);
+        result.succeeded = true;
+        for (int stage = STAGE_PARSE; stage < STAGE_COUNT && result.succeeded; ++stage) {
+            switch ((eCompilationStage)stage) {
+            case STAGE_PARSE:   result.succeeded = unit.parse(); break;
+            case STAGE_IMPORT:  result.succeeded = unit.import_modules(); break;
+            case STAGE_RESOLVE: result.succeeded = unit.resolve_names(); break;
+            // Importers only need the checked declarations
+            case STAGE_CHECK:   result.succeeded = unit.type_check() && unit.write_interface(result.interface_file_name); break;
+            case STAGE_LOWER:   result.succeeded = unit.lower(); break;
+            case STAGE_EMIT:    result.succeeded = unit.emit(result.object_file_name); break;
+            default: break;
+            }
+            if (!result.succeeded) { result.failed_stage = (eCompilationStage)stage; }
+        }
+    }
+
+    result.time_ns = timer.stop();
+}
+
+// Files in waves, each file after the input files it imports. Empty after
+// reporting an import cycle
+static std::vector<std::vector<size_t>> schedule_files(const std::vector<std::string>& file_paths, const std::unordered_map<std::string, size_t>& modules,
+                                                       std::vector<sFileResult>& results) {
+    std::vector<size_t> pending_imports(file_paths.size(), 0);
+    std::vector<std::vector<size_t>> importers(file_paths.size());
+
+    for (size_t i = 0; i < file_paths.size(); ++i) {
+        // Unreadable files fail when compiled
+        std::unique_ptr<cSourceFile> source_file = cSourceFile::open(file_paths[i]);
+        if (!source_file) { continue; }
+
+        for (const std::string& module : find_imports(source_file->get_content())) {
+            auto imported = modules.find(module);
+            if (imported == modules.end() || imported->second == i) { continue; }
+
+            std::vector<size_t>& dependencies = results[i].dependencies;
+            if (std::find(dependencies.begin(), dependencies.end(), imported->second) != dependencies.end()) { continue; }
+            dependencies.push_back(imported->second);
+            importers[imported->second].push_back(i);
+            ++pending_imports[i];
+        }
+    }
+
+    std::vector<std::vector<size_t>> waves;
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < file_paths.size(); ++i) {
+        if (pending_imports[i] == 0) { ready.push_back(i); }
+    }
+
+    size_t scheduled = 0;
+    while (!ready.empty()) {
+        scheduled += ready.size();
+        waves.push_back(std::move(ready));
+        ready.clear();
+
+        for (size_t i : waves.back()) {
+            for (size_t importer : importers[i]) {
+                if (--pending_imports[importer] == 0) { ready.push_back(importer); }
+            }
+        }
+    }
+
+    if (scheduled != file_paths.size()) {
+        for (size_t i = 0; i < file_paths.size(); ++i) {
+            if (pending_imports[i]) { std::cerr << file_paths[i] << " is part of an import cycle" << std::endl; }
+        }
+        return {};
+    }
+    return waves;
+}
+
+bool compile_files(const std::vector<std::string>& file_paths, const sCompilerOptions& options, const std::string& output_directory, unsigned workers) {
+    if (std::error_code error = llvm::sys::fs::create_directories(output_directory)) {
+        std::cerr << "Could not create " << output_directory << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    // Objects are named after the sources, two sources can't share a name
+    std::vector<sFileResult> results(file_paths.size());
+    std::unordered_map<std::string, size_t> modules;
+    for (size_t i = 0; i < file_paths.size(); ++i) {
+        std::string module = llvm::sys::path::stem(file_paths[i]).str();
+        llvm::SmallString<256> object_file_name(output_directory), interface_file_name(output_directory);
+        llvm::sys::path::append(object_file_name, module + ".o");
+        llvm::sys::path::append(interface_file_name, module + INTERFACE_FILE_EXTENSION);
+        results[i].object_file_name = std::string(object_file_name);
+        results[i].interface_file_name = std::string(interface_file_name);
+
+        auto inserted = modules.emplace(module, i);
+        if (!inserted.second) {
+            std::cerr << file_paths[inserted.first->second] << " and " << file_paths[i] << " would both be compiled to " << results[i].object_file_name << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<std::vector<size_t>> waves = schedule_files(file_paths, modules, results);
+    if (waves.empty() && !file_paths.empty()) { return false; }
+
+    sCompilerOptions file_options = options;
+    file_options.import_paths.insert(file_options.import_paths.begin(), output_directory);
+
+    if (workers == 0) { workers = llvm::hardware_concurrency().compute_thread_count(); }
+    if (workers > file_paths.size()) { workers = file_paths.size() ? file_paths.size() : 1; }
+
+    cScopedTimer timer("Compile files");
+    {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(workers));
+        for (const std::vector<size_t>& wave : waves) {
+            for (size_t i : wave) {
+                // A failed import would leave a stale or missing interface
+                bool imports_succeeded = true;
+                for (size_t dependency : results[i].dependencies) { imports_succeeded &= results[dependency].succeeded; }
+                if (!imports_succeeded) { continue; }
+
+                pool.async([&file_paths, &file_options, &results, i]() { compile_file(file_paths[i], file_options, results[i]); });
+            }
+            pool.wait();
+        }
+    }
+    double total_ns = timer.stop();
+
+    size_t failed = 0, source_size = 0;
+    for (size_t i = 0; i < file_paths.size(); ++i) {
+        const sFileResult& result = results[i];
+        source_size += result.source_size;
+
+        if (result.succeeded) {
+            std::cout << "OK      " << file_paths[i] << " -> " << result.object_file_name;
+        } else {
+            ++failed;
+            std::cout << "FAILED  " << file_paths[i] << " ("
+                      << (result.failed_stage == STAGE_COUNT ? "read or import" : get_stage_name(result.failed_stage)) << ")";
+        }
+        std::cout << " " << std::fixed << std::setprecision(1) << result.time_ns / 1e6 << " ms" << std::defaultfloat << std::endl;
+    }
+
+    double seconds = total_ns / 1e9;
+    std::cout << file_paths.size() - failed << " of " << file_paths.size() << " files compiled with " << workers << " workers in "
+              << std::fixed << std::setprecision(3) << seconds << " s, "
+              << std::setprecision(1) << file_paths.size() / seconds << " files/s, "
+              << source_size / seconds / (1024 * 1024) << " MB/s" << std::defaultfloat << std::endl;
+
+    return failed == 0;
+}
@@ -0,0 +1,423 @@
+#include "../include/flat_ast.h"
+
+#include <unordered_set>
+
+
+// Flat AST
+node_index_t cFlatAST::add_node(eFlatNodeKind kind, uint32_t payload, node_index_t lhs, node_index_t rhs) {
+    node_index_t node = (node_index_t)this->m_kinds.size();
+    this->m_kinds.push_back(kind);
+    this->m_payloads.push_back(payload);
+    this->m_lhs.push_back(lhs);
+    this->m_rhs.push_back(rhs);
+    return node;
+}
+
+uint32_t cFlatAST::add_extra(const std::vector<node_index_t>& indices) {
+    uint32_t position = (uint32_t)this->m_extra.size();
+    this->m_extra.insert(this->m_extra.end(), indices.begin(), indices.end());
+    return position;
+}
+
+float cFlatAST::get_float(node_index_t node) const {
+    float value;
+    memcpy(&value, &this->m_payloads[node], sizeof(float));
+    return value;
+}
+
+std::string_view cFlatAST::get_operator(node_index_t node) const {
+    const char* chars = (const char*)&this->m_payloads[node];
+    return std::string_view(chars, strnlen(chars, sizeof(uint32_t)));
+}
+
+size_t cFlatAST::get_memory_usage() const {
+    return this->m_kinds.capacity() * sizeof(uint8_t)
+        + (this->m_payloads.capacity() + this->m_lhs.capacity() + this->m_rhs.capacity()) * sizeof(uint32_t)
+        + (this->m_extra.capacity() + this->m_roots.capacity()) * sizeof(node_index_t);
+}
+
+void cFlatAST::clear() {
+    this->m_kinds.clear();
+    this->m_payloads.clear();
+    this->m_lhs.clear();
+    this->m_rhs.clear();
+    this->m_extra.clear();
+    this->m_roots.clear();
+}
+
+
+// Code generation
+// Defines the declared type after the declared types it refers to
+static bool codegen_flat_named_type(const cFlatAST& ast, node_index_t type_decl, const std::unordered_map<symbol_t, node_index_t>& type_decls,
+                                    std::vector<node_index_t>& pending, std::unordered_set<node_index_t>& defined,
+                                    std::shared_ptr<cCodeGenerator> code_generator) {
+    symbol_t name = ast.get_payload(type_decl);
+    if (defined.count(type_decl)) { return true; }
+
+    if (std::find(pending.begin(), pending.end(), type_decl) != pending.end()) {
+        DEPLANG_PARSER_ERROR("Type " << get_symbol_string(name) << " is defined in terms of itself");
+        return false;
+    }
+    pending.push_back(type_decl);
+
+    std::vector<node_index_t> stack = { ast.get_lhs(type_decl) };
+    while (!stack.empty()) {
+        node_index_t type = stack.back();
+        stack.pop_back();
+
+        if (ast.get_lhs(type) != NODE_NONE && ast.get_rhs(type) != NODE_NONE) {
+            stack.push_back(ast.get_lhs(type));
+            stack.push_back(ast.get_rhs(type));
+            continue;
+        }
+
+        auto dependency = type_decls.find(ast.get_payload(type));
+        if (dependency != type_decls.end() && !codegen_flat_named_type(ast, dependency->second, type_decls, pending, defined, code_generator)) { return false; }
+    }
+
+    pending.pop_back();
+
+    llvm::Type* lowered = codegen_flat_type(ast, ast.get_lhs(type_decl), code_generator);
+    if (!lowered) { return false; }
+    code_generator->define_named_type(name, lowered);
+    defined.insert(type_decl);
+    return true;
+}
+
+bool codegen_flat_named_types(const cFlatAST& ast, std::shared_ptr<cCodeGenerator> code_generator) {
+    std::unordered_map<symbol_t, node_index_t> type_decls;
+    for (node_index_t root : ast.get_roots()) {
+        if (ast.get_kind(root) == NODE_TYPEDECL) { type_decls[ast.get_payload(root)] = root; }
+    }
+
+    std::vector<node_index_t> pending;
+    std::unordered_set<node_index_t> defined;
+    for (node_index_t root : ast.get_roots()) {
+        if (ast.get_kind(root) != NODE_TYPEDECL) { continue; }
+        if (!codegen_flat_named_type(ast, root, type_decls, pending, defined, code_generator)) { return false; }
+    }
+
+    return true;
+}
+
+bool codegen_flat_declarations(const cFlatAST& ast, std::shared_ptr<cCodeGenerator> code_generator) {
+    if (!codegen_flat_named_types(ast, code_generator)) { return false; }
+
+    for (node_index_t root : ast.get_roots()) {
+        if (ast.get_kind(root) != NODE_FUNCTION && ast.get_kind(root) != NODE_EXTERN) { continue; }
+        if (!codegen_flat_prototype(ast, root, code_generator)) { return false; }
+    }
+
+    return true;
+}
+
+bool codegen_flat(const cFlatAST& ast, std::shared_ptr<cCodeGenerator> code_generator) {
+    if (!codegen_flat_declarations(ast, code_generator)) { return false; }
+
+    for (node_index_t root : ast.get_roots()) {
+        if (ast.get_kind(root) != NODE_FUNCTION) { continue; }
+        if (!codegen_flat_function(ast, root, code_generator)) { return false; }
+    }
+
+    return true;
+}
+
+type_id_t resolve_flat_type(const cFlatAST& ast, node_index_t type) {
+    cTypeTable& type_table = cTypeTable::get();
+    node_index_t lhs = ast.get_lhs(type), rhs = ast.get_rhs(type);
+    if (lhs == NODE_NONE || rhs == NODE_NONE) { return type_table.get_named(ast.get_payload(type)); }
+
+    switch (ast.get_payload(type)) {
+    case SYM_PRODUCT: return type_table.get_product(resolve_flat_type(ast, lhs), resolve_flat_type(ast, rhs));
+    case SYM_SUM:     return type_table.get_sum(resolve_flat_type(ast, lhs), resolve_flat_type(ast, rhs));
+    case SYM_ARROW:   return type_table.get_function(resolve_flat_type(ast, lhs), resolve_flat_type(ast, rhs));
+    default:
+        DEPLANG_PARSER_ERROR("Unknown type operator " << get_symbol_string(ast.get_payload(type)));
+        return TYPE_NONE;
+    }
+}
+
+llvm::Type* codegen_flat_type(const cFlatAST& ast, node_index_t type, std::shared_ptr<cCodeGenerator> code_generator) {
+    return lower_type(resolve_flat_type(ast, type), code_generator);
+}
+
+sTypedValue codegen_flat_expression(const cFlatAST& ast, node_index_t node, std::shared_ptr<cCodeGenerator> code_generator) {
+    llvm::LLVMContext& context = *code_generator->m_Context;
+
+    switch (ast.get_kind(node)) {
+    case NODE_INT:
+        // @CHECK: Integers precision is 32 bits for now
+        return sTypedValue(llvm::ConstantInt::get(context, llvm::APInt(32, ast.get_int(node))), llvm::Type::getInt32Ty(context));
+
+    case NODE_FLOAT:
+        return sTypedValue(llvm::ConstantFP::get(context, llvm::APFloat(ast.get_float(node))), llvm::Type::getFloatTy(context));
+
+    case NODE_BOOL:
+        return sTypedValue(llvm::ConstantInt::getBool(context, ast.get_payload(node) != 0), llvm::Type::getInt1Ty(context));
+
+    case NODE_VARIABLE: {
+        auto value = code_generator->m_NamedValues.find(ast.get_payload(node));
+        if (value != code_generator->m_NamedValues.end()) { return value->second; }
+
+        DEPLANG_PARSER_ERROR("Variable " << get_symbol_string(ast.get_payload(node)) << " not found");
+        return {};
+    }
+
+    case NODE_BINARY: {
+        sTypedValue l = codegen_flat_expression(ast, ast.get_lhs(node), code_generator);
+        sTypedValue r = codegen_flat_expression(ast, ast.get_rhs(node), code_generator);
+        if (!l || !r) {
+            DEPLANG_PARSER_ERROR("Couldn't evaluate left or right expression");
+            return {};
+        }
+
+        std::string_view op = ast.get_operator(node);
+        if (op != ",") { return build_ir_operation(l, r, op, code_generator); }
+        return build_ir_tuple(l, r, code_generator);
+    }
+
+    case NODE_RETURN:
+        if (ast.get_lhs(node) == NODE_NONE) { return {}; }
+        return codegen_flat_expression(ast, ast.get_lhs(node), code_generator);
+
+    case NODE_VARDECL:
+        if (ast.get_rhs(node) != NODE_NONE) {
+            return build_ir_variable_declaration(ast.get_payload(node), codegen_flat_expression(ast, ast.get_rhs(node), code_generator), nullptr, code_generator);
+        }
+        return build_ir_variable_declaration(ast.get_payload(node), {}, codegen_flat_type(ast, ast.get_lhs(node), code_generator), code_generator);
+
+    case NODE_ASSIGN: {
+        sTypedValue value = codegen_flat_expression(ast, ast.get_lhs(node), code_generator);
+        if (!value) {
+            DEPLANG_PARSER_ERROR("Couldn't Assign value to variable");
+            return {};
+        }
+        code_generator->m_NamedValues[ast.get_payload(node)] = value;
+        return value;
+    }
+
+    case NODE_CALL: {
+        symbol_t callee = ast.get_payload(node);
+        llvm::Function* callee_f = code_generator->m_Module->getFunction(get_symbol_string(callee));
+        if (!callee_f) {
+            DEPLANG_PARSER_ERROR("Function " << get_symbol_string(callee) << " not found");
+            return {};
+        }
+
+        uint32_t first_arg = ast.get_lhs(node), arg_count = ast.get_rhs(node);
+        if (callee_f->arg_size() != arg_count) {
+            DEPLANG_PARSER_ERROR("Expected " << callee_f->arg_size() << ", got " << arg_count << "arguments");
+            return {};
+        }
+
+        std::vector<llvm::Value*> args_v;
+        for (uint32_t i = 0; i < arg_count; ++i) {
+            sTypedValue arg = codegen_flat_expression(ast, ast.get_extra(first_arg + i), code_generator);
+            if (!arg) {
+                DEPLANG_PARSER_ERROR("Couldn't evaluate argument of call expression");
+                return {};
+            }
+            args_v.push_back(arg.value);
+        }
+
+        llvm::Value* val = code_generator->m_Builder->CreateCall(callee_f, args_v, "calltmp");
+        return sTypedValue(val, callee_f->getReturnType());
+    }
+
+    default:
+        DEPLANG_PARSER_ERROR("Node " << node << " is not an expression");
+        return {};
+    }
+}
+
+llvm::Function* codegen_flat_prototype(const cFlatAST& ast, node_index_t function, std::shared_ptr<cCodeGenerator> code_generator) {
+    std::string_view name = get_symbol_string(ast.get_payload(function));
+    llvm::Function* declared = code_generator->m_Module->getFunction(llvm::StringRef(name.data(), name.size()));
+    if (declared && declared->isDeclaration()) { return declared; }
+
+    uint32_t position = ast.get_lhs(function);
+    node_index_t return_type = ast.get_extra(position++);
+    uint32_t param_count = ast.get_extra(position++);
+    uint32_t first_param = position;
+
+    std::vector<llvm::Type*> param_types;
+    for (uint32_t i = 0; i < param_count; ++i) {
+        node_index_t param = ast.get_extra(first_param + i);
+        llvm::Type* param_type = get_llvm_type(ast.get_payload(ast.get_lhs(param)), code_generator);
+        if (!param_type) {
+            DEPLANG_PARSER_ERROR("Couldn't create type of parameter " << get_symbol_string(ast.get_payload(param)));
+            return nullptr;
+        }
+        param_types.push_back(param_type);
+    }
+
+    llvm::Type* func_return_type = codegen_flat_type(ast, return_type, code_generator);
+    if (!func_return_type) {
+        DEPLANG_PARSER_ERROR("Couldn't create function return type");
+        return nullptr;
+    }
+
+    llvm::FunctionType* func_type = llvm::FunctionType::get(func_return_type, param_types, false);
+    return llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, name, code_generator->m_Module.get());
+}
+
+llvm::Function* codegen_flat_function(const cFlatAST& ast, node_index_t function, std::shared_ptr<cCodeGenerator> code_generator) {
+    cScopedTimer timer("Codegen function", get_symbol_string(ast.get_payload(function)));
+    uint32_t position = ast.get_lhs(function) + 1;
+    uint32_t param_count = ast.get_extra(position++);
+    uint32_t first_param = position;
+    position += param_count;
+    uint32_t body_count = ast.get_extra(position++);
+    uint32_t first_expr = position;
+
+    llvm::Function* func = codegen_flat_prototype(ast, function, code_generator);
+    if (!func) { return nullptr; }
+    llvm::Type* func_return_type = func->getReturnType();
+
+    code_generator->delete_named_values();
+    uint32_t index = 0;
+    for (auto& arg : func->args()) {
+        symbol_t param_name = ast.get_payload(ast.get_extra(first_param + index));
+        arg.setName(get_symbol_string(param_name));
+        code_generator->m_NamedValues[param_name] = sTypedValue(&arg, arg.getType());
+        index++;
+    }
+
+    llvm::BasicBlock* bb = llvm::BasicBlock::Create(*code_generator->m_Context, "entry", func);
+    code_generator->m_Builder->SetInsertPoint(bb);
+
+    for (uint32_t i = 0; i < body_count; ++i) {
+        node_index_t expr = ast.get_extra(first_expr + i);
+        sTypedValue value = codegen_flat_expression(ast, expr, code_generator);
+        if (!value) {
+            DEPLANG_PARSER_ERROR("Couldn't evaluate expression");
+            return nullptr;
+        }
+
+        if (ast.get_kind(expr) == NODE_RETURN) {
+            // @TODO: Better type checking
+            if (func_return_type->getTypeID() != value.type->getTypeID()) {
+                DEPLANG_PARSER_ERROR("Type mismatch");
+                func->eraseFromParent();
+                return nullptr;
+            }
+
+            code_generator->m_Builder->CreateRet(value.value);
+            break;
+        }
+    }
+
+    // Verifies the function first
+    code_generator->optimize_function(*func);
+    return func;
+}
+
+void collect_flat_callees(const cFlatAST& ast, node_index_t node, std::vector<symbol_t>& callees) {
+    switch (ast.get_kind(node)) {
+    case NODE_BINARY:
+        collect_flat_callees(ast, ast.get_lhs(node), callees);
+        collect_flat_callees(ast, ast.get_rhs(node), callees);
+        break;
+    case NODE_RETURN:
+    case NODE_ASSIGN:
+        collect_flat_callees(ast, ast.get_lhs(node), callees);
+        break;
+    case NODE_VARDECL:
+        if (ast.get_rhs(node) != NODE_NONE) { collect_flat_callees(ast, ast.get_rhs(node), callees); }
+        break;
+    case NODE_CALL:
+        callees.push_back(ast.get_payload(node));
+        for (uint32_t i = 0; i < ast.get_rhs(node); ++i) { collect_flat_callees(ast, ast.get_extra(ast.get_lhs(node) + i), callees); }
+        break;
+    case NODE_FUNCTION: {
+        uint32_t position = ast.get_lhs(node) + 1;
+        position += ast.get_extra(position) + 1;
+        uint32_t body_count = ast.get_extra(position++);
+        for (uint32_t i = 0; i < body_count; ++i) { collect_flat_callees(ast, ast.get_extra(position + i), callees); }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+
+// Printing
+void print_flat(const cFlatAST& ast) {
+    for (node_index_t root : ast.get_roots()) { print_flat_node(ast, root, 0); }
+}
+
+void print_flat_node(const cFlatAST& ast, node_index_t node, int depth) {
+    if (node == NODE_NONE) { return; }
+
+    std::cout << std::string(depth * 2, ' ');
+    switch (ast.get_kind(node)) {
+    case NODE_INT:      std::cout << ast.get_int(node) << std::endl; break;
+    case NODE_FLOAT:    std::cout << ast.get_float(node) << std::endl; break;
+    case NODE_BOOL:     std::cout << (ast.get_payload(node) ? "true" : "false") << std::endl; break;
+    case NODE_VARIABLE: std::cout << get_symbol_string(ast.get_payload(node)) << std::endl; break;
+
+    case NODE_BINARY:
+        std::cout << ast.get_operator(node) << std::endl;
+        print_flat_node(ast, ast.get_lhs(node), depth + 1);
+        print_flat_node(ast, ast.get_rhs(node), depth + 1);
+        break;
+
+    case NODE_RETURN:
+        std::cout << "ret" << std::endl;
+        print_flat_node(ast, ast.get_lhs(node), depth + 1);
+        break;
+
+    case NODE_VARDECL:
+        std::cout << "let " << get_symbol_string(ast.get_payload(node)) << std::endl;
+        print_flat_node(ast, ast.get_lhs(node), depth + 1);
+        print_flat_node(ast, ast.get_rhs(node), depth + 1);
+        break;
+
+    case NODE_ASSIGN:
+        std::cout << get_symbol_string(ast.get_payload(node)) << " =" << std::endl;
+        print_flat_node(ast, ast.get_lhs(node), depth + 1);
+        break;
+
+    case NODE_CALL:
+        std::cout << "call " << get_symbol_string(ast.get_payload(node)) << std::endl;
+        for (uint32_t i = 0; i < ast.get_rhs(node); ++i) { print_flat_node(ast, ast.get_extra(ast.get_lhs(node) + i), depth + 1); }
+        break;
+
+    case NODE_TYPE:
+        std::cout << "type " << get_symbol_string(ast.get_payload(node)) << std::endl;
+        print_flat_node(ast, ast.get_lhs(node), depth + 1);
+        print_flat_node(ast, ast.get_rhs(node), depth + 1);
+        break;
+
+    case NODE_PARAM:
+        std::cout << "param " << get_symbol_string(ast.get_payload(node)) << std::endl;
+        print_flat_node(ast, ast.get_lhs(node), depth + 1);
+        break;
+
+    case NODE_TYPEDECL:
+        std::cout << "typedecl " << get_symbol_string(ast.get_payload(node)) << std::endl;
+        print_flat_node(ast, ast.get_lhs(node), depth + 1);
+        break;
+
+    case NODE_IMPORT:
+        std::cout << "import " << get_symbol_string(ast.get_payload(node)) << std::endl;
+        break;
+
+    case NODE_FUNCTION:
+    case NODE_EXTERN: {
+        std::cout << (ast.get_kind(node) == NODE_EXTERN ? "extern func " : "func ") << get_symbol_string(ast.get_payload(node)) << std::endl;
+
+        uint32_t position = ast.get_lhs(node);
+        print_flat_node(ast, ast.get_extra(position++), depth + 1);
+
+        uint32_t param_count = ast.get_extra(position++);
+        for (uint32_t i = 0; i < param_count; ++i) { print_flat_node(ast, ast.get_extra(position++), depth + 1); }
+        if (ast.get_kind(node) == NODE_EXTERN) { break; }
+
+        uint32_t body_count = ast.get_extra(position++);
+        for (uint32_t i = 0; i < body_count; ++i) { print_flat_node(ast, ast.get_extra(position++), depth + 1); }
+        break;
+    }
+    }
+}
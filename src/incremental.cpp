@@ -0,0 +1,267 @@
+#include "../include/incremental.h"
+
+#include <set>
+#include <unordered_map>
+
+#include "../include/object_cache.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Object/ArchiveWriter.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SHA256.h"
+
+
+// Names the fingerprint of a function depends on, ordered so the fingerprint
+// doesn't depend on the order of the calls
+struct sFragmentDependencies {
+    std::set<std::string_view> callees;
+    std::set<std::string_view> types;
+};
+
+struct sFragment {
+    node_index_t function;
+    std::string key;
+    std::vector<node_index_t> callees;
+};
+
+
+static void append_u32(std::string& out, uint32_t value) { out.append((const char*)&value, sizeof(value)); }
+
+// By name, symbol ids depend on the interning order
+static void append_symbol(std::string& out, symbol_t symbol) {
+    std::string_view str = get_symbol_string(symbol);
+    append_u32(out, str.size());
+    out.append(str);
+}
+
+// Canonical bytes of a subtree, collects the called functions and the type names
+static void append_node(const cFlatAST& ast, node_index_t node, std::string& out, sFragmentDependencies& dependencies) {
+    if (node == NODE_NONE) {
+        out.push_back((char)0xff);
+        return;
+    }
+
+    eFlatNodeKind kind = ast.get_kind(node);
+    out.push_back((char)kind);
+
+    switch (kind) {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_BOOL:
+        append_u32(out, ast.get_payload(node));
+        break;
+
+    case NODE_VARIABLE:
+        append_symbol(out, ast.get_payload(node));
+        break;
+
+    case NODE_BINARY:
+        append_u32(out, ast.get_payload(node));
+        append_node(ast, ast.get_lhs(node), out, dependencies);
+        append_node(ast, ast.get_rhs(node), out, dependencies);
+        break;
+
+    case NODE_RETURN:
+        append_node(ast, ast.get_lhs(node), out, dependencies);
+        break;
+
+    case NODE_VARDECL:
+    case NODE_TYPE:
+        append_symbol(out, ast.get_payload(node));
+        append_node(ast, ast.get_lhs(node), out, dependencies);
+        append_node(ast, ast.get_rhs(node), out, dependencies);
+        if (kind == NODE_TYPE && ast.get_lhs(node) == NODE_NONE) { dependencies.types.insert(get_symbol_string(ast.get_payload(node))); }
+        break;
+
+    // Not in a function, callees are appended by signature
+    case NODE_IMPORT:
+    case NODE_EXTERN:
+        append_symbol(out, ast.get_payload(node));
+        break;
+
+    case NODE_ASSIGN:
+    case NODE_PARAM:
+    case NODE_TYPEDECL:
+        append_symbol(out, ast.get_payload(node));
+        append_node(ast, ast.get_lhs(node), out, dependencies);
+        break;
+
+    case NODE_CALL: {
+        append_symbol(out, ast.get_payload(node));
+        dependencies.callees.insert(get_symbol_string(ast.get_payload(node)));
+
+        uint32_t first_arg = ast.get_lhs(node), arg_count = ast.get_rhs(node);
+        append_u32(out, arg_count);
+        for (uint32_t i = 0; i < arg_count; ++i) { append_node(ast, ast.get_extra(first_arg + i), out, dependencies); }
+        break;
+    }
+
+    case NODE_FUNCTION: {
+        append_symbol(out, ast.get_payload(node));
+
+        uint32_t position = ast.get_lhs(node);
+        append_node(ast, ast.get_extra(position++), out, dependencies);
+        uint32_t param_count = ast.get_extra(position++);
+        append_u32(out, param_count);
+        for (uint32_t i = 0; i < param_count; ++i) { append_node(ast, ast.get_extra(position++), out, dependencies); }
+        uint32_t body_count = ast.get_extra(position++);
+        append_u32(out, body_count);
+        for (uint32_t i = 0; i < body_count; ++i) { append_node(ast, ast.get_extra(position++), out, dependencies); }
+        break;
+    }
+    }
+}
+
+// What a caller sees of a function: name, return type and parameter types
+static void append_signature(const cFlatAST& ast, node_index_t function, std::string& out, sFragmentDependencies& dependencies) {
+    append_symbol(out, ast.get_payload(function));
+
+    uint32_t position = ast.get_lhs(function);
+    append_node(ast, ast.get_extra(position++), out, dependencies);
+    uint32_t param_count = ast.get_extra(position++);
+    append_u32(out, param_count);
+    for (uint32_t i = 0; i < param_count; ++i) { append_node(ast, ast.get_lhs(ast.get_extra(position++)), out, dependencies); }
+}
+
+static sFragment fingerprint_function(const cFlatAST& ast, node_index_t function, const std::string& configuration_key,
+                                      const std::unordered_map<std::string_view, node_index_t>& functions,
+                                      const std::unordered_map<std::string_view, node_index_t>& type_decls) {
+    sFragment fragment;
+    fragment.function = function;
+
+    std::string description;
+    sFragmentDependencies dependencies;
+    append_node(ast, function, description, dependencies);
+
+    // Only the signatures of the callees, their bodies live in other fragments
+    sFragmentDependencies callee_dependencies;
+    for (std::string_view callee : dependencies.callees) {
+        node_index_t callee_function = functions.at(callee);
+        append_signature(ast, callee_function, description, callee_dependencies);
+        fragment.callees.push_back(callee_function);
+    }
+    dependencies.types.insert(callee_dependencies.types.begin(), callee_dependencies.types.end());
+
+    // Declared types in name order, then the ones they are defined with
+    std::set<std::string_view> expanded;
+    std::vector<std::string_view> pending(dependencies.types.rbegin(), dependencies.types.rend());
+    while (!pending.empty()) {
+        std::string_view name = pending.back();
+        pending.pop_back();
+        if (!expanded.insert(name).second) { continue; }
+
+        auto type_decl = type_decls.find(name);
+        if (type_decl == type_decls.end()) { continue; }
+
+        sFragmentDependencies type_dependencies;
+        append_node(ast, type_decl->second, description, type_dependencies);
+        pending.insert(pending.end(), type_dependencies.types.rbegin(), type_dependencies.types.rend());
+    }
+
+    llvm::SHA256 hash;
+    hash.update(configuration_key);
+    hash.update(description);
+    fragment.key = llvm::toHex(hash.final(), true);
+    return fragment;
+}
+
+// Defines the declared types and declares the callees only, in a new module.
+// The target machine and optimizer are the ones of configured
+static bool codegen_flat_fragment(const cFlatAST& ast, const sFragment& fragment, const cCodeGenerator& configured, const std::string& object_file_name) {
+    cScopedTimer timer("Codegen fragment", get_symbol_string(ast.get_payload(fragment.function)));
+    std::shared_ptr<cCodeGenerator> code_generator = std::make_shared<cCodeGenerator>();
+    code_generator->configure(configured);
+
+    if (!codegen_flat_named_types(ast, code_generator)) { return false; }
+    for (node_index_t callee : fragment.callees) {
+        if (!codegen_flat_prototype(ast, callee, code_generator)) { return false; }
+    }
+    if (!codegen_flat_function(ast, fragment.function, code_generator)) { return false; }
+
+    return code_generator->emit_object_code(object_file_name);
+}
+
+static bool write_thin_archive(const std::vector<std::string>& object_file_names, const std::string& archive_file_name) {
+    cScopedTimer timer("Write archive", archive_file_name);
+
+    // Members refer to the names, relative to the archive
+    std::vector<std::string> member_names;
+    std::vector<llvm::NewArchiveMember> members;
+    member_names.reserve(object_file_names.size());
+    members.reserve(object_file_names.size());
+
+    for (const std::string& object_file_name : object_file_names) {
+        llvm::Expected<llvm::NewArchiveMember> member = llvm::NewArchiveMember::getFile(object_file_name, true);
+        if (!member) {
+            std::cerr << "Could not read " << object_file_name << ": " << llvm::toString(member.takeError()) << std::endl;
+            return false;
+        }
+        llvm::Expected<std::string> member_name = llvm::computeArchiveRelativePath(archive_file_name, object_file_name);
+        if (!member_name) {
+            std::cerr << "Could not add " << object_file_name << " to " << archive_file_name << ": " << llvm::toString(member_name.takeError()) << std::endl;
+            return false;
+        }
+
+        member_names.push_back(std::move(*member_name));
+        member->MemberName = member_names.back();
+        members.push_back(std::move(*member));
+    }
+
+    if (llvm::Error error = llvm::writeArchive(archive_file_name, members, true, llvm::object::Archive::K_GNU, true, true)) {
+        std::cerr << "Could not write " << archive_file_name << ": " << llvm::toString(std::move(error)) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool codegen_flat_incremental(const cFlatAST& ast, const sCompilerOptions& options, const std::string& cache_directory, const std::string& archive_file_name) {
+    cObjectCache cache(cache_directory);
+
+    std::unordered_map<std::string_view, node_index_t> functions;
+    std::unordered_map<std::string_view, node_index_t> type_decls;
+    for (node_index_t root : ast.get_roots()) {
+        std::string_view name = get_symbol_string(ast.get_payload(root));
+        if (ast.get_kind(root) == NODE_FUNCTION || ast.get_kind(root) == NODE_EXTERN) { functions[name] = root; }
+        else if (ast.get_kind(root) == NODE_TYPEDECL) { type_decls[name] = root; }
+    }
+
+    // Compiler build, target and options, shared by every fragment
+    std::string configuration_key = cache.compute_key({}, options);
+
+    // Configured on the first regenerated fragment only, a no-op run creates
+    // no target machine
+    std::unique_ptr<cCodeGenerator> configured;
+
+    std::vector<std::string> object_file_names;
+    size_t regenerated = 0;
+    for (node_index_t root : ast.get_roots()) {
+        if (ast.get_kind(root) != NODE_FUNCTION) { continue; }
+
+        sFragment fragment = fingerprint_function(ast, root, configuration_key, functions, type_decls);
+        std::string entry = cache.get_entry_path(fragment.key);
+        object_file_names.push_back(entry);
+
+        if (llvm::sys::fs::exists(entry)) { continue; }
+
+        DEPLANG_LOG(LOG_DEBUG, LOG_CODEGEN, "Regenerating " << get_symbol_string(ast.get_payload(root)) << " " << fragment.key);
+
+        std::string temporary = cache.create_temporary(fragment.key);
+        if (temporary.empty()) { return false; }
+
+        if (!configured) {
+            configured = std::make_unique<cCodeGenerator>();
+            configured->configure(options);
+        }
+        if (!codegen_flat_fragment(ast, fragment, *configured, temporary)) {
+            llvm::sys::fs::remove(temporary);
+            return false;
+        }
+        if (!cache.insert(fragment.key, temporary)) { return false; }
+
+        ++regenerated;
+    }
+
+    std::cout << "Regenerated " << regenerated << " of " << object_file_names.size() << " functions" << std::endl;
+
+    return write_thin_archive(object_file_names, archive_file_name);
+}
@@ -0,0 +1,261 @@
+#include "../include/interface_file.h"
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+
+cInterfaceFile::cInterfaceFile(std::unique_ptr<cSourceFile> mapping) : m_mapping(std::move(mapping)) {
+    // The mapping is page aligned and every field is 32-bit
+    const char* data = this->m_mapping->get_content().data();
+    this->m_header = (const sInterfaceHeader*)data;
+    if (this->m_mapping->get_size() < sizeof(sInterfaceHeader)) { return; }
+
+    this->m_type_nodes = (const sInterfaceTypeNode*)(data + sizeof(sInterfaceHeader));
+    this->m_params = (const sInterfaceParam*)(this->m_type_nodes + this->m_header->type_node_count);
+    this->m_functions = (const sInterfaceFunction*)(this->m_params + this->m_header->param_count);
+    this->m_type_decls = (const sInterfaceTypeDecl*)(this->m_functions + this->m_header->function_count);
+    this->m_strings = (const sInterfaceString*)(this->m_type_decls + this->m_header->type_decl_count);
+    this->m_chars = (const char*)(this->m_strings + this->m_header->string_count);
+}
+
+std::unique_ptr<cInterfaceFile> cInterfaceFile::open(const std::string& file_path) {
+    std::unique_ptr<cSourceFile> mapping = cSourceFile::open(file_path);
+    if (!mapping) { return nullptr; }
+
+    std::unique_ptr<cInterfaceFile> interface(new cInterfaceFile(std::move(mapping)));
+    if (!interface->validate()) {
+        std::cerr << "Invalid interface file: " << file_path << std::endl;
+        return nullptr;
+    }
+    return interface;
+}
+
+bool cInterfaceFile::validate() const {
+    size_t size = this->m_mapping->get_size();
+    if (size < sizeof(sInterfaceHeader)) { return false; }
+
+    const sInterfaceHeader& header = *this->m_header;
+    if (memcmp(header.magic, INTERFACE_MAGIC, sizeof(INTERFACE_MAGIC)) != 0 || header.version != INTERFACE_VERSION) { return false; }
+
+    uint64_t expected_size = sizeof(sInterfaceHeader)
+        + (uint64_t)header.type_node_count * sizeof(sInterfaceTypeNode)
+        + (uint64_t)header.param_count * sizeof(sInterfaceParam)
+        + (uint64_t)header.function_count * sizeof(sInterfaceFunction)
+        + (uint64_t)header.type_decl_count * sizeof(sInterfaceTypeDecl)
+        + (uint64_t)header.string_count * sizeof(sInterfaceString)
+        + header.char_count;
+    if (expected_size != size) { return false; }
+
+    auto is_string = [&header](uint32_t name) { return name < header.string_count; };
+    auto is_type = [&header](uint32_t type) { return type < header.type_node_count; };
+
+    for (uint32_t i = 0; i < header.string_count; ++i) {
+        if ((uint64_t)this->m_strings[i].offset + this->m_strings[i].length > header.char_count) { return false; }
+    }
+    for (uint32_t i = 0; i < header.type_node_count; ++i) {
+        const sInterfaceTypeNode& node = this->m_type_nodes[i];
+        if (!is_string(node.name)) { return false; }
+        // Operands before the node, no cycle when importing
+        if ((node.lhs == INTERFACE_NONE) != (node.rhs == INTERFACE_NONE)) { return false; }
+        if (node.lhs != INTERFACE_NONE && (node.lhs >= i || node.rhs >= i)) { return false; }
+    }
+    for (uint32_t i = 0; i < header.param_count; ++i) {
+        if (!is_string(this->m_params[i].name) || !is_type(this->m_params[i].type)) { return false; }
+    }
+    for (uint32_t i = 0; i < header.function_count; ++i) {
+        const sInterfaceFunction& function = this->m_functions[i];
+        if (!is_string(function.name) || !is_type(function.return_type)) { return false; }
+        if ((uint64_t)function.first_param + function.param_count > header.param_count) { return false; }
+    }
+    for (uint32_t i = 0; i < header.type_decl_count; ++i) {
+        if (!is_string(this->m_type_decls[i].name) || !is_type(this->m_type_decls[i].type)) { return false; }
+    }
+
+    return true;
+}
+
+std::string_view cInterfaceFile::get_string(uint32_t string) const {
+    return std::string_view(this->m_chars + this->m_strings[string].offset, this->m_strings[string].length);
+}
+
+symbol_t cInterfaceFile::import_string(uint32_t string, std::vector<symbol_t>& symbols) const {
+    if (symbols[string] == SYM_NONE) { symbols[string] = intern_string(this->get_string(string)); }
+    return symbols[string];
+}
+
+// Type nodes are shared in the AST too, they are never mutated
+node_index_t cInterfaceFile::import_type(cFlatAST& ast, uint32_t type, std::vector<symbol_t>& symbols, std::vector<node_index_t>& types) const {
+    if (types[type] != NODE_NONE) { return types[type]; }
+
+    const sInterfaceTypeNode& node = this->m_type_nodes[type];
+    symbol_t name = this->import_string(node.name, symbols);
+    if (node.lhs == INTERFACE_NONE) {
+        types[type] = ast.add_node(NODE_TYPE, name);
+    } else {
+        node_index_t lhs = this->import_type(ast, node.lhs, symbols, types);
+        node_index_t rhs = this->import_type(ast, node.rhs, symbols, types);
+        types[type] = ast.add_node(NODE_TYPE, name, lhs, rhs);
+    }
+    return types[type];
+}
+
+void cInterfaceFile::import_into(cFlatAST& ast) const {
+    std::vector<symbol_t> symbols(this->m_header->string_count, SYM_NONE);
+    std::vector<node_index_t> types(this->m_header->type_node_count, NODE_NONE);
+
+    for (uint32_t i = 0; i < this->m_header->type_decl_count; ++i) {
+        const sInterfaceTypeDecl& type_decl = this->m_type_decls[i];
+        node_index_t type = this->import_type(ast, type_decl.type, symbols, types);
+        ast.add_root(ast.add_node(NODE_TYPEDECL, this->import_string(type_decl.name, symbols), type));
+    }
+
+    std::vector<node_index_t> signature;
+    for (uint32_t i = 0; i < this->m_header->function_count; ++i) {
+        const sInterfaceFunction& function = this->m_functions[i];
+
+        signature.clear();
+        signature.push_back(this->import_type(ast, function.return_type, symbols, types));
+        signature.push_back(function.param_count);
+        for (uint32_t j = 0; j < function.param_count; ++j) {
+            const sInterfaceParam& param = this->m_params[function.first_param + j];
+            node_index_t type = this->import_type(ast, param.type, symbols, types);
+            signature.push_back(ast.add_node(NODE_PARAM, this->import_string(param.name, symbols), type));
+        }
+
+        ast.add_root(ast.add_node(NODE_EXTERN, this->import_string(function.name, symbols), ast.add_extra(signature)));
+    }
+}
+
+
+// Writing
+// Arrays of the file, filled from the AST
+struct sInterfaceBuilder {
+    std::vector<sInterfaceTypeNode> type_nodes;
+    std::vector<sInterfaceParam> params;
+    std::vector<sInterfaceFunction> functions;
+    std::vector<sInterfaceTypeDecl> type_decls;
+    std::vector<sInterfaceString> strings;
+    std::string chars;
+    std::unordered_map<symbol_t, uint32_t> string_indices;
+    // Name and operands of each type node
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> type_indices;
+
+    uint32_t add_string(symbol_t symbol) {
+        auto inserted = this->string_indices.emplace(symbol, (uint32_t)this->strings.size());
+        if (inserted.second) {
+            std::string_view str = get_symbol_string(symbol);
+            this->strings.push_back({ (uint32_t)this->chars.size(), (uint32_t)str.size() });
+            this->chars.append(str);
+        }
+        return inserted.first->second;
+    }
+
+    uint32_t add_type(const cFlatAST& ast, node_index_t type) {
+        sInterfaceTypeNode node = { this->add_string(ast.get_payload(type)), INTERFACE_NONE, INTERFACE_NONE };
+        if (ast.get_lhs(type) != NODE_NONE && ast.get_rhs(type) != NODE_NONE) {
+            node.lhs = this->add_type(ast, ast.get_lhs(type));
+            node.rhs = this->add_type(ast, ast.get_rhs(type));
+        }
+
+        auto inserted = this->type_indices.emplace(std::make_tuple(node.name, node.lhs, node.rhs), (uint32_t)this->type_nodes.size());
+        if (inserted.second) { this->type_nodes.push_back(node); }
+        return inserted.first->second;
+    }
+};
+
+template <typename T>
+static void write_array(llvm::raw_ostream& out, const std::vector<T>& array) {
+    out.write((const char*)array.data(), array.size() * sizeof(T));
+}
+
+bool cInterfaceFile::write(const cFlatAST& ast, const std::vector<node_index_t>& roots, const std::string& file_path) {
+    sInterfaceBuilder builder;
+
+    for (node_index_t root : roots) {
+        if (ast.get_kind(root) == NODE_TYPEDECL) {
+            uint32_t name = builder.add_string(ast.get_payload(root));
+            builder.type_decls.push_back({ name, builder.add_type(ast, ast.get_lhs(root)) });
+            continue;
+        }
+        if (ast.get_kind(root) != NODE_FUNCTION) { continue; }
+
+        sInterfaceFunction function;
+        function.name = builder.add_string(ast.get_payload(root));
+
+        uint32_t position = ast.get_lhs(root);
+        function.return_type = builder.add_type(ast, ast.get_extra(position++));
+        function.param_count = ast.get_extra(position++);
+        function.first_param = (uint32_t)builder.params.size();
+        for (uint32_t i = 0; i < function.param_count; ++i) {
+            node_index_t param = ast.get_extra(position++);
+            uint32_t name = builder.add_string(ast.get_payload(param));
+            builder.params.push_back({ name, builder.add_type(ast, ast.get_lhs(param)) });
+        }
+        builder.functions.push_back(function);
+    }
+
+    sInterfaceHeader header;
+    memcpy(header.magic, INTERFACE_MAGIC, sizeof(INTERFACE_MAGIC));
+    header.version = INTERFACE_VERSION;
+    header.type_node_count = builder.type_nodes.size();
+    header.param_count = builder.params.size();
+    header.function_count = builder.functions.size();
+    header.type_decl_count = builder.type_decls.size();
+    header.string_count = builder.strings.size();
+    header.char_count = builder.chars.size();
+
+    // Modules importing this one never see a partial file
+    llvm::SmallString<256> temporary;
+    int fd;
+    if (llvm::sys::fs::createUniqueFile(file_path + ".tmp%%%%%%", fd, temporary)) {
+        std::cerr << "Could not create " << file_path << std::endl;
+        return false;
+    }
+
+    llvm::raw_fd_ostream out(fd, true);
+    out.write((const char*)&header, sizeof(header));
+    write_array(out, builder.type_nodes);
+    write_array(out, builder.params);
+    write_array(out, builder.functions);
+    write_array(out, builder.type_decls);
+    write_array(out, builder.strings);
+    out << builder.chars;
+    out.close();
+
+    bool failed = out.has_error();
+    out.clear_error();
+    if (failed || llvm::sys::fs::rename(temporary, file_path)) {
+        llvm::sys::fs::remove(temporary);
+        std::cerr << "Could not write " << file_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+std::vector<std::string> find_imports(std::string_view source) {
+    std::vector<std::string> imports;
+    cLexer lexer(source);
+
+    for (sToken token = lexer.get_next_token(); token.token_type != TOK_EOF; token = lexer.get_next_token()) {
+        if (token.token_type != TOK_IMPORT) { continue; }
+
+        token = lexer.get_next_token();
+        if (token.token_type == TOK_IDENTIFIER) { imports.emplace_back(lexer.get_token_value(token)); }
+    }
+    return imports;
+}
+
+std::string find_interface_file(std::string_view module, const std::vector<std::string>& import_paths) {
+    for (const std::string& import_path : import_paths) {
+        llvm::SmallString<256> file_path(import_path);
+        llvm::sys::path::append(file_path, std::string(module) + INTERFACE_FILE_EXTENSION);
+        if (llvm::sys::fs::exists(file_path)) { return std::string(file_path); }
+    }
+    return {};
+}
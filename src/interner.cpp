@@ -0,0 +1,114 @@
+#include "../include/interner.h"
+
+#include <cstring>
+
+static const size_t INTERNER_BLOCK_SIZE = 64 * 1024;
+static const size_t SYMBOL_MAP_INITIAL_SIZE = 1024;
+
+
+// Symbol map
+cSymbolMap::cSymbolMap() : m_entries(SYMBOL_MAP_INITIAL_SIZE, sEntry{ 0, nullptr, 0, SYM_NONE }), m_count(0) {}
+
+void cSymbolMap::insert(std::string_view str, uint64_t hash, symbol_t symbol) {
+    size_t mask = this->m_entries.size() - 1;
+    size_t slot = hash & mask;
+    while (this->m_entries[slot].symbol != SYM_NONE) { slot = (slot + 1) & mask; }
+
+    this->m_entries[slot] = sEntry{ hash, str.data(), (uint32_t)str.size(), symbol };
+
+    // Keep the load factor under 1/2
+    if (++this->m_count * 2 > this->m_entries.size()) { this->grow(); }
+}
+
+void cSymbolMap::grow() {
+    std::vector<sEntry> old_entries(this->m_entries.size() * 2, sEntry{ 0, nullptr, 0, SYM_NONE });
+    old_entries.swap(this->m_entries);
+
+    size_t mask = this->m_entries.size() - 1;
+    for (const sEntry& entry : old_entries) {
+        if (entry.symbol == SYM_NONE) { continue; }
+        size_t slot = entry.hash & mask;
+        while (this->m_entries[slot].symbol != SYM_NONE) { slot = (slot + 1) & mask; }
+        this->m_entries[slot] = entry;
+    }
+}
+
+
+// String interner
+
+cStringInterner& cStringInterner::get() {
+    static cStringInterner interner;
+    return interner;
+}
+
+cStringInterner::cStringInterner() : m_block_used(INTERNER_BLOCK_SIZE), m_string_count(0) {
+    for (std::atomic<std::string_view*>& chunk : this->m_string_chunks) { chunk.store(nullptr, std::memory_order_relaxed); }
+
+    // Must match eBuiltinSymbol
+    this->intern("int");
+    this->intern("float");
+    this->intern("bool");
+    this->intern("void");
+
+    this->intern("*");
+    this->intern("|");
+    this->intern("->");
+}
+
+cStringInterner::~cStringInterner() {
+    for (std::atomic<std::string_view*>& chunk : this->m_string_chunks) { delete[] chunk.load(std::memory_order_relaxed); }
+}
+
+const char* cStringInterner::store(std::string_view str) {
+    // Long names get an allocation of their own
+    if (str.size() > INTERNER_BLOCK_SIZE / 4) {
+        this->m_large_strings.push_back(std::make_unique<char[]>(str.size()));
+        memcpy(this->m_large_strings.back().get(), str.data(), str.size());
+        return this->m_large_strings.back().get();
+    }
+
+    if (this->m_block_used + str.size() > INTERNER_BLOCK_SIZE) {
+        this->m_blocks.push_back(std::make_unique<char[]>(INTERNER_BLOCK_SIZE));
+        this->m_block_used = 0;
+    }
+
+    char* dest = this->m_blocks.back().get() + this->m_block_used;
+    memcpy(dest, str.data(), str.size());
+    this->m_block_used += str.size();
+    return dest;
+}
+
+symbol_t cStringInterner::intern(std::string_view str) {
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+
+    uint64_t hash = cSymbolMap::hash_string(str);
+    symbol_t symbol = this->m_symbols.find(str, hash);
+    if (symbol != SYM_NONE) { return symbol; }
+
+    std::string_view stored(this->store(str), str.size());
+    symbol = this->m_string_count.load(std::memory_order_relaxed);
+
+    uint32_t chunk = get_chunk(symbol);
+    std::string_view* strings = this->m_string_chunks[chunk].load(std::memory_order_relaxed);
+    if (!strings) {
+        strings = new std::string_view[STRING_CHUNK_BASE << chunk];
+        this->m_string_chunks[chunk].store(strings, std::memory_order_relaxed);
+    }
+    strings[symbol - get_chunk_start(chunk)] = stored;
+    this->m_string_count.store(symbol + 1, std::memory_order_release);
+
+    this->m_symbols.insert(stored, hash, symbol);
+    return symbol;
+}
+
+std::string_view cStringInterner::get_string(symbol_t symbol) const {
+    if (symbol >= this->m_string_count.load(std::memory_order_acquire)) { return "<unknown symbol>"; }
+
+    uint32_t chunk = get_chunk(symbol);
+    return this->m_string_chunks[chunk].load(std::memory_order_relaxed)[symbol - get_chunk_start(chunk)];
+}
+
+size_t cStringInterner::size() const {
+    return this->m_string_count.load(std::memory_order_acquire);
+}
+
@@ -0,0 +1,210 @@
+#include "../include/jit.h"
+
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+
+#include <unordered_map>
+
+
+cJIT::cJIT(std::unique_ptr<llvm::orc::LLJIT> jit) : m_jit(std::move(jit)) {}
+
+std::unique_ptr<cJIT> cJIT::create(const llvm::TargetMachine& target_machine) {
+    llvm::orc::JITTargetMachineBuilder machine_builder(target_machine.getTargetTriple());
+    machine_builder.setCPU(target_machine.getTargetCPU().str());
+    machine_builder.addFeatures({ target_machine.getTargetFeatureString().str() });
+    machine_builder.setCodeGenOptLevel(target_machine.getOptLevel());
+
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> jit = llvm::orc::LLJITBuilder()
+        .setJITTargetMachineBuilder(std::move(machine_builder))
+        .create();
+    if (!jit) {
+        llvm::errs() << "Could not create the JIT: " << llvm::toString(jit.takeError()) << "\n";
+        return nullptr;
+    }
+
+    // Symbols not defined by the module are looked up in the process
+    const llvm::DataLayout& data_layout = (*jit)->getDataLayout();
+    llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>> process_symbols =
+        llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(data_layout.getGlobalPrefix());
+    if (!process_symbols) {
+        llvm::errs() << "Could not load the process symbols: " << llvm::toString(process_symbols.takeError()) << "\n";
+        return nullptr;
+    }
+    (*jit)->getMainJITDylib().addGenerator(std::move(*process_symbols));
+
+    return std::unique_ptr<cJIT>(new cJIT(std::move(*jit)));
+}
+
+bool cJIT::add_module(std::shared_ptr<cCodeGenerator> code_generator) {
+    llvm::orc::ThreadSafeModule module(std::move(code_generator->m_Module), std::move(code_generator->m_Context));
+
+    if (llvm::Error error = this->m_jit->addIRModule(std::move(module))) {
+        llvm::errs() << "Could not add the module to the JIT: " << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Functions of a unit added with add_lazy_unit, shared by their
+// materialization units
+struct sLazyUnit {
+    const cFlatAST& ast;
+    std::shared_ptr<const cCodeGenerator> configured;
+    // Defined and imported functions by name, for the callee declarations
+    std::unordered_map<symbol_t, node_index_t> functions;
+    llvm::orc::IRLayer& compile_layer;
+};
+
+// Lowers one function when its body is first looked up, that is on the first
+// call through its stub. Callees are only declared, their calls go through
+// their own stubs
+class cFunctionMaterializationUnit : public llvm::orc::MaterializationUnit {
+public:
+    cFunctionMaterializationUnit(std::shared_ptr<sLazyUnit> unit, node_index_t function, std::string body_name, llvm::orc::SymbolStringPtr body)
+        : MaterializationUnit(Interface({ { body, llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable } }, nullptr)),
+          m_unit(std::move(unit)), m_function(function), m_body_name(std::move(body_name)) {}
+
+    llvm::StringRef getName() const override { return "cFunctionMaterializationUnit"; }
+
+    void materialize(std::unique_ptr<llvm::orc::MaterializationResponsibility> responsibility) override {
+        std::shared_ptr<cCodeGenerator> code_generator = std::make_shared<cCodeGenerator>();
+        code_generator->configure(*this->m_unit->configured);
+
+        if (!this->lower(code_generator)) {
+            responsibility->getExecutionSession().reportError(llvm::make_error<llvm::StringError>(
+                "Could not lower " + this->m_body_name, llvm::inconvertibleErrorCode()));
+            responsibility->failMaterialization();
+            return;
+        }
+
+        llvm::orc::ThreadSafeModule module(std::move(code_generator->m_Module), std::move(code_generator->m_Context));
+        this->m_unit->compile_layer.emit(std::move(responsibility), std::move(module));
+    }
+
+private:
+    bool lower(std::shared_ptr<cCodeGenerator> code_generator) {
+        const cFlatAST& ast = this->m_unit->ast;
+        if (!codegen_flat_named_types(ast, code_generator)) { return false; }
+
+        std::vector<symbol_t> callees;
+        collect_flat_callees(ast, this->m_function, callees);
+        for (symbol_t callee : callees) {
+            auto found = this->m_unit->functions.find(callee);
+            if (found == this->m_unit->functions.end() || !codegen_flat_prototype(ast, found->second, code_generator)) { return false; }
+        }
+
+        llvm::Function* function = codegen_flat_function(ast, this->m_function, code_generator);
+        if (!function) { return false; }
+        // Recursive calls keep calling the body directly
+        function->setName(this->m_body_name);
+        return true;
+    }
+
+    // Only one definition of a function per unit, nothing can replace it
+    void discard(const llvm::orc::JITDylib&, const llvm::orc::SymbolStringPtr&) override {}
+
+    std::shared_ptr<sLazyUnit> m_unit;
+    node_index_t m_function;
+    std::string m_body_name;
+};
+
+// Stubs jump here when the function couldn't be lowered or compiled, the
+// error has been reported by the execution session
+static void lazy_call_failed() {
+    std::cerr << "Could not compile the called function" << std::endl;
+    exit(1);
+}
+
+bool cJIT::add_lazy_unit(const cFlatAST& ast, std::shared_ptr<const cCodeGenerator> configured) {
+    llvm::orc::ExecutionSession& session = this->m_jit->getExecutionSession();
+    const llvm::Triple& triple = this->m_jit->getTargetTriple();
+
+    if (!this->m_call_through) {
+        llvm::Expected<std::unique_ptr<llvm::orc::LazyCallThroughManager>> call_through =
+            llvm::orc::createLocalLazyCallThroughManager(triple, session, llvm::pointerToJITTargetAddress(&lazy_call_failed));
+        if (!call_through) {
+            llvm::errs() << "Could not create the lazy call through manager: " << llvm::toString(call_through.takeError()) << "\n";
+            return false;
+        }
+        this->m_call_through = std::move(*call_through);
+        this->m_stubs = llvm::orc::createLocalIndirectStubsManagerBuilder(triple)();
+
+        llvm::Expected<llvm::orc::JITDylib&> bodies = this->m_jit->createJITDylib("bodies");
+        if (!bodies) {
+            llvm::errs() << "Could not create the function bodies dylib: " << llvm::toString(bodies.takeError()) << "\n";
+            return false;
+        }
+        // Callees and process symbols
+        bodies->addToLinkOrder(this->m_jit->getMainJITDylib());
+        this->m_bodies = &*bodies;
+    }
+
+    std::shared_ptr<sLazyUnit> unit(new sLazyUnit{ ast, std::move(configured), {}, this->m_jit->getIRCompileLayer() });
+    for (node_index_t root : ast.get_roots()) {
+        eFlatNodeKind kind = ast.get_kind(root);
+        if (kind == NODE_FUNCTION || kind == NODE_EXTERN) { unit->functions[ast.get_payload(root)] = root; }
+    }
+
+    // Each function is a stub in the main dylib, reexporting its body
+    llvm::orc::SymbolAliasMap stubs;
+    for (node_index_t root : ast.get_roots()) {
+        if (ast.get_kind(root) != NODE_FUNCTION) { continue; }
+
+        std::string name(get_symbol_string(ast.get_payload(root)));
+        std::string body_name = name + "$body";
+        llvm::orc::SymbolStringPtr body = this->m_jit->mangleAndIntern(body_name);
+
+        if (llvm::Error error = this->m_bodies->define(std::make_unique<cFunctionMaterializationUnit>(unit, root, body_name, body))) {
+            llvm::errs() << "Could not add " << name << " to the JIT: " << llvm::toString(std::move(error)) << "\n";
+            return false;
+        }
+        stubs[this->m_jit->mangleAndIntern(name)] = llvm::orc::SymbolAliasMapEntry(body, llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+    }
+
+    if (llvm::Error error = this->m_jit->getMainJITDylib().define(
+            llvm::orc::lazyReexports(*this->m_call_through, *this->m_stubs, *this->m_bodies, std::move(stubs)))) {
+        llvm::errs() << "Could not add the stubs to the JIT: " << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+void* cJIT::lookup(std::string_view name) {
+    llvm::Expected<llvm::JITEvaluatedSymbol> symbol = this->m_jit->lookup(llvm::StringRef(name.data(), name.size()));
+    if (!symbol) {
+        llvm::errs() << "Could not find " << name << ": " << llvm::toString(symbol.takeError()) << "\n";
+        return nullptr;
+    }
+    return (void*)symbol->getAddress();
+}
+
+
+type_id_t get_entry_return_type(const llvm::Function& function) {
+    if (function.arg_size() != 0) { return TYPE_NONE; }
+
+    llvm::Type* type = function.getReturnType();
+    if (type->isIntegerTy(32)) { return TYPE_INT; }
+    if (type->isFloatTy()) { return TYPE_FLOAT; }
+    if (type->isIntegerTy(1)) { return TYPE_BOOL; }
+    if (type->isVoidTy()) { return TYPE_VOID; }
+    return TYPE_NONE;
+}
+
+type_id_t get_entry_return_type(const cFlatAST& ast, node_index_t function) {
+    uint32_t position = ast.get_lhs(function);
+    if (ast.get_extra(position + 1) != 0) { return TYPE_NONE; }
+
+    type_id_t type = resolve_flat_type(ast, ast.get_extra(position));
+    if (type == TYPE_INT || type == TYPE_FLOAT || type == TYPE_BOOL || type == TYPE_VOID) { return type; }
+    return TYPE_NONE;
+}
+
+void call_entry(void* address, type_id_t return_type) {
+    switch (return_type) {
+        case TYPE_INT: std::cout << "Returned " << ((int (*)())address)() << std::endl; break;
+        case TYPE_FLOAT: std::cout << "Returned " << ((float (*)())address)() << std::endl; break;
+        case TYPE_BOOL: std::cout << "Returned " << (((bool (*)())address)() ? "true" : "false") << std::endl; break;
+        case TYPE_VOID: ((void (*)())address)(); break;
+    }
+}
@@ -1,10 +1,15 @@
 
 #include "../include/lexer.h"
+#include "../include/scanner.h"
 
-cLexer::cLexer(std::string input_str) {
+#include <cstring>
+
+cLexer::cLexer(std::string_view input_str, eCommentMode comment_mode) {
     this->m_input_str = input_str;
     this->m_current_pos = 0;
     this->m_current_line_count = 1;
+    this->m_comment_mode = comment_mode;
+    this->m_token_count = 0;
 }
 
 std::string get_token_type_string(eTokenType token_type) {
@@ -40,33 +45,216 @@ std::string get_token_type_string(eTokenType token_type) {
         case TOK_TRUE:          return "TRUE";
         case TOK_FALSE:         return "FALSE";
 
+        case TOK_MATCH:         return "MATCH";
+        case TOK_CASE:          return "CASE";
+        case TOK_WHERE:         return "WHERE";
+        case TOK_FORALL:        return "FORALL";
+
+        case TOK_IMPORT:        return "IMPORT";
+
         case TOK_UNKNOWN:
         default:                return "UNKNOWN";
     }
 }
 
-inline bool is_operator(char ch) { return ch == '+' || ch == '-' || ch == '*' || ch == '/'; }
+// Keywords
+// Looked up through a perfect hash computed at compile time: one table
+// probe and one compare per identifier, whatever the number of keywords.
+struct sKeyword {
+    std::string_view text;
+    eTokenType token_type;
+};
+
+static constexpr sKeyword KEYWORDS[] = {
+    { "func",   TOK_DEF      },
+    { "let",    TOK_VARDECL  },
+    { "type",   TOK_TYPEDECL },
+    { "true",   TOK_TRUE     },
+    { "false",  TOK_FALSE    },
+    { "return", TOK_RETURN   },
+    { "match",  TOK_MATCH    },
+    { "case",   TOK_CASE     },
+    { "where",  TOK_WHERE    },
+    { "forall", TOK_FORALL   },
+    { "import", TOK_IMPORT   },
+
+    // Sentinel for empty table slots, must stay last
+    { "",       TOK_IDENTIFIER },
+};
+
+static constexpr size_t KEYWORD_COUNT = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]) - 1;
+static constexpr uint32_t KEYWORD_TABLE_BITS = 5;
+static constexpr uint32_t KEYWORD_TABLE_SIZE = 1 << KEYWORD_TABLE_BITS;
+
+static_assert(KEYWORD_COUNT < KEYWORD_TABLE_SIZE, "Keyword table too small");
+
+constexpr size_t get_min_keyword_length() {
+    size_t min_length = SIZE_MAX;
+    for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+        if (KEYWORDS[i].text.size() < min_length) { min_length = KEYWORDS[i].text.size(); }
+    }
+    return min_length;
+}
+
+constexpr size_t get_max_keyword_length() {
+    size_t max_length = 0;
+    for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+        if (KEYWORDS[i].text.size() > max_length) { max_length = KEYWORDS[i].text.size(); }
+    }
+    return max_length;
+}
+
+static constexpr size_t KEYWORD_MIN_LENGTH = get_min_keyword_length();
+static constexpr size_t KEYWORD_MAX_LENGTH = get_max_keyword_length();
+
+// keyword_equals compares with two overlapping fixed size loads
+static_assert(KEYWORD_MIN_LENGTH >= 2 && KEYWORD_MAX_LENGTH <= 8, "Keyword length out of range");
+
+// Multiplicative hash of the length and the first, second and last chars
+constexpr uint32_t keyword_hash(std::string_view str, uint32_t seed) {
+    // str[1] or str[0] for single chars, picked without branching
+    uint32_t second = (uint8_t)str[str.size() > 1];
+    uint32_t key = ((uint32_t)(uint8_t)str[0] << 24) | (second << 16) | ((uint32_t)(uint8_t)str[str.size() - 1] << 8) | (uint32_t)str.size();
+    return (key * seed) >> (32 - KEYWORD_TABLE_BITS);
+}
+
+constexpr bool is_perfect_keyword_seed(uint32_t seed) {
+    bool used[KEYWORD_TABLE_SIZE] = {};
+    for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+        uint32_t slot = keyword_hash(KEYWORDS[i].text, seed);
+        if (used[slot]) { return false; }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t find_perfect_keyword_seed() {
+    for (uint32_t seed = 0x9E3779B1; seed < 0x9E3779B1 + (1 << 16); seed += 2) {
+        if (is_perfect_keyword_seed(seed)) { return seed; }
+    }
+    return 0;
+}
+
+static constexpr uint32_t KEYWORD_SEED = find_perfect_keyword_seed();
+static_assert(KEYWORD_SEED != 0, "No perfect hash seed for the keyword set");
+
+struct sKeywordTable {
+    int8_t slots[KEYWORD_TABLE_SIZE];
+};
+
+constexpr sKeywordTable build_keyword_table() {
+    sKeywordTable table = {};
+    for (uint32_t i = 0; i < KEYWORD_TABLE_SIZE; ++i) { table.slots[i] = (int8_t)KEYWORD_COUNT; }
+    for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+        table.slots[keyword_hash(KEYWORDS[i].text, KEYWORD_SEED)] = (int8_t)i;
+    }
+    return table;
+}
+
+static constexpr sKeywordTable KEYWORD_TABLE = build_keyword_table();
+
+// Both strings have the same length, between 2 and 8 chars
+inline bool keyword_equals(const char* lhs, const char* rhs, size_t length) {
+    if (length >= 4) {
+        uint32_t lhs_head, rhs_head, lhs_tail, rhs_tail;
+        memcpy(&lhs_head, lhs, 4); memcpy(&rhs_head, rhs, 4);
+        memcpy(&lhs_tail, lhs + length - 4, 4); memcpy(&rhs_tail, rhs + length - 4, 4);
+        return lhs_head == rhs_head && lhs_tail == rhs_tail;
+    }
+
+    uint16_t lhs_head, rhs_head, lhs_tail, rhs_tail;
+    memcpy(&lhs_head, lhs, 2); memcpy(&rhs_head, rhs, 2);
+    memcpy(&lhs_tail, lhs + length - 2, 2); memcpy(&rhs_tail, rhs + length - 2, 2);
+    return lhs_head == rhs_head && lhs_tail == rhs_tail;
+}
+
+// Empty slots point to a sentinel whose length never matches
+eTokenType classify_identifier(std::string_view identifier) {
+    if (identifier.empty()) { return TOK_IDENTIFIER; }
+
+    const sKeyword& keyword = KEYWORDS[KEYWORD_TABLE.slots[keyword_hash(identifier, KEYWORD_SEED)]];
+    if (keyword.text.size() == identifier.size() && keyword_equals(keyword.text.data(), identifier.data(), identifier.size())) {
+        return keyword.token_type;
+    }
+
+    return TOK_IDENTIFIER;
+}
+
+
+// Single char tokens
+// Token type of every char that forms a token on its own, TOK_UNKNOWN otherwise
+struct sSingleCharTokenTable {
+    eTokenType token_types[256];
+};
+
+constexpr sSingleCharTokenTable build_single_char_token_table() {
+    sSingleCharTokenTable table = {};
+    for (unsigned ch = 0; ch < 256; ++ch) { table.token_types[ch] = TOK_UNKNOWN; }
+
+    table.token_types[(uint8_t)';'] = TOK_SEMICOLON;
+    table.token_types[(uint8_t)'('] = TOK_LEFTPAR;
+    table.token_types[(uint8_t)')'] = TOK_RIGHTPAR;
+    table.token_types[(uint8_t)','] = TOK_COMMA;
+    table.token_types[(uint8_t)'{'] = TOK_LEFTCURBRACE;
+    table.token_types[(uint8_t)'}'] = TOK_RIGHTCURBRACE;
+    table.token_types[(uint8_t)':'] = TOK_COLON;
+    table.token_types[(uint8_t)'='] = TOK_EQUAL;
+
+    for (char op : { '+', '-', '*', '/', '<', '>', '|' }) { table.token_types[(uint8_t)op] = TOK_OP; }
+
+    // consume_char returns EOF past the end of the input
+    table.token_types[(uint8_t)EOF] = TOK_EOF;
+    return table;
+}
+
+static constexpr sSingleCharTokenTable SINGLE_CHAR_TOKENS = build_single_char_token_table();
+
 
 sToken cLexer::get_next_token() {
-    char last_char = ' ';
+    sToken token = this->scan_token();
+
+    // Comment runs are consumed here once, instead of on every parser peek
+    while (token.token_type == TOK_COMMENT && this->m_comment_mode != COMMENTS_KEEP) {
+        if (this->m_comment_mode == COMMENTS_TRIVIA) {
+            this->m_trivia.push_back({ this->m_token_count, token });
+        }
+        token = this->scan_token();
+    }
+
+    ++this->m_token_count;
+    return token;
+}
+
+sToken cLexer::scan_token() {
     sToken final_token;
 
-    final_token.value = "";
     final_token.token_type = TOK_UNKNOWN;
+    final_token.symbol = SYM_NONE;
 
-    std::string identifier_string;
+    const char* data = this->m_input_str.data();
+    size_t size = this->m_input_str.size();
 
-    while (isspace(last_char)) {
-        if (last_char == '\n') { ++this->m_current_line_count; }
-        last_char = this->consume_char();
+    // Most tokens aren't preceded by whitespace, don't call the scanner for those
+    if (this->m_current_pos < size && has_char_class(data[this->m_current_pos], CHAR_SPACE)) {
+        int newline_count;
+        this->m_current_pos = scan_whitespace(data, this->m_current_pos, size, newline_count);
+        this->m_current_line_count += newline_count;
     }
 
+    char last_char = this->consume_char();
+
     final_token.line_number = this->m_current_line_count;
+    // Start of the token, the first char is already consumed
+    final_token.offset = last_char == EOF ? this->m_current_pos : this->m_current_pos - 1;
+    final_token.length = last_char == EOF ? 0 : 1;
 
     if (last_char == '/' && this->peek_char() == '/') {
-        while ((last_char = this->consume_char()) != '\n') {
-            final_token.value += last_char;
-        }
+        final_token.offset = this->m_current_pos;
+        size_t line_end = scan_line_end(data, this->m_current_pos, size);
+
+        final_token.length = line_end - final_token.offset;
+        // Consume the '\n'
+        this->m_current_pos = line_end < size ? line_end + 1 : size;
         ++this->m_current_line_count;
         final_token.token_type = TOK_COMMENT;
         return final_token;
@@ -76,135 +264,58 @@ sToken cLexer::get_next_token() {
     if (last_char == '-' && this->peek_char() == '>') {
         this->consume_char();
         final_token.token_type = TOK_ARROW;
-        final_token.value = "->";
+        final_token.length = 2;
         return final_token;
     }
 
     // Alpha
-    if (isalpha(last_char) || last_char == '_') {
-        identifier_string = last_char;
-        while (isalnum(last_char = this->peek_char()) || last_char == '_') {
-            identifier_string += last_char;
-            this->m_current_pos++;
-        }
-
-        if (identifier_string == "func") {
-            final_token.token_type = TOK_DEF;
-            final_token.value = identifier_string;
-
-            return final_token;
-        } else if (identifier_string == "let") {
-            final_token.token_type = TOK_VARDECL;
-            final_token.value = identifier_string;
-
-            return final_token;
-        } else if (identifier_string == "type") {
-            final_token.token_type = TOK_TYPEDECL;
-            final_token.value = identifier_string;
-
-            return final_token;
-        } else if (identifier_string == "true") {
-            final_token.token_type = TOK_TRUE;
-            final_token.value = identifier_string;
+    if (has_char_class(last_char, CHAR_IDENT_START)) {
+        this->m_current_pos = scan_identifier_tail(data, this->m_current_pos, size);
 
-            return final_token;
-        } else if (identifier_string == "false") {
-            final_token.token_type = TOK_FALSE;
-            final_token.value = identifier_string;
-
-            return final_token;
-        } else if (identifier_string == "return") {
-            final_token.token_type = TOK_RETURN;
-            final_token.value = identifier_string;
-
-            return final_token;
-        } else {
-            final_token.token_type = TOK_IDENTIFIER;
-            final_token.value = identifier_string;
+        final_token.length = this->m_current_pos - final_token.offset;
+        std::string_view identifier_string = this->get_token_value(final_token);
 
-            return final_token;
+        final_token.token_type = classify_identifier(identifier_string);
+        if (final_token.token_type == TOK_IDENTIFIER) {
+            final_token.symbol = this->m_symbol_cache.intern(identifier_string);
         }
+
+        return final_token;
     }
 
     // Number
-    if (isdigit(last_char)) {
-        identifier_string = last_char;
-        while (isdigit(last_char = this->peek_char())) {
-            identifier_string += last_char; 
-            this->m_current_pos++;
-        }
+    if (has_char_class(last_char, CHAR_DIGIT)) {
+        this->m_current_pos = scan_digits(data, this->m_current_pos, size);
 
-        if ((last_char = this->peek_char()) == '.') {
-            identifier_string += ".";
+        if (this->peek_char() == '.') {
             this->m_current_pos++;
         } else {
             final_token.token_type = TOK_INTEGER;
-            final_token.value = identifier_string;
+            final_token.length = this->m_current_pos - final_token.offset;
             return final_token;
         }
 
-        while (isdigit(last_char = this->peek_char())) {
-            identifier_string += last_char; 
-            this->m_current_pos++;
-        }
+        this->m_current_pos = scan_digits(data, this->m_current_pos, size);
 
         final_token.token_type = TOK_FLOAT;
-        final_token.value = identifier_string;
+        final_token.length = this->m_current_pos - final_token.offset;
         return final_token;
     }
 
-    switch (last_char) {
-    case ';': 
-        final_token.token_type = TOK_SEMICOLON;
-        break;
-    case '(':
-        final_token.token_type = TOK_LEFTPAR;
-        break;
-    case ')':
-        final_token.token_type = TOK_RIGHTPAR;
-        break;
-    case ',':
-        final_token.token_type = TOK_COMMA;
-        break;
-    case '{':
-        final_token.token_type = TOK_LEFTCURBRACE;
-        break;
-    case '}':
-        final_token.token_type = TOK_RIGHTCURBRACE;
-        break;
-    case ':':
-        final_token.token_type = TOK_COLON;
-        break;
-    case '=':
-        final_token.token_type = TOK_EQUAL;
-        break;
-    case '+':
-    case '-':
-    case '*':
-    case '/':
-    case '<':
-    case '>':
-    case '|':
-        final_token.token_type = TOK_OP;
-        break;
-    case EOF:
-        final_token.token_type = TOK_EOF;
-        break;
-    default:
-        break;
-    }
-
-    final_token.value = last_char;
+    final_token.token_type = SINGLE_CHAR_TOKENS.token_types[(uint8_t)last_char];
     return final_token;
 }
 
 
+// Reading past the end of the input yields EOF
 char cLexer::consume_char() {
+    if (this->m_current_pos >= this->m_input_str.size()) { return EOF; }
     return this->m_input_str[this->m_current_pos++];
 }
 
 
 char cLexer::peek_char() const {
+    if (this->m_current_pos >= this->m_input_str.size()) { return EOF; }
     return this->m_input_str[this->m_current_pos];
 }
 
@@ -213,7 +324,15 @@ const std::vector<sToken>& cLexer::get_tokens() {
     return this->m_tokens;
 }
 
+std::vector<sToken> cLexer::take_tokens() {
+    return std::move(this->m_tokens);
+}
+
 void cLexer::lex() {
+    // Sources average around 3 bytes or more per token, pages of the
+    // unused tail are never touched
+    this->m_tokens.reserve(this->m_input_str.size() / 3 + 1);
+
     sToken token;
     do {
         token = this->get_next_token();
@@ -222,8 +341,12 @@ void cLexer::lex() {
 }
 
 void cLexer::print_tokens() const {
+    ::print_tokens(this->m_input_str, this->m_tokens);
+}
+
+void print_tokens(std::string_view source, const std::vector<sToken>& tokens) {
     std::cout << "Lexer Tokens" << std::endl;
-    for (auto token : this->m_tokens)
-        std::cout << "Token: " << get_token_type_string(token.token_type) << "; Value: " << token.value << "; Line: " << token.line_number << std::endl;
+    for (const sToken& token : tokens)
+        std::cout << "Token: " << get_token_type_string(token.token_type) << "; Value: " << token.get_value(source) << "; Line: " << token.line_number << std::endl;
 }
 
@@ -0,0 +1,53 @@
+#include "../include/log.h"
+
+
+static const char* LOG_LEVEL_NAMES[] = { "Error", "Warning", "Info", "Debug", "Trace" };
+static const char* LOG_CATEGORY_NAMES[] = { "Driver", "Lexer", "Parser", "Codegen", "Types" };
+
+
+cLogger& cLogger::get() {
+    static cLogger logger;
+    return logger;
+}
+
+cLogger::cLogger() : m_level(LOG_INFO), m_categories((1u << LOG_CATEGORY_COUNT) - 1) {}
+
+std::ostream& cLogger::begin(eLogLevel level, eLogCategory category) {
+    return std::cerr << "::[" << LOG_CATEGORY_NAMES[category] << "]::" << LOG_LEVEL_NAMES[level] << ": ";
+}
+
+// Case insensitive on the first letter only, names are "Error" or "error"
+static bool match_name(std::string_view name, std::string_view expected) {
+    if (name.size() != expected.size() || name.empty()) { return false; }
+    return (name[0] | 0x20) == (expected[0] | 0x20) && name.substr(1) == expected.substr(1);
+}
+
+bool parse_log_level(std::string_view name, eLogLevel& level) {
+    for (int i = LOG_ERROR; i <= LOG_TRACE; ++i) {
+        if (match_name(name, LOG_LEVEL_NAMES[i])) {
+            level = (eLogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_log_categories(std::string_view names, uint32_t& categories) {
+    categories = 0;
+    while (!names.empty()) {
+        size_t comma = names.find(',');
+        std::string_view name = names.substr(0, comma);
+        names = comma == std::string_view::npos ? std::string_view() : names.substr(comma + 1);
+
+        if (name == "all") {
+            categories = (1u << LOG_CATEGORY_COUNT) - 1;
+            continue;
+        }
+
+        int category = 0;
+        while (category < LOG_CATEGORY_COUNT && !match_name(name, LOG_CATEGORY_NAMES[category])) { ++category; }
+        if (category == LOG_CATEGORY_COUNT) { return false; }
+        categories |= 1u << category;
+    }
+    return true;
+}
@@ -1,81 +1,390 @@
+#include "../include/ast_cache.h"
+#include "../include/compilation_unit.h"
+#include "../include/driver.h"
+#include "../include/flat_ast.h"
+#include "../include/incremental.h"
+#include "../include/interface_file.h"
+#include "../include/jit.h"
 #include "../include/lexer.h"
+#include "../include/object_cache.h"
+#include "../include/parallel_codegen.h"
 #include "../include/parser.h"
+#include "../include/profiler.h"
+#include "../include/source_file.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Path.h"
 
 #include <memory>
+#include <vector>
 #include <fcntl.h>
-#include <time.h>
+
+// Looks up the entry point, which compiles it, and calls it
+static int run_entry(cJIT& engine, const std::string& entry, type_id_t return_type, cScopedTimer& compile_timer) {
+    void* address = engine.lookup(entry);
+    if (!address) { return 1; }
+
+    std::cout << "Elapsed time: " << compile_timer.stop() << " ns" << std::endl;
+
+    std::cout << "---------------------------------- Execution ----------------------------------" << std::endl;
+
+    cScopedTimer run_timer("Execution");
+    call_entry(address, return_type);
+    std::cout << "Elapsed time: " << run_timer.stop() << " ns" << std::endl;
+
+    return 0;
+}
+
+// Compiles the module in memory and calls the entry point instead of writing
+// the object file
+static int run_jit(std::shared_ptr<cCodeGenerator> code_generator, const std::string& entry) {
+    llvm::Function* function = code_generator->m_Module->getFunction(entry);
+    if (!function || function->isDeclaration()) {
+        std::cerr << "No entry point " << entry << std::endl;
+        return 1;
+    }
+
+    type_id_t return_type = get_entry_return_type(*function);
+    if (return_type == TYPE_NONE) {
+        std::cerr << "Entry point " << entry << " must take no parameter and return int, float, bool or void" << std::endl;
+        return 1;
+    }
+
+    std::cout << "---------------------------------- JIT compilation ----------------------------------" << std::endl;
+
+    cScopedTimer compile_timer("JIT compilation");
+
+    code_generator->optimize_module();
+
+    std::unique_ptr<cJIT> engine = cJIT::create(*code_generator->m_TargetMachine);
+    if (!engine || !engine->add_module(code_generator)) { return 1; }
+
+    return run_entry(*engine, entry, return_type, compile_timer);
+}
+
+// Generates the IR of each function on its first call, the unit stops after
+// the checks
+static int run_lazy_unit_jit(const cCompilationUnit& unit, const sCompilerOptions& options, const std::string& entry) {
+    const cFlatAST& ast = unit.get_ast();
+    node_index_t function = NODE_NONE;
+    for (node_index_t root : ast.get_roots()) {
+        if (ast.get_kind(root) == NODE_FUNCTION && get_symbol_string(ast.get_payload(root)) == entry) { function = root; }
+    }
+    if (function == NODE_NONE) {
+        std::cerr << "No entry point " << entry << std::endl;
+        return 1;
+    }
+
+    type_id_t return_type = get_entry_return_type(ast, function);
+    if (return_type == TYPE_NONE) {
+        std::cerr << "Entry point " << entry << " must take no parameter and return int, float, bool or void" << std::endl;
+        return 1;
+    }
+
+    std::cout << "---------------------------------- JIT compilation ----------------------------------" << std::endl;
+
+    cScopedTimer compile_timer("JIT compilation");
+
+    // Nothing was lowered, only the target machine and optimizer are used
+    std::shared_ptr<cCodeGenerator> configured = unit.get_code_generator();
+    configured->configure(options);
+
+    std::unique_ptr<cJIT> engine = cJIT::create(*configured->m_TargetMachine);
+    if (!engine || !engine->add_lazy_unit(ast, configured)) { return 1; }
+
+    return run_entry(*engine, entry, return_type, compile_timer);
+}
+
+// Staged compilation of the whole file, see cCompilationUnit. Parallel and
+// incremental codegen and the lazy JIT replace lowering and emission, the JIT
+// replaces emission
+static int run_unit(std::string_view source, const sCompilerOptions& options, eCompilationStage last_stage,
+                    unsigned jobs, const std::string& incremental_directory, const std::string& interface_file_name,
+                    const std::string& ast_cache_file_name, bool jit, bool lazy, const std::string& entry) {
+    cCompilationUnit unit(source, options);
+    unit.set_ast_cache(ast_cache_file_name);
+
+    eCompilationStage unit_last_stage = last_stage;
+    if ((jobs || !incremental_directory.empty() || (jit && lazy)) && last_stage > STAGE_CHECK) { unit_last_stage = STAGE_CHECK; }
+    else if (last_stage > STAGE_LOWER) { unit_last_stage = STAGE_LOWER; }
+
+    if (!unit.run(unit_last_stage, "obj/output.o")) { return 1; }
+    if (!interface_file_name.empty() && unit_last_stage >= STAGE_CHECK) {
+        if (!unit.write_interface(interface_file_name)) { return 1; }
+        std::cout << "Wrote " << interface_file_name << std::endl;
+    }
+    if (DEPLANG_LOG_ENABLED(LOG_DEBUG, LOG_PARSER)) { print_flat(unit.get_ast()); }
+
+    if (unit_last_stage == last_stage) { return 0; }
+
+    if (jit && lazy) { return run_lazy_unit_jit(unit, options, entry); }
+
+    if (jobs) {
+        std::cout << "---------------------------------- Parallel code generation ----------------------------------" << std::endl;
+
+        cScopedTimer timer("Parallel code generation");
+        bool succeeded = codegen_flat_parallel(unit.get_ast(), options, jobs, "obj/output");
+        std::cout << "Elapsed time: " << timer.stop() << " ns" << std::endl;
+
+        return succeeded ? 0 : 1;
+    }
+
+    if (!incremental_directory.empty()) {
+        std::cout << "---------------------------------- Incremental code generation ----------------------------------" << std::endl;
+
+        cScopedTimer timer("Incremental code generation");
+        bool succeeded = codegen_flat_incremental(unit.get_ast(), options, incremental_directory, "obj/output.a");
+        std::cout << "Elapsed time: " << timer.stop() << " ns" << std::endl;
+        if (succeeded) { std::cout << "Wrote obj/output.a" << std::endl; }
+
+        return succeeded ? 0 : 1;
+    }
+
+    if (DEPLANG_LOG_ENABLED(LOG_DEBUG, LOG_CODEGEN)) {
+        std::cout << std::endl;
+
+        std::cout << "Generated code" << std::endl;
+        unit.get_code_generator()->m_Module->print(llvm::errs(), nullptr);
+
+        std::cout << std::endl;
+        std::cout << std::endl;
+    }
+
+    if (jit) { return run_jit(unit.get_code_generator(), entry); }
+
+    if (!unit.run_stage(STAGE_EMIT, "obj/output.o")) { return 1; }
+    std::cout << "Wrote obj/output.o" << std::endl;
+    return 0;
+}
+
+// Writes the trace and prints the time report when main returns, after the
+// compiler objects (and their pass timing reports) are gone
+struct sProfileOutput {
+    std::string trace_file;
+    bool report = false;
+
+    ~sProfileOutput() {
+        if (!this->trace_file.empty() && cProfiler::get().write_trace(this->trace_file)) {
+            std::cout << "Wrote " << this->trace_file << std::endl;
+        }
+        if (this->report) {
+            cProfiler::get().print_summary(std::cout);
+            // Backend passes of the legacy pass manager
+            llvm::reportAndResetTimings();
+        }
+    }
+};
 
 int main (int argc, char *argv[]) {
     // std::string file_path = "./test/expressions_test_other.dp";
     // std::string file_path = "./test/test_errors.dp";
     std::string file_path = "./test/test_type_exprs.dp";
+    std::vector<std::string> file_paths;
+    // Several files or an output directory go through the multi file driver
+    std::string output_directory;
+    bool echo_source = false;
+    bool stream_tokens = false;
+    bool flat_ast = false;
+    bool jit = false;
+    bool lazy = false;
+    std::string entry = "main";
+    // Parallel codegen when not 0, goes through the flat AST
+    unsigned jobs = 0;
+    // Per function fragments when not empty, goes through the flat AST
+    std::string incremental_directory;
+    // Interface of the source in obj, goes through the flat AST
+    bool emit_interface = false;
+    // Tokens and AST of the source cached in obj, goes through the flat AST
+    bool ast_cache = false;
+    // Only the staged pipeline of the flat AST can stop early
+    eCompilationStage last_stage = STAGE_EMIT;
+    sCompilerOptions options;
+    sProfileOutput profile_output;
+    // Object cache directory, empty when the cache is off
+    std::string cache_directory;
+    bool cache_statistics = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--echo-source") { echo_source = true; }
+        else if (arg == "--stream-tokens") { stream_tokens = true; }
+        else if (arg == "--flat-ast") { flat_ast = true; }
+        else if (arg == "--jit") { jit = true; }
+        // The tree path generates the IR while parsing, only the flat AST can defer it
+        else if (arg == "--jit-lazy") { jit = true; lazy = true; flat_ast = true; }
+        else if (arg.rfind("--output-dir=", 0) == 0) { output_directory = arg.substr(13); }
+        else if (arg.rfind("--entry=", 0) == 0) { entry = arg.substr(8); }
+        else if (arg.rfind("--jobs=", 0) == 0) {
+            if (llvm::StringRef(arg).substr(7).getAsInteger(10, jobs) || jobs < 1) {
+                std::cerr << "Expected a number of jobs of at least 1, got " << arg.substr(7) << std::endl;
+                return 1;
+            }
+            flat_ast = true;
+        }
+        else if (arg == "--incremental") { incremental_directory = "obj/incremental"; flat_ast = true; }
+        else if (arg.rfind("--incremental-dir=", 0) == 0) { incremental_directory = arg.substr(18); flat_ast = true; }
+        else if (arg == "--emit-interface") { emit_interface = true; flat_ast = true; }
+        else if (arg == "--ast-cache") { ast_cache = true; flat_ast = true; }
+        else if (arg.rfind("-I", 0) == 0 && arg.size() > 2) { options.import_paths.push_back(arg.substr(2)); }
+        else if (arg == "--parse-only") { last_stage = STAGE_PARSE; flat_ast = true; }
+        else if (arg == "--check-only") { last_stage = STAGE_CHECK; flat_ast = true; }
+        else if (arg == "-ftime-trace") { profile_output.trace_file = "obj/output.json"; }
+        else if (arg.rfind("-ftime-trace=", 0) == 0) { profile_output.trace_file = arg.substr(13); }
+        else if (arg == "-ftime-report") { profile_output.report = true; }
+        else if (arg == "--cache") { cache_directory = "obj/cache"; }
+        else if (arg.rfind("--cache-dir=", 0) == 0) { cache_directory = arg.substr(12); }
+        else if (arg == "--cache-stats") { cache_statistics = true; }
+        else if (arg.rfind("--log-level=", 0) == 0) {
+            eLogLevel level;
+            if (!parse_log_level(std::string_view(arg).substr(12), level)) {
+                std::cerr << "Unknown log level " << arg.substr(12) << std::endl;
+                return 1;
+            }
+            if (level > DEPLANG_LOG_MAX_LEVEL) { std::cerr << "Log level " << arg.substr(12) << " is not compiled in, see make debug" << std::endl; }
+            cLogger::get().set_level(level);
+        }
+        else if (arg.rfind("--log=", 0) == 0) {
+            uint32_t categories;
+            if (!parse_log_categories(std::string_view(arg).substr(6), categories)) {
+                std::cerr << "Unknown log category in " << arg.substr(6) << std::endl;
+                return 1;
+            }
+            cLogger::get().set_categories(categories);
+        }
+        else if (parse_opt_level(arg, options.opt_level)) {}
+        else if (parse_target_option(arg, options)) {}
+        else { file_paths.push_back(arg); }
+    }
+    if (file_paths.size() == 1) { file_path = file_paths.front(); }
 
-    struct timespec start, end;
+    // Before any code generator exists, the optimizers check them on creation
+    if (!profile_output.trace_file.empty() || profile_output.report) { cProfiler::get().enable(); }
+    if (profile_output.report) { llvm::TimePassesIsEnabled = true; }
+
+    // --jobs is the number of files compiled at once
+    if (file_paths.size() > 1 || !output_directory.empty()) {
+        if (jit || !incremental_directory.empty() || last_stage != STAGE_EMIT) {
+            std::cerr << "The JIT, incremental and early stop modes take a single file" << std::endl;
+            return 1;
+        }
+        if (file_paths.empty()) { file_paths.push_back(file_path); }
+        if (output_directory.empty()) { output_directory = "obj"; }
+
+        std::cout << "---------------------------------- Compiling " << file_paths.size() << " files ----------------------------------" << std::endl;
+        return compile_files(file_paths, options, output_directory, jobs) ? 0 : 1;
+    }
+
+    // Interfaces written with --emit-interface
+    options.import_paths.push_back("obj");
 
     std::cout << "-------------------------- Reading source file ----------------------------------" << std::endl;
 
-    clock_gettime(CLOCK_REALTIME, &start);
+    cScopedTimer read_timer("Reading source file");
 
-    FILE* input_file = fopen(file_path.c_str(), "r");
-    if (!input_file) {
-        std::cerr << "Error opening file!" << std::endl;
-        return 1;
+    std::unique_ptr<cSourceFile> source_file = cSourceFile::open(file_path);
+    if (!source_file) { return 1; }
+
+    double t_ns = read_timer.stop();
+
+    if (echo_source) {
+        std::cout.write(source_file->get_content().data(), source_file->get_size());
+        std::cout << std::endl;
     }
 
-    char ch;
-    std::string content = "";
-    while ((ch = fgetc(input_file)) != EOF) {
-        putchar(ch);
-        content += ch;
+    std::cout << "Elapsed time: " << t_ns << " ns" << std::endl;
+
+    std::string interface_file_name, ast_cache_file_name;
+    if (emit_interface) {
+        llvm::SmallString<256> path("obj");
+        llvm::sys::path::append(path, llvm::sys::path::stem(file_path) + INTERFACE_FILE_EXTENSION);
+        interface_file_name = std::string(path);
+    }
+    if (ast_cache) {
+        llvm::SmallString<256> path("obj");
+        llvm::sys::path::append(path, llvm::sys::path::stem(file_path) + AST_CACHE_FILE_EXTENSION);
+        ast_cache_file_name = std::string(path);
     }
 
-    fclose(input_file);
-    content += EOF;
+    // Only a single object file is cached, with the other outputs of the file
+    std::vector<std::string> cached_files = {"obj/output.o"};
+    if (!interface_file_name.empty()) { cached_files.push_back(interface_file_name); }
+    if (!ast_cache_file_name.empty()) { cached_files.push_back(ast_cache_file_name); }
 
-    clock_gettime(CLOCK_REALTIME, &end);
+    std::unique_ptr<cObjectCache> cache;
+    std::string cache_key;
+    if (!cache_directory.empty() && !jit && !jobs && incremental_directory.empty() && last_stage == STAGE_EMIT) {
+        std::cout << "---------------------------------- Object cache ----------------------------------" << std::endl;
 
-    double t_ns = (double)(end.tv_sec - start.tv_sec) * 1.0e9 +
-              (double)(end.tv_nsec - start.tv_nsec);
+        cScopedTimer timer("Object cache lookup");
+        cache = std::make_unique<cObjectCache>(cache_directory);
+        // The object also depends on the interfaces it imports
+        std::vector<std::string> interface_files;
+        for (const std::string& module : find_imports(source_file->get_content())) {
+            interface_files.push_back(find_interface_file(module, options.import_paths));
+        }
+        // Both frontends build the same language, but not the same module
+        cache_key = cache->compute_key(source_file->get_content(), options, interface_files, flat_ast ? "flat" : "tree");
+        bool hit = cache->fetch(cache_key, cached_files);
 
-    std::cout << "Elapsed time: " << t_ns << " ns" << std::endl;
-    std::cout << "---------------------------------- Lexical analysis ----------------------------------" << std::endl;
+        std::cout << (hit ? "Cache hit " : "Cache miss ") << cache_key << std::endl;
+        std::cout << "Elapsed time: " << timer.stop() << " ns" << std::endl;
+        if (cache_statistics) { cache->print_statistics(std::cout); }
 
-    clock_gettime(CLOCK_REALTIME, &start);
+        if (hit) { return 0; }
+    } else if (cache_statistics && !cache_directory.empty()) {
+        cObjectCache(cache_directory).print_statistics(std::cout);
+    }
 
-    std::unique_ptr<cLexer> lexer = std::make_unique<cLexer>(content);
-    lexer->lex();
-    clock_gettime(CLOCK_REALTIME, &end);
+    if (flat_ast) {
+        int result = run_unit(source_file->get_content(), options, last_stage, jobs, incremental_directory, interface_file_name, ast_cache_file_name, jit, lazy, entry);
+        if (result == 0 && cache) { cache->store(cache_key, cached_files); }
+        return result;
+    }
 
-    t_ns = (double)(end.tv_sec - start.tv_sec) * 1.0e9 +
-              (double)(end.tv_nsec - start.tv_nsec);
+    std::unique_ptr<cLexer> lexer = std::make_unique<cLexer>(source_file->get_content());
 
-    std::cout << "Elapsed time: " << t_ns << " ns" << std::endl;
+    // When streaming, lexing happens on demand during the syntactic analysis
+    if (!stream_tokens) {
+        std::cout << "---------------------------------- Lexical analysis ----------------------------------" << std::endl;
 
-    lexer->print_tokens();
-    std::cout << "---------------------------------- Syntactic analysis ----------------------------------" << std::endl;
+        cScopedTimer timer("Lexical analysis");
+        lexer->lex();
+        std::cout << "Elapsed time: " << timer.stop() << " ns" << std::endl;
 
-    clock_gettime(CLOCK_REALTIME, &start);
-    std::unique_ptr<cParser> parser = std::make_unique<cParser>(lexer->get_tokens());
+        if (DEPLANG_LOG_ENABLED(LOG_DEBUG, LOG_LEXER)) { lexer->print_tokens(); }
+    }
 
-    parser->parse();
+    std::cout << "---------------------------------- Syntactic analysis ----------------------------------" << std::endl;
 
-    clock_gettime(CLOCK_REALTIME, &end);
+    // Codegen runs at the end of parse on this path
+    cScopedTimer parse_timer("Syntactic analysis");
+    std::unique_ptr<cParser> parser = stream_tokens
+        ? std::make_unique<cParser>(lexer.get())
+        : std::make_unique<cParser>(source_file->get_content(), lexer->take_tokens());
+    parser->m_code_generator->configure(options);
 
-    t_ns = (double)(end.tv_sec - start.tv_sec) * 1.0e9 +
-              (double)(end.tv_nsec - start.tv_nsec);
+    bool parsed = parser->parse();
 
-    std::cout << "Elapsed time: " << t_ns << " ns" << std::endl;
+    std::cout << "Elapsed time: " << parse_timer.stop() << " ns" << std::endl;
+    // Nothing is emitted, so nothing partial gets cached
+    if (!parsed) { return 1; }
 
-    std::cout << std::endl;
+    if (DEPLANG_LOG_ENABLED(LOG_DEBUG, LOG_CODEGEN)) {
+        std::cout << std::endl;
 
-    std::cout << "Generated code" << std::endl;
-    parser->m_code_generator->m_Module->print(llvm::errs(), nullptr);
+        std::cout << "Generated code" << std::endl;
+        parser->m_code_generator->m_Module->print(llvm::errs(), nullptr);
+
+        std::cout << std::endl;
+        std::cout << std::endl;
+    }
 
-    std::cout << std::endl;
-    std::cout << std::endl;
+    if (jit) { return run_jit(parser->m_code_generator, entry); }
 
     // parser->m_code_generator->delete_named_values();
+    // Exits on failure
     parser->emit_object_code("obj/output.o");
+    if (cache) { cache->store(cache_key, cached_files); }
 
     return 0;
 }
@@ -0,0 +1,185 @@
+#include "../include/object_cache.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+
+// Bumped when the layout of the key changes
+static const char* OBJECT_CACHE_FORMAT = "deplang-object-cache-2";
+// LLVM is a shared library, it is not part of the build id
+static const char* COMPILER_VERSION = DEPLANG_COMPILER_VERSION " llvm " LLVM_VERSION_STRING;
+
+// Native endian counters, updated in place under an flock
+static const char* STATISTICS_FILE = "statistics";
+enum eStatisticsCounter {
+    STATISTICS_HITS,
+    STATISTICS_MISSES,
+
+    STATISTICS_COUNTER_COUNT,
+};
+
+
+cObjectCache::cObjectCache(const std::string& directory) : m_directory(directory) {}
+
+std::string cObjectCache::compute_key(std::string_view source, const sCompilerOptions& options, const std::vector<std::string>& dependencies, std::string_view pipeline) const {
+    llvm::SHA256 hash;
+    // Fields are separated so "ab" + "c" and "a" + "bc" differ
+    auto add = [&hash](llvm::StringRef field) {
+        hash.update(field);
+        hash.update(llvm::StringRef("\0", 1));
+    };
+
+    add(OBJECT_CACHE_FORMAT);
+    // Every build of the compiler gets its own entries
+    add(COMPILER_VERSION);
+    add(llvm::utohexstr(get_compiler_build_id()));
+    add(llvm::sys::getDefaultTargetTriple());
+
+    // Native code depends on the machine that compiled it
+    if (options.cpu == "native") {
+        add(llvm::sys::getHostCPUName());
+
+        llvm::StringMap<bool> host_features;
+        if (llvm::sys::getHostCPUFeatures(host_features)) {
+            std::vector<std::string> features;
+            for (auto& feature : host_features) { features.push_back((feature.second ? "+" : "-") + feature.first().str()); }
+            std::sort(features.begin(), features.end());
+            add(llvm::join(features, ","));
+        }
+    } else {
+        add(options.cpu);
+    }
+    add(options.features);
+    add(std::to_string(options.opt_level));
+    add(std::to_string(options.reloc_model));
+    add(llvm::StringRef(pipeline.data(), pipeline.size()));
+
+    for (const std::string& dependency : dependencies) {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> content = llvm::MemoryBuffer::getFile(dependency);
+        add(dependency);
+        add(content ? (*content)->getBuffer() : llvm::StringRef("<missing>"));
+    }
+
+    hash.update(llvm::StringRef(source.data(), source.size()));
+    return llvm::toHex(hash.final(), true);
+}
+
+std::string cObjectCache::get_entry_path(const std::string& key, std::string_view extension) const {
+    // Two level layout keeps directories small
+    llvm::SmallString<256> path(this->m_directory);
+    llvm::sys::path::append(path, key.substr(0, 2), key.substr(2) + std::string(extension));
+    return std::string(path);
+}
+
+bool cObjectCache::fetch(const std::string& key, const std::vector<std::string>& file_names) {
+    bool hit = true;
+    for (const std::string& file_name : file_names) {
+        std::string entry = this->get_entry_path(key, llvm::sys::path::extension(file_name));
+        if (!llvm::sys::fs::exists(entry) || llvm::sys::fs::copy_file(entry, file_name)) {
+            hit = false;
+            break;
+        }
+    }
+
+    this->record_lookup(hit);
+    return hit;
+}
+
+bool cObjectCache::store(const std::string& key, const std::vector<std::string>& file_names) {
+    for (const std::string& file_name : file_names) {
+        llvm::StringRef extension = llvm::sys::path::extension(file_name);
+        std::string temporary = this->create_temporary(key, extension);
+        if (temporary.empty()) { return false; }
+
+        if (llvm::sys::fs::copy_file(file_name, temporary)) {
+            llvm::sys::fs::remove(temporary);
+            std::cerr << "Could not store " << file_name << " in the cache" << std::endl;
+            return false;
+        }
+        if (!this->insert(key, temporary, extension)) { return false; }
+    }
+    return true;
+}
+
+std::string cObjectCache::create_temporary(const std::string& key, std::string_view extension) {
+    std::string entry = this->get_entry_path(key, extension);
+    if (std::error_code error = llvm::sys::fs::create_directories(llvm::sys::path::parent_path(entry))) {
+        std::cerr << "Could not create the cache directory: " << error.message() << std::endl;
+        return {};
+    }
+
+    llvm::SmallString<256> temporary;
+    int fd;
+    if (llvm::sys::fs::createUniqueFile(entry + ".tmp%%%%%%", fd, temporary)) {
+        std::cerr << "Could not create a cache entry in " << this->m_directory << std::endl;
+        return {};
+    }
+    ::close(fd);
+    return std::string(temporary);
+}
+
+bool cObjectCache::insert(const std::string& key, const std::string& temporary_file_name, std::string_view extension) {
+    // Readers never see a partial file
+    if (llvm::sys::fs::rename(temporary_file_name, this->get_entry_path(key, extension))) {
+        llvm::sys::fs::remove(temporary_file_name);
+        std::cerr << "Could not move " << temporary_file_name << " in the cache" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Missing or truncated files count as zero
+static void read_counters(int fd, uint64_t (&counters)[STATISTICS_COUNTER_COUNT]) {
+    if (::pread(fd, counters, sizeof(counters), 0) != sizeof(counters)) {
+        std::fill(std::begin(counters), std::end(counters), 0);
+    }
+}
+
+void cObjectCache::record_lookup(bool hit) {
+    if (llvm::sys::fs::create_directories(this->m_directory)) { return; }
+
+    std::string path = this->m_directory + "/" + STATISTICS_FILE;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) { return; }
+
+    // Released by close
+    ::flock(fd, LOCK_EX);
+    uint64_t counters[STATISTICS_COUNTER_COUNT];
+    read_counters(fd, counters);
+    ++counters[hit ? STATISTICS_HITS : STATISTICS_MISSES];
+    if (::pwrite(fd, counters, sizeof(counters), 0) != sizeof(counters)) { std::cerr << "Could not update the cache statistics" << std::endl; }
+    ::close(fd);
+}
+
+void cObjectCache::print_statistics(std::ostream& out) const {
+    uint64_t counters[STATISTICS_COUNTER_COUNT] = {};
+
+    std::string path = this->m_directory + "/" + STATISTICS_FILE;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::flock(fd, LOCK_SH);
+        read_counters(fd, counters);
+        ::close(fd);
+    }
+    uint64_t hits = counters[STATISTICS_HITS], misses = counters[STATISTICS_MISSES];
+
+    uint64_t lookups = hits + misses;
+    out << "Object cache " << this->m_directory << ": " << hits << " hits, " << misses << " misses";
+    if (lookups) { out << " (" << (100.0 * hits / lookups) << "% hit rate)"; }
+    out << std::endl;
+}
@@ -0,0 +1,63 @@
+#include "../include/optimizer.h"
+#include "../include/profiler.h"
+
+
+static llvm::OptimizationLevel get_llvm_opt_level(eOptLevel opt_level) {
+    switch (opt_level) {
+    case OPT_O1: return llvm::OptimizationLevel::O1;
+    case OPT_O2: return llvm::OptimizationLevel::O2;
+    case OPT_O3: return llvm::OptimizationLevel::O3;
+    case OPT_OS: return llvm::OptimizationLevel::Os;
+    default:     return llvm::OptimizationLevel::O0;
+    }
+}
+
+cOptimizer::cOptimizer(eOptLevel opt_level, llvm::TargetMachine* target_machine) :
+    m_opt_level(opt_level), m_pass_builder(target_machine, llvm::PipelineTuningOptions(), llvm::None, &m_instrumentation) {
+
+    if (llvm::TimePassesIsEnabled) {
+        this->m_time_passes = std::make_unique<llvm::TimePassesHandler>(true);
+        this->m_time_passes->registerCallbacks(this->m_instrumentation);
+    }
+
+    if (cProfiler::get().is_enabled()) {
+        this->m_instrumentation.registerBeforeNonSkippedPassCallback([](llvm::StringRef pass, llvm::Any) {
+            cProfiler::get().begin(std::string_view(pass.data(), pass.size()), {}, "pass");
+        });
+        this->m_instrumentation.registerAfterPassCallback([](llvm::StringRef, llvm::Any, const llvm::PreservedAnalyses&) { cProfiler::get().end(); });
+        this->m_instrumentation.registerAfterPassInvalidatedCallback([](llvm::StringRef, const llvm::PreservedAnalyses&) { cProfiler::get().end(); });
+    }
+
+    this->m_pass_builder.registerModuleAnalyses(this->m_module_analyses);
+    this->m_pass_builder.registerCGSCCAnalyses(this->m_cgscc_analyses);
+    this->m_pass_builder.registerFunctionAnalyses(this->m_function_analyses);
+    this->m_pass_builder.registerLoopAnalyses(this->m_loop_analyses);
+    this->m_pass_builder.crossRegisterProxies(this->m_loop_analyses, this->m_function_analyses, this->m_cgscc_analyses, this->m_module_analyses);
+
+    llvm::OptimizationLevel level = get_llvm_opt_level(opt_level);
+    if (level == llvm::OptimizationLevel::O0) {
+        // Only the always-inliner and the like, no per function simplification
+        this->m_module_passes = this->m_pass_builder.buildO0DefaultPipeline(level);
+        return;
+    }
+
+    // SROA in there is our mem2reg, tuples built by ',' are allocas until then
+    this->m_function_passes = this->m_pass_builder.buildFunctionSimplificationPipeline(level, llvm::ThinOrFullLTOPhase::None);
+    this->m_module_passes = this->m_pass_builder.buildPerModuleDefaultPipeline(level);
+}
+
+void cOptimizer::optimize_function(llvm::Function& function) {
+    if (this->m_opt_level == OPT_O0 || function.isDeclaration()) { return; }
+
+    cScopedTimer timer("Optimize function", function.getName());
+    this->m_function_passes.run(function, this->m_function_analyses);
+    // The module pipeline recomputes what it needs, don't keep results of
+    // a function the next stages may still change outside the pass manager
+    this->m_function_analyses.clear(function, function.getName());
+}
+
+void cOptimizer::optimize_module(llvm::Module& module) {
+    cScopedTimer timer("Optimize module");
+    this->m_module_passes.run(module, this->m_module_analyses);
+    this->m_module_analyses.clear();
+}
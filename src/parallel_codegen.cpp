@@ -0,0 +1,67 @@
+#include "../include/parallel_codegen.h"
+
+#include <atomic>
+#include <iostream>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+
+static std::string get_chunk_file_name(const std::string& output_prefix, unsigned chunk) {
+    return output_prefix + "." + std::to_string(chunk) + ".o";
+}
+
+// Declares the whole unit in a new module, only the functions in
+// [chunk_begin, chunk_end) are defined
+static bool codegen_flat_chunk(const cFlatAST& ast, const sCompilerOptions& options, const std::vector<node_index_t>& functions,
+                               size_t chunk_begin, size_t chunk_end, const std::string& object_file_name) {
+    cScopedTimer timer("Codegen chunk", object_file_name);
+    std::shared_ptr<cCodeGenerator> code_generator = std::make_shared<cCodeGenerator>();
+    code_generator->configure(options);
+
+    if (!codegen_flat_declarations(ast, code_generator)) { return false; }
+
+    for (size_t i = chunk_begin; i < chunk_end; ++i) {
+        if (!codegen_flat_function(ast, functions[i], code_generator)) { return false; }
+    }
+
+    return code_generator->emit_object_code(object_file_name);
+}
+
+bool codegen_flat_parallel(const cFlatAST& ast, const sCompilerOptions& options, unsigned jobs, const std::string& output_prefix) {
+    // Type declarations and imports are declared by every chunk, only the
+    // functions are split
+    std::vector<node_index_t> functions;
+    for (node_index_t root : ast.get_roots()) {
+        if (ast.get_kind(root) == NODE_FUNCTION) { functions.push_back(root); }
+    }
+
+    if (jobs == 0) { jobs = llvm::hardware_concurrency().compute_thread_count(); }
+    if (jobs > functions.size()) { jobs = functions.size() ? functions.size() : 1; }
+
+    std::atomic<bool> succeeded(true);
+    llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+
+    // The first chunks take one more function when it doesn't divide
+    size_t chunk_size = functions.size() / jobs, remainder = functions.size() % jobs;
+    size_t chunk_begin = 0;
+    for (unsigned chunk = 0; chunk < jobs; ++chunk) {
+        size_t chunk_end = chunk_begin + chunk_size + (chunk < remainder ? 1 : 0);
+        std::string object_file_name = get_chunk_file_name(output_prefix, chunk);
+
+        pool.async([&ast, &options, &functions, &succeeded, chunk_begin, chunk_end, object_file_name]() {
+            if (!codegen_flat_chunk(ast, options, functions, chunk_begin, chunk_end, object_file_name)) { succeeded = false; }
+        });
+        chunk_begin = chunk_end;
+    }
+
+    pool.wait();
+    for (unsigned chunk = 0; succeeded && chunk < jobs; ++chunk) { std::cout << "Wrote " << get_chunk_file_name(output_prefix, chunk) << std::endl; }
+
+    // Chunks of an earlier run with more jobs would be linked in too
+    for (unsigned chunk = jobs; llvm::sys::fs::exists(get_chunk_file_name(output_prefix, chunk)); ++chunk) {
+        llvm::sys::fs::remove(get_chunk_file_name(output_prefix, chunk));
+    }
+    return succeeded;
+}
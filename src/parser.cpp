@@ -1,4 +1,5 @@
 #include "../include/parser.h"
+#include "../include/flat_ast.h"
 #include <llvm-14/llvm/BinaryFormat/Dwarf.h>
 #include <llvm-14/llvm/Support/raw_ostream.h>
 #include <string>
@@ -22,103 +23,314 @@ cCodeGenerator::cCodeGenerator() {
     this->m_Module = std::make_unique<llvm::Module>("DepLangModule", *m_Context);
 
     this->m_Builder = std::make_unique<llvm::IRBuilder<>>(*m_Context);
+
+    // Must match eBuiltinType
+    this->m_LoweredTypes = {
+        llvm::Type::getInt32Ty(*m_Context),
+        llvm::Type::getFloatTy(*m_Context),
+        llvm::Type::getInt1Ty(*m_Context),
+        llvm::Type::getVoidTy(*m_Context),
+    };
 }
 
 void cCodeGenerator::delete_named_values() { this->m_NamedValues.clear(); }
 
-llvm::Type* get_llvm_type(const std::string& type, std::shared_ptr<cCodeGenerator> code_generator) {
-    // @TODO: Add primitive types to NamedTypes
+void cCodeGenerator::configure(const sCompilerOptions& options) {
+    this->m_options = options;
+
+    // Initialize the target registry etc., once for all the code generators
+    static std::once_flag targets_initialized;
+    std::call_once(targets_initialized, []() {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmParsers();
+        llvm::InitializeAllAsmPrinters();
+    });
+
+    auto TargetTriple = llvm::sys::getDefaultTargetTriple();
+    this->m_Module->setTargetTriple(TargetTriple);
+
+    std::string Error;
+    auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
+
+    // Print an error and exit if we couldn't find the requested target.
+    // This generally occurs if we've forgotten to initialise the
+    // TargetRegistry or we have a bogus target triple.
+    if (!Target) {
+        llvm::errs() << Error;
+        exit(1);
+    }
+
+    std::string CPU = options.cpu;
+    llvm::SubtargetFeatures Features;
+
+    if (CPU == "native") {
+        CPU = llvm::sys::getHostCPUName().str();
+
+        llvm::StringMap<bool> HostFeatures;
+        if (llvm::sys::getHostCPUFeatures(HostFeatures)) {
+            for (auto& feature : HostFeatures) { Features.AddFeature(feature.first(), feature.second); }
+        }
+    }
+
+    // Explicit -mattr entries come last so they override the host features
+    llvm::SubtargetFeatures ExtraFeatures(options.features);
+    for (const std::string& feature : ExtraFeatures.getFeatures()) { Features.AddFeature(feature); }
+
+    std::unique_ptr<llvm::MCSubtargetInfo> SubtargetInfo(Target->createMCSubtargetInfo(TargetTriple, CPU, ""));
+    if (!SubtargetInfo->isCPUStringValid(CPU)) {
+        llvm::errs() << "Unknown cpu " << CPU << " for target " << TargetTriple << "\n";
+        exit(1);
+    }
+
+    llvm::Reloc::Model RelocModel = llvm::Reloc::PIC_;
+    switch (options.reloc_model) {
+        case RELOC_STATIC: RelocModel = llvm::Reloc::Static; break;
+        case RELOC_PIC: RelocModel = llvm::Reloc::PIC_; break;
+        case RELOC_DYNAMIC_NO_PIC: RelocModel = llvm::Reloc::DynamicNoPIC; break;
+    }
+
+    llvm::CodeGenOpt::Level CodeGenLevel = llvm::CodeGenOpt::None;
+    switch (options.opt_level) {
+        case OPT_O0: CodeGenLevel = llvm::CodeGenOpt::None; break;
+        case OPT_O1: CodeGenLevel = llvm::CodeGenOpt::Less; break;
+        case OPT_O2: CodeGenLevel = llvm::CodeGenOpt::Default; break;
+        case OPT_O3: CodeGenLevel = llvm::CodeGenOpt::Aggressive; break;
+        case OPT_OS: CodeGenLevel = llvm::CodeGenOpt::Default; break;
+    }
+
+    llvm::TargetOptions opt;
+    this->m_TargetMachine.reset(Target->createTargetMachine(TargetTriple, CPU, Features.getString(), opt, RelocModel, llvm::None, CodeGenLevel));
+    this->m_Module->setDataLayout(this->m_TargetMachine->createDataLayout());
+
+    this->m_optimizer = std::make_shared<cOptimizer>(options.opt_level, this->m_TargetMachine.get());
+}
+
+void cCodeGenerator::configure(const cCodeGenerator& configured) {
+    this->m_options = configured.m_options;
+    this->m_TargetMachine = configured.m_TargetMachine;
+    this->m_optimizer = configured.m_optimizer;
+
+    this->m_Module->setTargetTriple(this->m_TargetMachine->getTargetTriple().str());
+    this->m_Module->setDataLayout(this->m_TargetMachine->createDataLayout());
+}
+
+void cCodeGenerator::optimize_function(llvm::Function& function) {
+    if (!this->m_optimizer) { return; }
 
-    if (type == "int") { return llvm::Type::getInt32Ty(*code_generator->m_Context);}
-    else if (type == "float") { return llvm::Type::getFloatTy(*code_generator->m_Context); }
-    else if (type == "bool") { return llvm::Type::getInt1Ty(*code_generator->m_Context); }
-    else if (type == "void") { return llvm::Type::getVoidTy(*code_generator->m_Context); }
-    else { return code_generator->m_NamedTypes[type]; }
+    // Passes assume valid IR
+    if (llvm::verifyFunction(function)) {
+        DEPLANG_PARSER_ERROR("Function " << std::string(function.getName()) << " is invalid, not optimized");
+        return;
+    }
+    this->m_optimizer->optimize_function(function);
+}
+
+void cCodeGenerator::optimize_module() {
+    if (!this->m_optimizer) { return; }
+
+    if (llvm::verifyModule(*this->m_Module, &llvm::errs())) {
+        DEPLANG_PARSER_ERROR("Module is invalid, not optimized");
+        return;
+    }
+    this->m_optimizer->optimize_module(*this->m_Module);
+}
+
+bool cCodeGenerator::emit_object_code(const std::string& object_file_name) {
+    if (!this->m_TargetMachine) { this->configure(sCompilerOptions()); }
+
+    this->optimize_module();
+
+    std::error_code EC;
+    llvm::raw_fd_ostream dest(object_file_name, EC, llvm::sys::fs::OF_None);
+
+    if (EC) {
+        llvm::errs() << "Could not open file: " << EC.message();
+        return false;
+    }
+
+    cScopedTimer timer("Emit object", object_file_name);
+    llvm::legacy::PassManager pass;
+    auto FileType = llvm::CodeGenFileType::CGFT_ObjectFile;
+
+    if (this->m_TargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
+        llvm::errs() << "TheTargetMachine can't emit a file of this type";
+        return false;
+    }
+
+    pass.run(*this->m_Module);
+    dest.flush();
+
+    // Callers report the files they keep, this one may be a temporary file
+    DEPLANG_LOG(LOG_DEBUG, LOG_CODEGEN, "Wrote " << object_file_name);
+    return true;
 }
 
-sTypedValue* build_ir_operation(sTypedValue* l, sTypedValue* r, std::string op, std::shared_ptr<cCodeGenerator> code_generator) {
-    if (!l || !r || !l->value || !r->value) { 
+void cCodeGenerator::define_named_type(symbol_t name, llvm::Type* type) {
+    type_id_t type_id = cTypeTable::get().get_named(name);
+    if (type_id >= this->m_LoweredTypes.size()) { this->m_LoweredTypes.resize(type_id + 1, nullptr); }
+    this->m_LoweredTypes[type_id] = type;
+}
+
+llvm::Type* get_llvm_type(symbol_t type, std::shared_ptr<cCodeGenerator> code_generator) {
+    switch (type) {
+    case SYM_INT:   return code_generator->m_LoweredTypes[TYPE_INT];
+    case SYM_FLOAT: return code_generator->m_LoweredTypes[TYPE_FLOAT];
+    case SYM_BOOL:  return code_generator->m_LoweredTypes[TYPE_BOOL];
+    case SYM_VOID:  return code_generator->m_LoweredTypes[TYPE_VOID];
+    default: break;
+    }
+
+    std::vector<type_id_t>& named_type_ids = code_generator->m_NamedTypeIds;
+    if (type >= named_type_ids.size()) { named_type_ids.resize(type + 1, TYPE_NONE); }
+    if (named_type_ids[type] == TYPE_NONE) { named_type_ids[type] = cTypeTable::get().get_named(type); }
+
+    return lower_type(named_type_ids[type], code_generator);
+}
+
+llvm::Type* lower_type(type_id_t type, std::shared_ptr<cCodeGenerator> code_generator) {
+    if (type == TYPE_NONE) { return nullptr; }
+
+    std::vector<llvm::Type*>& lowered_types = code_generator->m_LoweredTypes;
+    if (type < lowered_types.size() && lowered_types[type]) { return lowered_types[type]; }
+
+    sDepType dep_type = cTypeTable::get().get_type(type);
+    llvm::Type* lowered = nullptr;
+
+    switch (dep_type.kind) {
+    // Primitives are seeded and declared types are set by define_named_type
+    case TYPE_PRIMITIVE:
+    case TYPE_NAMED:
+        DEPLANG_PARSER_ERROR("Unknown type " << get_symbol_string(dep_type.name));
+        return nullptr;
+
+    // @TODO: For now sums and functions are lowered like products
+    case TYPE_PRODUCT:
+    case TYPE_SUM:
+    case TYPE_FUNCTION: {
+        llvm::Type* frst_type = lower_type(dep_type.lhs, code_generator);
+        llvm::Type* scnd_type = lower_type(dep_type.rhs, code_generator);
+        if (!frst_type || !scnd_type) { return nullptr; }
+
+        std::vector<llvm::Type*> types = { frst_type, scnd_type };
+        lowered = llvm::StructType::get(*code_generator->m_Context, types);
+        break;
+    }
+
+    // @TODO: Lower dependent types
+    case TYPE_DEPENDENT:
+        return nullptr;
+    }
+
+    if (type >= lowered_types.size()) { lowered_types.resize(type + 1, nullptr); }
+    lowered_types[type] = lowered;
+    return lowered;
+}
+
+sTypedValue build_ir_operation(sTypedValue l, sTypedValue r, std::string_view op, std::shared_ptr<cCodeGenerator> code_generator) {
+    if (!l || !r) { 
         DEPLANG_PARSER_ERROR("Empty operands");
-        return nullptr; 
+        return {}; 
     }
 
     // @TODO: Change for type coersion
-    r->value->print(llvm::errs());
-    std::cout << std::endl;
-    l->value->print(llvm::errs());
-    std::cout << std::endl;
+    if (DEPLANG_LOG_ENABLED(LOG_TRACE, LOG_CODEGEN)) {
+        r.value->print(llvm::errs());
+        std::cout << std::endl;
+        l.value->print(llvm::errs());
+        std::cout << std::endl;
+    }
 
-    if (!l->type || !r->type) { 
+    if (!l.type || !r.type) { 
         DEPLANG_PARSER_ERROR("Binary operation on different types");
-        return nullptr;
+        return {};
     }
 
     llvm::Value* final_value = nullptr;
     llvm::Type* final_type;
 
-    if (l->type->isFloatTy()) {
+    if (l.type->isFloatTy()) {
         if (op == "+") { 
-            final_value = code_generator->m_Builder->CreateFAdd(l->value, r->value, "addtmp"); 
+            final_value = code_generator->m_Builder->CreateFAdd(l.value, r.value, "addtmp"); 
             final_type = llvm::Type::getFloatTy(*code_generator->m_Context);
         } 
         else if (op == "-") { 
-            final_value = code_generator->m_Builder->CreateFSub(l->value, r->value, "subtmp"); 
+            final_value = code_generator->m_Builder->CreateFSub(l.value, r.value, "subtmp"); 
             final_type = llvm::Type::getFloatTy(*code_generator->m_Context);
         }
         else if (op == "*") { 
-            final_value = code_generator->m_Builder->CreateFMul(l->value, r->value, "multmp"); 
+            final_value = code_generator->m_Builder->CreateFMul(l.value, r.value, "multmp"); 
             final_type = llvm::Type::getFloatTy(*code_generator->m_Context);
         }
         else if (op == "<") {
-            l->value = code_generator->m_Builder->CreateFCmpULT(l->value, r->value, "cmptmp");
-            final_value = code_generator->m_Builder->CreateUIToFP(l->value, llvm::Type::getInt1Ty(*code_generator->m_Context), "booltmp");
+            l.value = code_generator->m_Builder->CreateFCmpULT(l.value, r.value, "cmptmp");
+            final_value = code_generator->m_Builder->CreateUIToFP(l.value, llvm::Type::getInt1Ty(*code_generator->m_Context), "booltmp");
             final_type = llvm::Type::getInt1Ty(*code_generator->m_Context);
         }
         else if (op == ">") {
-            l->value = code_generator->m_Builder->CreateFCmpULT(r->value, l->value, "cmptmp");
-            final_value = code_generator->m_Builder->CreateUIToFP(l->value, llvm::Type::getInt1Ty(*code_generator->m_Context), "booltmp");
+            l.value = code_generator->m_Builder->CreateFCmpULT(r.value, l.value, "cmptmp");
+            final_value = code_generator->m_Builder->CreateUIToFP(l.value, llvm::Type::getInt1Ty(*code_generator->m_Context), "booltmp");
             final_type = llvm::Type::getInt1Ty(*code_generator->m_Context);
         }
         else {
             DEPLANG_PARSER_ERROR("Expected Operator, got " << op);
-            return nullptr;
+            return {};
         }
     } 
-    else if (l->type->isIntegerTy()) {
+    else if (l.type->isIntegerTy()) {
         if (op == "+") { 
-            final_value = code_generator->m_Builder->CreateAdd(l->value, r->value, "addtmp"); 
+            final_value = code_generator->m_Builder->CreateAdd(l.value, r.value, "addtmp"); 
             final_type = llvm::Type::getInt32Ty(*code_generator->m_Context);
         }
         else if (op == "-") { 
-            final_value = code_generator->m_Builder->CreateSub(l->value, r->value, "subtmp"); 
+            final_value = code_generator->m_Builder->CreateSub(l.value, r.value, "subtmp"); 
             final_type = llvm::Type::getInt32Ty(*code_generator->m_Context);
         }
         else if (op == "*") { 
-            final_value = code_generator->m_Builder->CreateMul(l->value, r->value, "multmp");
+            final_value = code_generator->m_Builder->CreateMul(l.value, r.value, "multmp");
             final_type = llvm::Type::getInt32Ty(*code_generator->m_Context);
         }
         else if (op == "<") {
-            l->value = code_generator->m_Builder->CreateICmpULT(l->value, r->value, "cmptmp");
-            final_value = code_generator->m_Builder->CreateUIToFP(l->value, llvm::Type::getInt1Ty(*code_generator->m_Context), "booltmp");
+            l.value = code_generator->m_Builder->CreateICmpULT(l.value, r.value, "cmptmp");
+            final_value = code_generator->m_Builder->CreateUIToFP(l.value, llvm::Type::getInt1Ty(*code_generator->m_Context), "booltmp");
             final_type = llvm::Type::getInt1Ty(*code_generator->m_Context);
         }
         else if (op == ">") {
-            l->value = code_generator->m_Builder->CreateICmpULT(r->value, l->value, "cmptmp");
-            final_value = code_generator->m_Builder->CreateUIToFP(l->value, llvm::Type::getInt1Ty(*code_generator->m_Context), "booltmp");
+            l.value = code_generator->m_Builder->CreateICmpULT(r.value, l.value, "cmptmp");
+            final_value = code_generator->m_Builder->CreateUIToFP(l.value, llvm::Type::getInt1Ty(*code_generator->m_Context), "booltmp");
             final_type = llvm::Type::getInt1Ty(*code_generator->m_Context);
         }
         else {
             DEPLANG_PARSER_ERROR("Expected Operator, got " << op);
-            return nullptr;
+            return {};
         }
     }
     else {
         // @TODO: Implement binary operations for bools
         DEPLANG_PARSER_ERROR("Bool does not support binary operations");
-        return nullptr;
+        return {};
     }
 
-    return new sTypedValue(final_value, final_type);
+    return sTypedValue(final_value, final_type);
+}
+
+sTypedValue build_ir_tuple(sTypedValue l, sTypedValue r, std::shared_ptr<cCodeGenerator> code_generator) {
+    // @TODO: type product as expression
+    std::vector<llvm::Type*> types = { l.type, r.type };
+    llvm::StructType* tuple_type = llvm::StructType::get(*code_generator->m_Context, types);
+
+    llvm::Value* ptr = code_generator->m_Builder->CreateAlloca(tuple_type);
+    code_generator->m_Builder->CreateStore(l.value, code_generator->m_Builder->CreateStructGEP(tuple_type, ptr, 0));
+    code_generator->m_Builder->CreateStore(r.value, code_generator->m_Builder->CreateStructGEP(tuple_type, ptr, 1));
+    return sTypedValue(ptr, tuple_type);
+}
+
+sTypedValue build_ir_variable_declaration(symbol_t name, sTypedValue initializer, llvm::Type* declared_type, std::shared_ptr<cCodeGenerator> code_generator) {
+    sTypedValue value = initializer;
+    if (!value && declared_type) { value = sTypedValue(llvm::Constant::getNullValue(declared_type), declared_type); }
+    code_generator->m_NamedValues[name] = value;
+    return value;
 }
 
 
@@ -131,15 +343,15 @@ sTypedValue* build_ir_operation(sTypedValue* l, sTypedValue* r, std::string op,
 //     return std::make_unique<sTypedValue>(val, std::move(type));
 // }
 
-sTypedValue* LiteralIntExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+sTypedValue LiteralIntExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
     // @CHECK: Integers precision is 32 bits for now
     llvm::Value* val = llvm::ConstantInt::get(*code_generator->m_Context, llvm::APInt(32, this->m_value));
     if (!val) {
         DEPLANG_PARSER_ERROR("Couldn't create Literal Int value");
-        return nullptr;
+        return {};
     }
 
-    return new sTypedValue(val, llvm::Type::getInt32Ty(*code_generator->m_Context));
+    return sTypedValue(val, llvm::Type::getInt32Ty(*code_generator->m_Context));
 
     // auto type = std::make_unique<TypeExrAST>("int");
     // return new sTypedValue(val, new TypeExrAST("int"));
@@ -150,14 +362,14 @@ void LiteralIntExprAST::print() {
     std::cout << this->m_value << std::endl;
 }
 
-sTypedValue* LiteralFloatExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+sTypedValue LiteralFloatExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
     llvm::Value* val = llvm::ConstantFP::get(*code_generator->m_Context, llvm::APFloat(this->m_value));
     if (!val) {
         DEPLANG_PARSER_ERROR("Couldn't create Literal Float value");
-        return nullptr;
+        return {};
     }
 
-    return new sTypedValue(val, llvm::Type::getFloatTy(*code_generator->m_Context));
+    return sTypedValue(val, llvm::Type::getFloatTy(*code_generator->m_Context));
 
     // auto type = std::make_unique<TypeExrAST>("float");
     // return new sTypedValue(val, new TypeExrAST("float"));
@@ -168,15 +380,15 @@ void LiteralFloatExprAST::print() {
     std::cout << this->m_value << std::endl;
 }
 
-sTypedValue* LiteralBoolExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+sTypedValue LiteralBoolExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
     // llvm::Value* val = llvm::ConstantFP::get(*code_generator->m_Context, llvm::APFloat(this->m_value));
     llvm::Value* val = llvm::ConstantInt::getBool(*code_generator->m_Context, this->m_value);
     if (!val) {
         DEPLANG_PARSER_ERROR("Couldn't create Literal Bool value");
-        return nullptr;
+        return {};
     }
     // auto type = std::make_unique<TypeExrAST>("bool");
-    return new sTypedValue(val, llvm::Type::getInt1Ty(*code_generator->m_Context));
+    return sTypedValue(val, llvm::Type::getInt1Ty(*code_generator->m_Context));
     // return new sTypedValue(val, new TypeExrAST("bool"));
     // return std::make_unique<sTypedValue>(val, std::move(type));
 }
@@ -187,70 +399,79 @@ void LiteralBoolExprAST::print() {
 
 // Variable Expression AST
 
-VariableExprAST::VariableExprAST(const std::string& name) : m_name(name) {}
+VariableExprAST::VariableExprAST(symbol_t name) : m_name(name) {}
 
-const std::string& VariableExprAST::get_name() { return m_name; }
+symbol_t VariableExprAST::get_name() { return m_name; }
 
-sTypedValue* VariableExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+sTypedValue VariableExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
     // std::unique_ptr<sTypedValue> value = std::move(code_generator->m_NamedValues[this->m_name]);
-    sTypedValue* value = code_generator->m_NamedValues[this->m_name];
+    auto value = code_generator->m_NamedValues.find(this->m_name);
 
-    if (value) { return value; }
+    if (value != code_generator->m_NamedValues.end()) { return value->second; }
     else {
-        DEPLANG_PARSER_ERROR("Variable " << this->m_name << " not found");
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Variable " << get_symbol_string(this->m_name) << " not found");
+        return {};
     }
 }
 
 void VariableExprAST::print() {
-    std::cout << this->m_name << std::endl;
+    std::cout << get_symbol_string(this->m_name) << std::endl;
 }
 
 
-TypeExrAST::TypeExrAST(const std::string& name, std::unique_ptr<TypeExrAST> lhs, std::unique_ptr<TypeExrAST> rhs) {
+TypeExrAST::TypeExrAST(symbol_t name, TypeExrAST* lhs, TypeExrAST* rhs) {
     this->m_prim_type = name;
-    this->m_left = std::move(lhs);
-    this->m_right = std::move(rhs);
+    this->m_left = lhs;
+    this->m_right = rhs;
+    this->m_type_id = TYPE_NONE;
 }
 
-TypeExrAST::TypeExrAST(const std::string& name) {
-    std::cout << "PIRJEARPIAEJRPIAR: " << name << std::endl;
+TypeExrAST::TypeExrAST(symbol_t name) {
+    DEPLANG_LOG(LOG_TRACE, LOG_TYPES, "Type expression " << get_symbol_string(name));
     this->m_prim_type = name;
 
     this->m_left = nullptr;
     this->m_right = nullptr;
+    this->m_type_id = TYPE_NONE;
 }
 
-const std::string& TypeExrAST::get_primitive_type() { return this->m_prim_type; }
+symbol_t TypeExrAST::get_primitive_type() { return this->m_prim_type; }
 
-sTypedValue* TypeExrAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+sTypedValue TypeExrAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
     // @TODO: Add type code generation
-    return nullptr;
+    return {};
 }
 
-llvm::Type* TypeExrAST::register_type(std::shared_ptr<cCodeGenerator> code_generator) {
-    
-    llvm::Type* prim_type = get_llvm_type(this->get_primitive_type(), code_generator);
+type_id_t TypeExrAST::resolve_type() {
+    if (this->m_type_id != TYPE_NONE) { return this->m_type_id; }
 
-    // @TODO: For now only doing product types, implement others later
-    if (!prim_type && this->m_left && this->m_right) {
-        llvm::Type* frst_type = this->m_left->register_type(code_generator);
-        llvm::Type* scnd_type = this->m_right->register_type(code_generator);
-        
-        std::vector<llvm::Type*> types;
-        types.push_back(frst_type);
-        types.push_back(scnd_type);
+    cTypeTable& type_table = cTypeTable::get();
+    if (!this->m_left || !this->m_right) {
+        this->m_type_id = type_table.get_named(this->m_prim_type);
+        return this->m_type_id;
+    }
 
-        llvm::StructType* tuple_type = llvm::StructType::get(*code_generator->m_Context, types);
+    type_id_t lhs = this->m_left->resolve_type();
+    type_id_t rhs = this->m_right->resolve_type();
 
-        return tuple_type;
+    switch (this->m_prim_type) {
+    case SYM_PRODUCT: this->m_type_id = type_table.get_product(lhs, rhs); break;
+    case SYM_SUM:     this->m_type_id = type_table.get_sum(lhs, rhs); break;
+    case SYM_ARROW:   this->m_type_id = type_table.get_function(lhs, rhs); break;
+    default:
+        DEPLANG_PARSER_ERROR("Unknown type operator " << get_symbol_string(this->m_prim_type));
+        break;
     }
 
-    return prim_type;
+    return this->m_type_id;
+}
+
+llvm::Type* TypeExrAST::register_type(std::shared_ptr<cCodeGenerator> code_generator) {
+    return lower_type(this->resolve_type(), code_generator);
 }
 
 void TypeExrAST::print() {
-    std::cout << "\t" << this->m_prim_type << std::endl;
+    std::cout << "\t" << get_symbol_string(this->m_prim_type) << std::endl;
     if (this->m_left && this->m_right) {
         std::cout << "\t/\t\t\t\t\\" << std::endl;
         std::cout << "/\t\t\t\t\t\\" << std::endl;
@@ -261,58 +482,25 @@ void TypeExrAST::print() {
     std::cout << std::endl;
 }
 
-bool TypeExrAST::type_check(const TypeExrAST* other_type_expr) {
-    if (this->m_prim_type != other_type_expr->m_prim_type) { return false; }
-    if (!this->m_left || !this->m_right || !other_type_expr->m_left || !other_type_expr->m_right) {
-        return false;
-    }
-    if (this->m_prim_type == "*" || this->m_prim_type == "->") {
-        return this->m_left->type_check(other_type_expr->m_left.get()) && this->m_right->type_check(other_type_expr->m_right.get());
-    } else if (this->m_prim_type == "|") {
-        return (m_left->type_check(other_type_expr->m_left.get()) && m_right->type_check(other_type_expr->m_right.get()))
-        || (m_left->type_check(other_type_expr->m_right.get()) && m_right->type_check(other_type_expr->m_left.get()));
-    }
-
-    return true;
+// Canonical types, equal iff their ids are
+bool TypeExrAST::type_check(TypeExrAST* other_type_expr) {
+    type_id_t type = this->resolve_type();
+    return type != TYPE_NONE && type == other_type_expr->resolve_type();
 }
 
 // Binary Expr AST
-BinaryExprAST::BinaryExprAST(std::string op, std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs) :
-    m_op(op), m_lhs(std::move(lhs)), m_rhs(std::move(rhs)) {}   
+BinaryExprAST::BinaryExprAST(std::string_view op, ExprAST* lhs, ExprAST* rhs) :
+    m_op(op), m_lhs(lhs), m_rhs(rhs) {}   
 
-sTypedValue* BinaryExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
-    sTypedValue* l = this->m_lhs->codegen(code_generator);
-    sTypedValue* r = this->m_rhs->codegen(code_generator);
+sTypedValue BinaryExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+    sTypedValue l = this->m_lhs->codegen(code_generator);
+    sTypedValue r = this->m_rhs->codegen(code_generator);
     if (!l || !r) {
         DEPLANG_PARSER_ERROR("Couldn't evaluate left or right expression");
-        return nullptr;
+        return {};
     }
 
-    if (this->m_op == ",") {
-        // @TODO: type product as expression
-        // @BACK
-        // llvm::Value* val = 
-        // llvm::ArrayRef<llvm::Value*> elements = llvm::makeArrayRef(l->value);
-
-        std::vector<llvm::Type*> types;
-
-        types.push_back(l->type);
-        types.push_back(r->type);
-
-        llvm::StructType* tuple_type = 
-            llvm::StructType::get(*code_generator->m_Context, types);
-        
-        llvm::Value* ptr = code_generator->m_Builder->CreateAlloca(tuple_type);
-        code_generator->m_Builder->CreateStore(l->value, code_generator->m_Builder->CreateStructGEP(tuple_type, ptr, 0));
-        code_generator->m_Builder->CreateStore(r->value, code_generator->m_Builder->CreateStructGEP(tuple_type, ptr, 1));
-
-        // llvm::Value* val = llvm::Value::ConstantFirstVal
-        // Set type as TypeExrAST : l.type <- "*" -> r.type
-        
-        return new sTypedValue(ptr, tuple_type);
-        
-        // return new sTypedValue(ptr, );
-    }
+    if (this->m_op == ",") { return build_ir_tuple(l, r, code_generator); }
     return build_ir_operation(l, r, this->m_op, code_generator);
 }
 
@@ -329,12 +517,12 @@ void BinaryExprAST::print() {
 }
 
 // Return Expr AST
-ReturnExprAST::ReturnExprAST(std::unique_ptr<ExprAST> expression) : m_expression(std::move(expression)) {}
+ReturnExprAST::ReturnExprAST(ExprAST* expression) : m_expression(expression) {}
 
 
-sTypedValue* ReturnExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+sTypedValue ReturnExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
     if (this->m_expression) { return this->m_expression->codegen(code_generator); }
-    return nullptr;
+    return {};
 }
 
 void ReturnExprAST::print() {
@@ -344,25 +532,30 @@ void ReturnExprAST::print() {
 }
 
 // Function Parameter AST
-FunctionParameterAST::FunctionParameterAST(const std::string& param_name, std::unique_ptr<TypeExrAST> param_type): m_type_expr(std::move(param_type)), m_param_name(param_name) {}
+FunctionParameterAST::FunctionParameterAST(symbol_t param_name, TypeExrAST* param_type): m_type_expr(param_type), m_param_name(param_name) {}
 
-const std::string& FunctionParameterAST::get_param_name() { return m_param_name; }
-const std::string& FunctionParameterAST::get_primitive_type() { return m_type_expr->get_primitive_type(); }
+symbol_t FunctionParameterAST::get_param_name() { return m_param_name; }
+symbol_t FunctionParameterAST::get_primitive_type() { return m_type_expr->get_primitive_type(); }
 
 
 // Functio ndefinition AST
-FunctionDefinitionAST::FunctionDefinitionAST(const std::string& function_name, std::vector<std::unique_ptr<FunctionParameterAST>> parameters, std::unique_ptr<TypeExrAST> return_type, std::vector<std::unique_ptr<ExprAST>> function_body) : m_function_name(function_name), m_parameters(std::move(parameters)), m_return_type(std::move(return_type)), m_function_body(std::move(function_body)) {}
+FunctionDefinitionAST::FunctionDefinitionAST(symbol_t function_name, llvm::ArrayRef<FunctionParameterAST*> parameters, TypeExrAST* return_type, llvm::ArrayRef<ExprAST*> function_body) : m_function_name(function_name), m_parameters(parameters), m_return_type(return_type), m_function_body(function_body) {}
 
-const std::string& FunctionDefinitionAST::get_function_name() { return m_function_name; }
+symbol_t FunctionDefinitionAST::get_function_name() { return m_function_name; }
 
-llvm::Function* FunctionDefinitionAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+llvm::Function* FunctionDefinitionAST::codegen_prototype(std::shared_ptr<cCodeGenerator> code_generator) {
     // @CHECK: possible memory leak
     // std::vector<llvm::Type*> doubles(this->m_parameters.size(),
     //                     llvm::Type::getDoubleTy(*code_generator->m_Context));
 
     std::vector<llvm::Type*> param_types;
-    for (auto& param : this->m_parameters) {
-        param_types.push_back(get_llvm_type(param->get_primitive_type(), code_generator));
+    for (FunctionParameterAST* param : this->m_parameters) {
+        llvm::Type* param_type = get_llvm_type(param->get_primitive_type(), code_generator);
+        if (!param_type) {
+            DEPLANG_PARSER_ERROR("Couldn't create type of parameter " << get_symbol_string(param->get_param_name()));
+            return nullptr;
+        }
+        param_types.push_back(param_type);
     }
 
     // std::vector<std::shared_ptr<llvm::Type>> doubles(this->m_parameters.size(),
@@ -376,8 +569,10 @@ llvm::Function* FunctionDefinitionAST::codegen(std::shared_ptr<cCodeGenerator> c
     // llvm::Type* func_return_type = llvm::Type::getInt32Ty(*code_generator->m_Context);
     llvm::Type* func_return_type = this->m_return_type->register_type(code_generator);
 
-    std::cout << "True return type: " << std::endl;
-    this->m_return_type->print();
+    if (DEPLANG_LOG_ENABLED(LOG_DEBUG, LOG_CODEGEN)) {
+        std::cout << "True return type: " << std::endl;
+        this->m_return_type->print();
+    }
 
     if (!func_return_type) {
         DEPLANG_PARSER_ERROR("Couldn't create function return type");
@@ -390,26 +585,32 @@ llvm::Function* FunctionDefinitionAST::codegen(std::shared_ptr<cCodeGenerator> c
         return nullptr;
     }
 
-    llvm::Function* func = llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, this->m_function_name, code_generator->m_Module.get());
+    llvm::Function* func = llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, get_symbol_string(this->m_function_name), code_generator->m_Module.get());
     if (!func) {
         DEPLANG_PARSER_ERROR("Couldn't create function");
         return nullptr;
     }
 
+    unsigned index = 0;
+    for (auto& arg : func->args()) { arg.setName(get_symbol_string(this->m_parameters[index++]->get_param_name())); }
+
+    return func;
+}
+
+llvm::Function* FunctionDefinitionAST::codegen(std::shared_ptr<cCodeGenerator> code_generator, llvm::Function* func) {
+    cScopedTimer timer("Codegen function", get_symbol_string(this->m_function_name));
+
     // code_generator->m_NamedValues.clear();
     code_generator->delete_named_values();
     unsigned index = 0;
     for (auto& arg : func->args()) {
-        arg.setName(this->m_parameters[index]->get_param_name()); 
-        std::cout << "Adding parameter: " << std::string(arg.getName()) << std::endl;
+        DEPLANG_LOG(LOG_DEBUG, LOG_CODEGEN, "Adding parameter: " << std::string_view(arg.getName()));
         // @TODO: Set arg type
         // code_generator->m_NamedValues[std::string(arg.getName())] = new sTypedValue(&arg, this->m_parameters[index]->m_type_expr.release());
-        code_generator->m_NamedValues[std::string(arg.getName())] = new sTypedValue(&arg, arg.getType());
+        code_generator->m_NamedValues[this->m_parameters[index]->get_param_name()] = sTypedValue(&arg, arg.getType());
         index++;
     }
 
-    if (!func) { return nullptr; }
-
     llvm::BasicBlock* bb = llvm::BasicBlock::Create(*code_generator->m_Context, "entry", func);
     if (!bb) {
         DEPLANG_PARSER_ERROR("Couldn't create basic block");
@@ -417,27 +618,29 @@ llvm::Function* FunctionDefinitionAST::codegen(std::shared_ptr<cCodeGenerator> c
     }
     code_generator->m_Builder->SetInsertPoint(bb);
 
+    llvm::Type* func_return_type = func->getReturnType();
     // code_generator->m_NamedValues.clear();
-    sTypedValue* value;
-    for (auto& expr : this->m_function_body) {
+    sTypedValue value;
+    for (ExprAST* expr : this->m_function_body) {
         value = expr->codegen(code_generator);
         if (!value) {
             DEPLANG_PARSER_ERROR("Couldn't evaluate expression");
             return nullptr;
         }
-        if (dynamic_cast<ReturnExprAST*>(expr.get())) {
+        if (dynamic_cast<ReturnExprAST*>(expr)) {
             // func_return_type->print(llvm::errs());
             // std::cout << std::endl;
             // value->type->print(llvm::errs());
             // std::cout << std::endl;
 
             // @TODO: Better type checking
-            if (func_return_type->getTypeID() == value->type->getTypeID()) {
-                std::cout << "Type check" << std::endl;
-                code_generator->m_Builder->CreateRet(value->value);
+            if (func_return_type->getTypeID() == value.type->getTypeID()) {
+                DEPLANG_LOG(LOG_TRACE, LOG_CODEGEN, "Type check");
+                code_generator->m_Builder->CreateRet(value.value);
             } else {
                 DEPLANG_PARSER_ERROR("Type mismatch");
-                func->eraseFromParent();
+                // Calls from other functions may already use the declaration
+                func->deleteBody();
                 return nullptr;
             }
             break;
@@ -446,39 +649,40 @@ llvm::Function* FunctionDefinitionAST::codegen(std::shared_ptr<cCodeGenerator> c
         // func->eraseFromParent();
     }
 
-    llvm::verifyFunction(*func);
+    // Verifies the function first
+    code_generator->optimize_function(*func);
     return func;
 }
 
 void FunctionDefinitionAST::print() {
-    std::cout << this->m_function_name << std::endl;
+    std::cout << get_symbol_string(this->m_function_name) << std::endl;
     std::cout << "\t|" << std::endl;
     std::cout << "\t|" << std::endl;
-    for (auto& expr : m_function_body) { expr->print(); }
+    for (ExprAST* expr : m_function_body) { expr->print(); }
     std::cout << std::endl;
 }
 
 
 // Variable Declaration Expression
-VariableDeclarationExprAST::VariableDeclarationExprAST(const std::string& variable_name, std::unique_ptr<TypeExrAST> variable_type) : m_variable_name(variable_name), m_variable_type(std::move(variable_type)), m_expression(nullptr) {}
+VariableDeclarationExprAST::VariableDeclarationExprAST(symbol_t variable_name, TypeExrAST* variable_type) : m_variable_name(variable_name), m_variable_type(variable_type), m_expression(nullptr) {}
 
-VariableDeclarationExprAST::VariableDeclarationExprAST(const std::string& variable_name, std::unique_ptr<TypeExrAST> variable_type, std::unique_ptr<ExprAST> expression) : m_variable_name(variable_name), m_variable_type(std::move(variable_type)), m_expression(std::move(expression)) {}
+VariableDeclarationExprAST::VariableDeclarationExprAST(symbol_t variable_name, TypeExrAST* variable_type, ExprAST* expression) : m_variable_name(variable_name), m_variable_type(variable_type), m_expression(expression) {}
 
-const std::string& VariableDeclarationExprAST::get_variable_name() { return m_variable_name; }
-const std::string& VariableDeclarationExprAST::get_primitive_type() { return m_variable_type->get_primitive_type(); }
+symbol_t VariableDeclarationExprAST::get_variable_name() { return m_variable_name; }
+symbol_t VariableDeclarationExprAST::get_primitive_type() { return m_variable_type->get_primitive_type(); }
 
-sTypedValue* VariableDeclarationExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
-    sTypedValue* value;
-    if (this->m_expression) { value = this->m_expression->codegen(code_generator); }
-    code_generator->m_NamedValues[this->m_variable_name] = std::move(value);
-    return value;
+sTypedValue VariableDeclarationExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+    if (this->m_expression) {
+        return build_ir_variable_declaration(this->m_variable_name, this->m_expression->codegen(code_generator), nullptr, code_generator);
+    }
+    return build_ir_variable_declaration(this->m_variable_name, {}, this->m_variable_type->register_type(code_generator), code_generator);
 }
 
 void VariableDeclarationExprAST::print() {
     std::cout << "\tlet" << std::endl;
     std::cout << "\t/\t\t\t\t\\" << std::endl;
     std::cout << "/\t\t\t\t\t\\" << std::endl;
-    std::cout << this->m_variable_name << "\t\t";
+    std::cout << get_symbol_string(this->m_variable_name) << "\t\t";
     m_variable_type->print();
     // @TODO: Also print expression
     std::cout << std::endl;
@@ -486,45 +690,45 @@ void VariableDeclarationExprAST::print() {
 
 
 // Call Expression AST
-CallExprAST::CallExprAST(const std::string& callee, std::vector<std::unique_ptr<ExprAST>> args) :
-    m_callee(callee), m_args(std::move(args)) {}
+CallExprAST::CallExprAST(symbol_t callee, llvm::ArrayRef<ExprAST*> args) :
+    m_callee(callee), m_args(args) {}
 
-sTypedValue* CallExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
-    llvm::Function* callee_f = code_generator->m_Module->getFunction(this->m_callee);
+sTypedValue CallExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+    llvm::Function* callee_f = code_generator->m_Module->getFunction(get_symbol_string(this->m_callee));
     if (!callee_f) {
-        DEPLANG_PARSER_ERROR("Function " << this->m_callee << " not found");
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Function " << get_symbol_string(this->m_callee) << " not found");
+        return {};
     }
 
     if (callee_f->arg_size() != this->m_args.size()) {
         DEPLANG_PARSER_ERROR("Expected " << callee_f->arg_size() << ", got " << this->m_args.size() << "arguments");
-        return nullptr;
+        return {};
     }
 
     std::vector<llvm::Value*> args_v;
     for (unsigned i = 0, e = this->m_args.size(); i != e; ++i) {
-        llvm::Value* arg_value = this->m_args[i]->codegen(code_generator)->value;
+        llvm::Value* arg_value = this->m_args[i]->codegen(code_generator).value;
         if (!arg_value) {
             DEPLANG_PARSER_ERROR("Couldn't evaluate argument of call expression");
-            return nullptr;
+            return {};
         }
         args_v.push_back(arg_value);
-        if (!args_v.back()) { return nullptr; }
+        if (!args_v.back()) { return {}; }
     }
 
     llvm::Value* val = code_generator->m_Builder->CreateCall(callee_f, args_v, "calltmp");
     if (!val) {
         DEPLANG_PARSER_ERROR("Couldn't Build function call");
-        return nullptr;
+        return {};
     }
 
-    return new sTypedValue(val, llvm::Type::getInt32Ty(*code_generator->m_Context));
+    return sTypedValue(val, callee_f->getReturnType());
     // return new sTypedValue(val, new TypeExrAST("int"));
 }
 
 void CallExprAST::print() {
-    std::cout << "\t" << this->m_callee << std::endl;
-    for (auto& expr : m_args) {
+    std::cout << "\t" << get_symbol_string(this->m_callee) << std::endl;
+    for (ExprAST* expr : m_args) {
         std::cout << "|" << std::endl;
         expr->print();
     }
@@ -532,16 +736,16 @@ void CallExprAST::print() {
 
 
 // Assignment Expr AST
-AssignmentExprAST::AssignmentExprAST(const std::string& variable, std::unique_ptr<ExprAST> rhs) : m_variable(variable), m_rhs(std::move(rhs)) {}
-const std::string& AssignmentExprAST::get_variable_name() { return m_variable; }
+AssignmentExprAST::AssignmentExprAST(symbol_t variable, ExprAST* rhs) : m_variable(variable), m_rhs(rhs) {}
+symbol_t AssignmentExprAST::get_variable_name() { return m_variable; }
 
-sTypedValue* AssignmentExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
+sTypedValue AssignmentExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
     auto value = this->m_rhs->codegen(code_generator);
     if (!value) {
         DEPLANG_PARSER_ERROR("Couldn't Assign value to variable");
-        return nullptr;
+        return {};
     }
-    code_generator->m_NamedValues[this->m_variable] = std::move(value);
+    code_generator->m_NamedValues[this->m_variable] = value;
     return value;
 }
 
@@ -549,7 +753,7 @@ void AssignmentExprAST::print() {
     std::cout << "\t=" << std::endl;
     std::cout << "\t/\t\t\t\t\\" << std::endl;
     std::cout << "/\t\t\t\t\t\\" << std::endl;
-    std::cout << this->m_variable << "\t\t";
+    std::cout << get_symbol_string(this->m_variable) << "\t\t";
     m_rhs->print();
 
     // m_variable_type->print();
@@ -558,540 +762,584 @@ void AssignmentExprAST::print() {
 
 
 
-TypeDeclarationExprAST::TypeDeclarationExprAST(const std::string& type_name, std::unique_ptr<TypeExrAST> type_def) : m_type_name(type_name), m_type_definition(std::move(type_def)) {
+TypeDeclarationExprAST::TypeDeclarationExprAST(symbol_t type_name, TypeExrAST* type_def) : m_type_name(type_name), m_type_definition(type_def) {
 
 }
 
 llvm::Type* TypeDeclarationExprAST::codegen(std::shared_ptr<cCodeGenerator> code_generator) {
     llvm::Type* expr_type = this->m_type_definition->register_type(code_generator);
 
-    std::cout << "Added Named Type" << std::endl;
-    code_generator->m_NamedTypes[this->m_type_name] = expr_type;
+    DEPLANG_LOG(LOG_DEBUG, LOG_TYPES, "Added named type " << get_symbol_string(this->m_type_name));
+    code_generator->define_named_type(this->m_type_name, expr_type);
     return expr_type;
 }
 
 
 // Parser
-cParser::cParser(std::vector<sToken> tokens) : m_code_generator(std::make_shared<cCodeGenerator>()),
-    m_tokens(std::move(tokens)), m_current_index(0) {}
+cParser::cParser(std::string_view source, std::vector<sToken> tokens) : m_code_generator(std::make_shared<cCodeGenerator>()),
+    m_source(source), m_lexer(nullptr), m_tokens(std::move(tokens)), m_current_index(0), m_lookahead_start(0), m_lookahead_count(0) {}
+
+cParser::cParser(cLexer* lexer) : m_code_generator(std::make_shared<cCodeGenerator>()),
+    m_source(lexer->get_input()), m_lexer(lexer), m_current_index(0), m_lookahead_start(0), m_lookahead_count(0) {}
+
+sToken cParser::pull_token() {
+    if (this->m_lexer) { return this->m_lexer->get_next_token(); }
+
+    if (this->m_current_index < this->m_tokens.size()) { return this->m_tokens[this->m_current_index++]; }
+
+    // Past the end keep returning the last token, EOF for a complete stream
+    if (!this->m_tokens.empty()) { return this->m_tokens.back(); }
+
+    sToken eof_token = { TOK_EOF, (uint32_t)this->m_source.size(), 0, 0, SYM_NONE };
+    return eof_token;
+}
+
+void cParser::fill_lookahead(size_t count) {
+    while (this->m_lookahead_count < count) {
+        this->m_lookahead[(this->m_lookahead_start + this->m_lookahead_count) % LOOKAHEAD_SIZE] = this->pull_token();
+        ++this->m_lookahead_count;
+    }
+}
+
+void cParser::pop_lookahead() {
+    this->m_lookahead_start = (this->m_lookahead_start + 1) % LOOKAHEAD_SIZE;
+    --this->m_lookahead_count;
+}
 
 sToken cParser::get_next_token() {
-    while (this->m_tokens[this->m_current_index].token_type == TOK_COMMENT) {
-        this->m_current_index++;
-    } 
-    return this->m_current_token = this->m_tokens[this->m_current_index++];
+    this->peek_next_token();
+    this->m_current_token = this->m_lookahead[this->m_lookahead_start];
+    this->pop_lookahead();
+    return this->m_current_token;
 }
 
 const sToken& cParser::peek_next_token() {
-    while (this->m_tokens[this->m_current_index].token_type == TOK_COMMENT) {
-        this->m_current_index++;
-    } 
-    return this->m_tokens[this->m_current_index];
+    this->fill_lookahead(1);
+    return this->m_lookahead[this->m_lookahead_start];
 }
 
 
 void cParser::emit_object_code(std::string object_file_name) {
-    // Initialize the target registry etc.
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
-
-    auto TargetTriple = llvm::sys::getDefaultTargetTriple();
-    this->m_code_generator->m_Module->setTargetTriple(TargetTriple);
+    if (!this->m_code_generator->emit_object_code(object_file_name)) { exit(1); }
+    std::cout << "Wrote " << object_file_name << std::endl;
+}
 
-    std::string Error;
-    auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
 
-    // Print an error and exit if we couldn't find the requested target.
-    // This generally occurs if we've forgotten to initialise the
-    // TargetRegistry or we have a bogus target triple.
-    if (!Target) {
-        llvm::errs() << Error;
-        exit(1);
+// Builders
+// The grammar below is written once and emits its nodes through a builder:
+// sTreeBuilder allocates the tree nodes in the arena and generates the
+// functions once the whole unit is parsed, sFlatBuilder appends to a
+// cFlatAST. A failed rule returns NONE
+struct sTreeBuilder {
+    typedef ExprAST* expr_t;
+    typedef TypeExrAST* type_t;
+    typedef FunctionParameterAST* param_t;
+    typedef FunctionDefinitionAST* function_t;
+    typedef TypeDeclarationExprAST* type_decl_t;
+    static constexpr std::nullptr_t NONE = nullptr;
+
+    cArena& arena;
+    std::shared_ptr<cCodeGenerator> code_generator;
+    std::vector<function_t> functions;
+
+    expr_t integer(std::string_view text) { return this->arena.create<LiteralIntExprAST>(std::string(text)); }
+    expr_t floating(std::string_view text) { return this->arena.create<LiteralFloatExprAST>(std::string(text)); }
+    expr_t variable(symbol_t name) { return this->arena.create<VariableExprAST>(name); }
+    expr_t assignment(symbol_t name, expr_t value) { return this->arena.create<AssignmentExprAST>(name, value); }
+    expr_t call(symbol_t callee, const std::vector<expr_t>& args) { return this->arena.create<CallExprAST>(callee, this->arena.copy_array(args)); }
+    expr_t binary(std::string_view op, expr_t lhs, expr_t rhs) { return this->arena.create<BinaryExprAST>(op, lhs, rhs); }
+    expr_t return_expression(expr_t value) { return this->arena.create<ReturnExprAST>(value); }
+    expr_t variable_declaration(symbol_t name, type_t type, expr_t initializer) {
+        return this->arena.create<VariableDeclarationExprAST>(name, type, initializer);
     }
 
-    auto CPU = "generic";
-    auto Features = "";
-
-    llvm::TargetOptions opt;
-    auto TheTargetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, llvm::Reloc::PIC_);
-    this->m_code_generator->m_Module->setDataLayout(TheTargetMachine->createDataLayout());
+    type_t type(symbol_t name) { return this->arena.create<TypeExrAST>(name); }
+    type_t type_operator(symbol_t op, type_t lhs, type_t rhs) { return this->arena.create<TypeExrAST>(op, lhs, rhs); }
+    void print_type(type_t type) { type->print(); }
 
-    std::error_code EC;
-    llvm::raw_fd_ostream dest(object_file_name, EC, llvm::sys::fs::OF_None);
+    param_t parameter(symbol_t name, type_t type) { return this->arena.create<FunctionParameterAST>(name, type); }
+    function_t function(symbol_t name, const std::vector<param_t>& params, type_t return_type, const std::vector<expr_t>& body) {
+        return this->arena.create<FunctionDefinitionAST>(name, this->arena.copy_array(params), return_type, this->arena.copy_array(body));
+    }
+    type_decl_t type_declaration(symbol_t name, type_t type) { return this->arena.create<TypeDeclarationExprAST>(name, type); }
 
-    if (EC) {
-        llvm::errs() << "Could not open file: " << EC.message();
-        exit(1);
+    bool add_type_declaration(type_decl_t type_decl) {
+        type_decl->codegen(this->code_generator);
+        return true;
     }
 
-    llvm::legacy::PassManager pass;
-    auto FileType = llvm::CodeGenFileType::CGFT_ObjectFile;
+    bool add_function(function_t func_def) { this->functions.push_back(func_def); return true; }
+
+    // Every prototype is declared before the first body, so a call may come
+    // before the definition of its callee
+    bool generate_functions() {
+        std::vector<llvm::Function*> prototypes;
+        prototypes.reserve(this->functions.size());
+        for (function_t func_def : this->functions) {
+            llvm::Function* f = func_def->codegen_prototype(this->code_generator);
+            if (!f) {
+                DEPLANG_PARSER_ERROR("Couldn't declare function " << get_symbol_string(func_def->get_function_name()));
+                return false;
+            }
+            prototypes.push_back(f);
+        }
 
-    if (TheTargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
-        llvm::errs() << "TheTargetMachine can't emit a file of this type";
-        exit(1);
+        for (size_t i = 0; i < this->functions.size(); ++i) {
+            llvm::Function* f = this->functions[i]->codegen(this->code_generator, prototypes[i]);
+            if (!f) {
+                DEPLANG_PARSER_ERROR("Couldn't generate function " << get_symbol_string(this->functions[i]->get_function_name()));
+                return false;
+            }
+            if (DEPLANG_LOG_ENABLED(LOG_DEBUG, LOG_CODEGEN)) { f->print(llvm::errs()); }
+        }
+        return true;
     }
 
-    pass.run(*this->m_code_generator->m_Module);
-    dest.flush();
+    bool add_import(symbol_t, const sToken& token) {
+        // Imported declarations are only known after parsing
+        DEPLANG_PARSER_ERROR("Imports need the staged pipeline, use --flat-ast at line " << token.line_number);
+        return false;
+    }
+};
+
+struct sFlatBuilder {
+    typedef node_index_t expr_t;
+    typedef node_index_t type_t;
+    typedef node_index_t param_t;
+    typedef node_index_t function_t;
+    typedef node_index_t type_decl_t;
+    static constexpr node_index_t NONE = NODE_NONE;
+
+    cFlatAST& ast;
+
+    expr_t integer(std::string_view text) { return this->ast.add_node(NODE_INT, (uint32_t)std::stoi(std::string(text))); }
+    expr_t floating(std::string_view text) {
+        float value = std::stof(std::string(text));
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(float));
+        return this->ast.add_node(NODE_FLOAT, bits);
+    }
+    expr_t variable(symbol_t name) { return this->ast.add_node(NODE_VARIABLE, name); }
+    expr_t assignment(symbol_t name, expr_t value) { return this->ast.add_node(NODE_ASSIGN, name, value); }
+    expr_t call(symbol_t callee, const std::vector<expr_t>& args) {
+        return this->ast.add_node(NODE_CALL, callee, this->ast.add_extra(args), (node_index_t)args.size());
+    }
+    expr_t binary(std::string_view op, expr_t lhs, expr_t rhs) { return this->ast.add_node(NODE_BINARY, encode_operator(op), lhs, rhs); }
+    expr_t return_expression(expr_t value) { return this->ast.add_node(NODE_RETURN, 0, value); }
+    expr_t variable_declaration(symbol_t name, type_t type, expr_t initializer) { return this->ast.add_node(NODE_VARDECL, name, type, initializer); }
+
+    type_t type(symbol_t name) { return this->ast.add_node(NODE_TYPE, name); }
+    type_t type_operator(symbol_t op, type_t lhs, type_t rhs) { return this->ast.add_node(NODE_TYPE, op, lhs, rhs); }
+    void print_type(type_t type) { print_flat_node(this->ast, type, 1); }
+
+    param_t parameter(symbol_t name, type_t type) { return this->ast.add_node(NODE_PARAM, name, type); }
+    function_t function(symbol_t name, const std::vector<param_t>& params, type_t return_type, const std::vector<expr_t>& body) {
+        // [return type, param count, params..., body count, body...]
+        std::vector<node_index_t> extra;
+        extra.reserve(params.size() + body.size() + 3);
+        extra.push_back(return_type);
+        extra.push_back((node_index_t)params.size());
+        extra.insert(extra.end(), params.begin(), params.end());
+        extra.push_back((node_index_t)body.size());
+        extra.insert(extra.end(), body.begin(), body.end());
+
+        return this->ast.add_node(NODE_FUNCTION, name, this->ast.add_extra(extra));
+    }
+    type_decl_t type_declaration(symbol_t name, type_t type) { return this->ast.add_node(NODE_TYPEDECL, name, type); }
 
-    llvm::outs() << "Wrote " << object_file_name << "\n";
-}
+    bool add_type_declaration(type_decl_t type_decl) { this->ast.add_root(type_decl); return true; }
+    bool add_function(function_t func_def) { this->ast.add_root(func_def); return true; }
+    bool add_import(symbol_t module_name, const sToken&) { this->ast.add_root(this->ast.add_node(NODE_IMPORT, module_name)); return true; }
+};
 
 
-std::unique_ptr<ExprAST> cParser::parse_number_expr() {
-    sToken peeked_token = this->peek_next_token();
-    std::unique_ptr<ExprAST> result;
-    this->get_next_token(); // Consume number
+// Grammar
+template <typename Builder>
+typename Builder::expr_t cParser::parse_number_expr(Builder& builder) {
+    sToken number = this->get_next_token();
 
-    switch (peeked_token.token_type) {
-    case TOK_INTEGER: return std::make_unique<LiteralIntExprAST>(peeked_token.value);
-    case TOK_FLOAT:   return std::make_unique<LiteralFloatExprAST>(peeked_token.value);
+    switch (number.token_type) {
+    case TOK_INTEGER: return builder.integer(this->get_token_value(number));
+    case TOK_FLOAT:   return builder.floating(this->get_token_value(number));
     default:
-        DEPLANG_PARSER_ERROR("Expected Integer or Float, got " << peeked_token.value);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected Integer or Float, got " << this->get_token_value(number));
+        return Builder::NONE;
     }
 }
 
 
 // '(' expression ')'
-std::unique_ptr<ExprAST> cParser::parse_paren_expr() {
+template <typename Builder>
+typename Builder::expr_t cParser::parse_paren_expr(Builder& builder) {
     this->get_next_token(); // Consume '('
     // Parse Expression
     if (this->m_current_token.token_type != TOK_RIGHTPAR) {
-        auto result = this->parse_expression();
+        auto result = this->parse_expression(builder);
         this->get_next_token(); // Consume ')'
         return result;
     }
 
     this->get_next_token(); // Consume ')'
-    return nullptr;
+    return Builder::NONE;
 }
 
 
 // identifier_expr := identifier | identifier '=' expr ';' | function_call
-std::unique_ptr<ExprAST> cParser::parse_identifier_expr() {
-    // this->get_next_token();
+template <typename Builder>
+typename Builder::expr_t cParser::parse_identifier_expr(Builder& builder) {
+    symbol_t identifier_name = this->get_next_token().symbol;
     sToken peeked_token = this->peek_next_token();
-    std::string identifier_name = peeked_token.value;
-    this->get_next_token(); // Consume identifier
-
-    peeked_token = this->peek_next_token();
 
     // Assignment
     if (peeked_token.token_type == TOK_EQUAL) {
         this->get_next_token(); // Consume '='
-        // @TODO: Parse Expression
-        auto expr = this->parse_expression();
-        if (!expr) { return nullptr; }
+        auto expr = this->parse_expression(builder);
+        if (expr == Builder::NONE) { return Builder::NONE; }
+
         peeked_token = this->peek_next_token();
-        if (peeked_token.token_type == TOK_SEMICOLON) {
-            return std::make_unique<AssignmentExprAST>(identifier_name, std::move(expr));
-        }
+        if (peeked_token.token_type == TOK_SEMICOLON) { return builder.assignment(identifier_name, expr); }
     }
 
     // Simple variable
-    if (peeked_token.token_type != TOK_LEFTPAR)
-        return std::make_unique<VariableExprAST>(identifier_name);
+    if (peeked_token.token_type != TOK_LEFTPAR) { return builder.variable(identifier_name); }
 
     this->get_next_token(); // Consume '('
-    peeked_token = this->peek_next_token();
 
     // Function call
-    std::vector<std::unique_ptr<ExprAST>> args;
-    // Parse function parameters
-    if (peeked_token.token_type != TOK_RIGHTPAR) {
+    std::vector<typename Builder::expr_t> args;
+    if (this->peek_next_token().token_type != TOK_RIGHTPAR) {
         while (true) {
-            if (auto arg = this->parse_expression()) {
-                args.push_back(std::move(arg));
-            }
-            else { return nullptr; }
-            // this->get_next_token();
-            peeked_token = this->peek_next_token();
+            auto arg = this->parse_expression(builder);
+            if (arg == Builder::NONE) { return Builder::NONE; }
+            args.push_back(arg);
 
-            if (peeked_token.token_type == TOK_RIGHTPAR) { 
+            peeked_token = this->peek_next_token();
+            if (peeked_token.token_type == TOK_RIGHTPAR) {
                 this->get_next_token(); // Consume ')'
-                break; 
+                break;
             }
 
             if (peeked_token.token_type != TOK_COMMA) {
-                DEPLANG_PARSER_ERROR("Expected ',' or ')', got " << peeked_token.value << " at line " << peeked_token.line_number);
-                return nullptr;
+                DEPLANG_PARSER_ERROR("Expected ',' or ')', got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+                return Builder::NONE;
             }
 
             this->get_next_token(); // Consume ','
         }
-    } else { 
+    } else {
         this->get_next_token(); // Consume the ')' if no parameters
     }
 
     peeked_token = this->peek_next_token();
-    if (peeked_token.token_type == TOK_SEMICOLON) {
-        std::cout << std::endl;
-        // this->get_next_token();
-        return std::make_unique<CallExprAST>(identifier_name, std::move(args));
-    } else { 
-        std::cout << "Expected ; | Got: " << peeked_token.value << std::endl;
-        return nullptr; 
+    if (peeked_token.token_type != TOK_SEMICOLON) {
+        DEPLANG_PARSER_ERROR("Expected ';', got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
 
+    return builder.call(identifier_name, args);
 }
 
-std::unique_ptr<ExprAST> cParser::parse_primary() {
-    // this->get_next_token();
-
-    sToken peeked_token = this->peek_next_token();
-    switch (peeked_token.token_type) {
-        case TOK_IDENTIFIER:
-            return this->parse_identifier_expr();
-        case TOK_FLOAT:
-        case TOK_INTEGER:
-            return this->parse_number_expr();
-        case TOK_LEFTPAR:
-            return this->parse_paren_expr();
-        case TOK_VARDECL:
-            return this->parse_variable_declaration();
-        case TOK_RETURN:
-            return this->parse_return_expr();
-        default:
-            return nullptr;
+template <typename Builder>
+typename Builder::expr_t cParser::parse_primary(Builder& builder) {
+    switch (this->peek_next_token().token_type) {
+    case TOK_IDENTIFIER: return this->parse_identifier_expr(builder);
+    case TOK_FLOAT:
+    case TOK_INTEGER:    return this->parse_number_expr(builder);
+    case TOK_LEFTPAR:    return this->parse_paren_expr(builder);
+    case TOK_VARDECL:    return this->parse_variable_declaration(builder);
+    case TOK_RETURN:     return this->parse_return_expr(builder);
+    default:             return Builder::NONE;
     }
 }
 
-std::unique_ptr<TypeExrAST> cParser::parse_type() {
-    sToken peeked_token = this->peek_next_token();
+template <typename Builder>
+typename Builder::type_t cParser::parse_type(Builder& builder) {
+    if (this->peek_next_token().token_type != TOK_IDENTIFIER) { return Builder::NONE; }
+    return builder.type(this->get_next_token().symbol);
+}
 
-    if (peeked_token.token_type == TOK_IDENTIFIER) {
-        this->get_next_token();
-        return std::make_unique<TypeExrAST>(peeked_token.value);
-    }
+// type_expr, void when there is no type name
+template <typename Builder>
+typename Builder::type_t cParser::parse_full_type(Builder& builder) {
+    sToken peeked_token = this->peek_next_token();
+    auto lhs = this->parse_type(builder);
+    if (lhs == Builder::NONE) { return builder.type(SYM_VOID); }
 
-    return nullptr;
+    DEPLANG_LOG(LOG_TRACE, LOG_PARSER, "Type: " << get_symbol_string(peeked_token.symbol));
+    return this->parse_type_expression(builder, 0, lhs);
 }
 
-std::unique_ptr<TypeDeclarationExprAST> cParser::parse_type_declaration() {
+// type identifier '=' type_expr
+template <typename Builder>
+typename Builder::type_decl_t cParser::parse_type_declaration(Builder& builder) {
     this->get_next_token(); // Consume 'type'
     sToken peeked = this->peek_next_token();
     if (peeked.token_type != TOK_IDENTIFIER) {
-        DEPLANG_PARSER_ERROR("Expected identifier, got " << peeked.value << " at line " << peeked.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected identifier, got " << this->get_token_value(peeked) << " at line " << peeked.line_number);
+        return Builder::NONE;
     }
 
-    this->get_next_token(); // Consume identifier
-    std::string type_name = peeked.value;
+    symbol_t type_name = this->get_next_token().symbol;
 
     peeked = this->peek_next_token();
     if (peeked.token_type != TOK_EQUAL) {
-        DEPLANG_PARSER_ERROR("Expected '=', got " << peeked.value << " at line " << peeked.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected '=', got " << this->get_token_value(peeked) << " at line " << peeked.line_number);
+        return Builder::NONE;
     }
     this->get_next_token(); // Consume '='
 
-    std::unique_ptr<TypeExrAST> lhs = this->parse_type();
-    std::unique_ptr<TypeExrAST> type_expr;
-    if (lhs) {
-        std::cout << "Type: " << lhs->get_primitive_type() << std::endl;
-        type_expr = this->parse_type_expression(0, std::move(lhs));
-    } else {
-        type_expr = std::make_unique<TypeExrAST>("void");
+    auto type_expr = this->parse_full_type(builder);
+    if (type_expr == Builder::NONE) { return Builder::NONE; }
+
+    return builder.type_declaration(type_name, type_expr);
+}
+
+// import name;
+template <typename Builder>
+bool cParser::parse_import(Builder& builder) {
+    sToken import = this->get_next_token(); // Consume 'import'
+    sToken peeked = this->peek_next_token();
+    if (peeked.token_type != TOK_IDENTIFIER) {
+        DEPLANG_PARSER_ERROR("Expected module name, got " << this->get_token_value(peeked) << " at line " << peeked.line_number);
+        return false;
     }
 
-    if (!type_expr) { return nullptr; }
+    symbol_t module_name = this->get_next_token().symbol;
 
-    return std::make_unique<TypeDeclarationExprAST>(type_name, std::move(type_expr));
-}
+    peeked = this->peek_next_token();
+    if (peeked.token_type != TOK_SEMICOLON) {
+        DEPLANG_PARSER_ERROR("Expected ';', got " << this->get_token_value(peeked) << " at line " << peeked.line_number);
+        return false;
+    }
 
-std::unique_ptr<ExprAST> cParser::parse_binop_expression(int expr_prec, std::unique_ptr<ExprAST> lhs) {
-    sToken peeked_token;
+    return builder.add_import(module_name, import);
+}
 
+template <typename Builder>
+typename Builder::expr_t cParser::parse_binop_expression(Builder& builder, int expr_prec, typename Builder::expr_t lhs) {
     while (true) {
-        peeked_token = this->peek_next_token();
-        if (peeked_token.token_type == TOK_EOF) { return nullptr; }
-        std::string op = peeked_token.value;
-        int tok_prec = this->get_binop_precedence(op);
+        sToken peeked_token = this->peek_next_token();
+        if (peeked_token.token_type == TOK_EOF) { return Builder::NONE; }
 
+        std::string_view op = this->get_token_value(peeked_token);
+        int tok_prec = this->get_binop_precedence(op);
         if (tok_prec < expr_prec) { return lhs; }
 
         this->get_next_token();
-        auto rhs = this->parse_primary();
-        if (!rhs) { return nullptr; }
+        auto rhs = this->parse_primary(builder);
+        if (rhs == Builder::NONE) { return Builder::NONE; }
 
-        peeked_token = this->peek_next_token();
-        int next_prec = this->get_binop_precedence(peeked_token.value);
+        int next_prec = this->get_binop_precedence(this->get_token_value(this->peek_next_token()));
         if (tok_prec < next_prec) {
-            rhs = this->parse_binop_expression(tok_prec + 1, std::move(rhs));
-            if (!rhs) { return nullptr; }
+            rhs = this->parse_binop_expression(builder, tok_prec + 1, rhs);
+            if (rhs == Builder::NONE) { return Builder::NONE; }
         }
-        lhs = std::make_unique<BinaryExprAST>(op, std::move(lhs), std::move(rhs));
+        lhs = builder.binary(op, lhs, rhs);
     }
 }
 
-std::unique_ptr<TypeExrAST> cParser::parse_type_expression(int expr_prec, std::unique_ptr<TypeExrAST> lhs) {
-    sToken peeked_token;
+template <typename Builder>
+typename Builder::type_t cParser::parse_type_expression(Builder& builder, int expr_prec, typename Builder::type_t lhs) {
     while (true) {
-        peeked_token = this->peek_next_token();
-        if (peeked_token.token_type == TOK_EOF) { return nullptr; }
+        sToken peeked_token = this->peek_next_token();
+        if (peeked_token.token_type == TOK_EOF) { return Builder::NONE; }
 
-        std::string op = peeked_token.value;
+        std::string_view op = this->get_token_value(peeked_token);
         int tok_prec = this->get_type_operator_precedence(op);
-
         if (tok_prec < expr_prec) { return lhs; }
 
         this->get_next_token();
-        // auto rhs = this->parse_primary();
-        auto rhs = this->parse_type();
-        if (!rhs) { return nullptr; }
+        auto rhs = this->parse_type(builder);
+        if (rhs == Builder::NONE) { return Builder::NONE; }
 
-        peeked_token = this->peek_next_token();
-        int next_prec = this->get_type_operator_precedence(peeked_token.value);
+        int next_prec = this->get_type_operator_precedence(this->get_token_value(this->peek_next_token()));
         if (tok_prec < next_prec) {
-            rhs = this->parse_type_expression(tok_prec + 1, std::move(rhs));
-            if (!rhs) { return nullptr; }
+            rhs = this->parse_type_expression(builder, tok_prec + 1, rhs);
+            if (rhs == Builder::NONE) { return Builder::NONE; }
         }
-        lhs = std::make_unique<TypeExrAST>(op, std::move(lhs), std::move(rhs));
+        lhs = builder.type_operator(intern_string(op), lhs, rhs);
     }
 }
 
-std::unique_ptr<ReturnExprAST> cParser::parse_return_expr() {
+template <typename Builder>
+typename Builder::expr_t cParser::parse_return_expr(Builder& builder) {
     this->get_next_token(); // Consume 'return'
-    
-    sToken peeked_token = this->peek_next_token();
 
-    // @BACK
-    if (peeked_token.token_type == TOK_SEMICOLON) {}
-    auto final_expr = this->parse_expression();
-    if (!final_expr) { return nullptr; }
+    auto final_expr = this->parse_expression(builder);
+    if (final_expr == Builder::NONE) { return Builder::NONE; }
 
-    return std::make_unique<ReturnExprAST>(std::move(final_expr));
+    return builder.return_expression(final_expr);
 }
 
-std::unique_ptr<ExprAST> cParser::parse_expression() {
-    auto lhs = this->parse_primary();
-    if (!lhs) 
-        return nullptr;
-    return this->parse_binop_expression(0, std::move(lhs));
+template <typename Builder>
+typename Builder::expr_t cParser::parse_expression(Builder& builder) {
+    auto lhs = this->parse_primary(builder);
+    if (lhs == Builder::NONE) { return Builder::NONE; }
+    return this->parse_binop_expression(builder, 0, lhs);
 }
 
 
 // function_param := identifier ':' identifier
-std::unique_ptr<FunctionParameterAST> cParser::parse_function_parameter() {
+template <typename Builder>
+typename Builder::param_t cParser::parse_function_parameter(Builder& builder) {
     sToken peeked_token = this->peek_next_token();
-
     if (peeked_token.token_type != TOK_IDENTIFIER) {
-        DEPLANG_PARSER_ERROR("Expected identifier, got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected identifier, got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
 
-    this->get_next_token(); // Consume identifier
+    symbol_t param_name = this->get_next_token().symbol;
 
-    std::string param_name = peeked_token.value;
     peeked_token = this->peek_next_token();
-
     if (peeked_token.token_type != TOK_COLON) {
-        DEPLANG_PARSER_ERROR("Expected ':', got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected ':', got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
-
     this->get_next_token(); // Consume ':'
-    
-    peeked_token = this->peek_next_token();
 
+    peeked_token = this->peek_next_token();
     if (peeked_token.token_type != TOK_IDENTIFIER) {
-        DEPLANG_PARSER_ERROR("Expected identifier, got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected identifier, got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
 
-    this->get_next_token(); // Consume identifier
-    std::string param_type = peeked_token.value;
-    
     // @TODO: Change to parse type expression
-    auto param_type_expr = std::make_unique<TypeExrAST>(param_type);
-    return std::make_unique<FunctionParameterAST>(param_name, std::move(param_type_expr));
+    auto param_type = builder.type(this->get_next_token().symbol);
+    return builder.parameter(param_name, param_type);
 }
 
 // Parse function definition
 // func identifier(arg1, arg2, ...) {
 //    expressions_list
 // }
-std::unique_ptr<FunctionDefinitionAST> cParser::parse_function_definition() {
+template <typename Builder>
+typename Builder::function_t cParser::parse_function_definition(Builder& builder) {
     this->get_next_token(); // Consume 'func'
-    
+
     sToken peeked_token = this->peek_next_token();
     if (peeked_token.token_type != TOK_IDENTIFIER) {
-        DEPLANG_PARSER_ERROR("Expected identifier, got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected identifier, got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
 
-    this->get_next_token(); // Consume identifier
+    symbol_t function_name = this->get_next_token().symbol;
 
-    std::string function_name = peeked_token.value;
     peeked_token = this->peek_next_token();
     if (peeked_token.token_type != TOK_LEFTPAR) {
-        DEPLANG_PARSER_ERROR("Expected '(', got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected '(', got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
-
     this->get_next_token(); // Consume '('
 
-    peeked_token = this->peek_next_token();
-
     // Parse function parameters
-    std::vector<std::unique_ptr<FunctionParameterAST>> args;
-    if (peeked_token.token_type != TOK_RIGHTPAR) {
+    std::vector<typename Builder::param_t> params;
+    if (this->peek_next_token().token_type != TOK_RIGHTPAR) {
         while (true) {
-            auto param = this->parse_function_parameter();
-            if (!param) { return nullptr; }
+            auto param = this->parse_function_parameter(builder);
+            if (param == Builder::NONE) { return Builder::NONE; }
+            params.push_back(param);
 
-            args.push_back(std::move(param));
             this->get_next_token();
+            if (this->m_current_token.token_type == TOK_RIGHTPAR) { break; }
 
-            if (m_current_token.token_type == TOK_RIGHTPAR) 
-                break;
-
-            if (m_current_token.token_type != TOK_COMMA) {
-                DEPLANG_PARSER_ERROR("Expected ',' or ')', got " << peeked_token.value << " at line " << peeked_token.line_number);
-                return nullptr;
+            if (this->m_current_token.token_type != TOK_COMMA) {
+                DEPLANG_PARSER_ERROR("Expected ',' or ')', got " << this->get_token_value(this->m_current_token) << " at line " << this->m_current_token.line_number);
+                return Builder::NONE;
             }
         }
-    } else { 
+    } else {
         this->get_next_token(); // Consume the ')' if no parameters
     }
 
-    // this->get_next_token();
+    typename Builder::type_t return_type;
     peeked_token = this->peek_next_token();
-
-    std::string return_type = "void";
-    std::unique_ptr<TypeExrAST> return_type_expr;
-
     if (peeked_token.token_type == TOK_ARROW) {
         this->get_next_token(); // Consume '->'
 
         peeked_token = this->peek_next_token();
-
         if (peeked_token.token_type != TOK_IDENTIFIER) {
-            DEPLANG_PARSER_ERROR("Expected identifier got " << peeked_token.value << " at line " << peeked_token.line_number);
-            return nullptr;
+            DEPLANG_PARSER_ERROR("Expected identifier got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+            return Builder::NONE;
         }
 
-        // this->get_next_token(); // Consume identifier
-        // return_type = peeked_token.value;
-
-        std::cout << "Parsing type "<< std::endl;
-        auto lhs = this->parse_type();
-        if (lhs) {
-            std::cout << "Type: " << lhs->get_primitive_type() << std::endl;
-            return_type_expr = this->parse_type_expression(0, std::move(lhs));
-        } else {
-            return_type_expr = std::make_unique<TypeExrAST>("void");
-        }
-
-        // this->get_next_token(); // Move to the '{'
+        DEPLANG_LOG(LOG_TRACE, LOG_PARSER, "Parsing type");
+        return_type = this->parse_full_type(builder);
+        if (return_type == Builder::NONE) { return Builder::NONE; }
         peeked_token = this->peek_next_token();
-    } else { return_type_expr = std::make_unique<TypeExrAST>("void"); }
+    } else {
+        return_type = builder.type(SYM_VOID);
+    }
 
     if (peeked_token.token_type != TOK_LEFTCURBRACE) {
-        DEPLANG_PARSER_ERROR("Expected '{' got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected '{' got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
+    this->get_next_token(); // Consume '{'
 
-    this->get_next_token(); // consume '{'
-
-    std::vector<std::unique_ptr<ExprAST>> fn_body;
-    while (true) {
-        peeked_token = this->peek_next_token();
-        if (peeked_token.token_type == TOK_RIGHTCURBRACE) { break; }
-
-        auto expression = this->parse_expression();
-        peeked_token = this->peek_next_token();
-        // std::cout << "PEEEEKED:: " << peeked_token.value << std::endl;
-
+    std::vector<typename Builder::expr_t> body;
+    while (this->peek_next_token().token_type != TOK_RIGHTCURBRACE) {
+        auto expression = this->parse_expression(builder);
         this->get_next_token(); // Consume ';'
-        if (!expression) { std::cout << "Got no expression\n"; break; }
-        fn_body.push_back(std::move(expression));
+        if (expression == Builder::NONE) { break; }
+        body.push_back(expression);
     }
 
     peeked_token = this->peek_next_token();
     if (peeked_token.token_type != TOK_RIGHTCURBRACE) {
-        DEPLANG_PARSER_ERROR("Expected '}' got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected '}' got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
+    this->get_next_token(); // Consume last '}'
 
-    this->get_next_token(); // Consume last }
-
-    // @TODO: Change
-    // auto return_type_expr = std::make_unique<TypeExrAST>(return_type);
-    auto function_definition = std::make_unique<FunctionDefinitionAST>(function_name, std::move(args), std::move(return_type_expr), std::move(fn_body));
-    return function_definition;
+    return builder.function(function_name, params, return_type, body);
 }
 
-std::unique_ptr<VariableDeclarationExprAST> cParser::parse_variable_declaration() {
-
+// let identifier ':' type_expr ['=' expr] ';'
+template <typename Builder>
+typename Builder::expr_t cParser::parse_variable_declaration(Builder& builder) {
     this->get_next_token(); // Consume 'let'
-    sToken peeked_token = this->peek_next_token();
 
+    sToken peeked_token = this->peek_next_token();
     if (peeked_token.token_type != TOK_IDENTIFIER) {
-        DEPLANG_PARSER_ERROR("Expected identifier got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected identifier got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
-    
-    this->get_next_token(); // Consume identifier
 
-    std::string var_name = peeked_token.value;
-    peeked_token = this->peek_next_token();
+    symbol_t var_name = this->get_next_token().symbol;
 
+    peeked_token = this->peek_next_token();
     if (peeked_token.token_type != TOK_COLON) {
-        DEPLANG_PARSER_ERROR("Expected ':' got " << peeked_token.value << " at line " << peeked_token.line_number);
-        return nullptr;
+        DEPLANG_PARSER_ERROR("Expected ':' got " << this->get_token_value(peeked_token) << " at line " << peeked_token.line_number);
+        return Builder::NONE;
     }
-
     this->get_next_token(); // Consume ':'
 
-    // peeked_token = this->peek_next_token();
-    // if (peeked_token.token_type != TOK_IDENTIFIER) {
-    //     DEPLANG_PARSER_ERROR("Expected identifier got " << peeked_token.value << " at line " << peeked_token.line_number);
-    //     return nullptr;
-    // }
-
-    // std::string var_type = peeked_token.value;
-
-    std::unique_ptr<TypeExrAST> return_type_expr;
-    
-    std::cout << "Parsing type "<< std::endl;
-    auto lhs = this->parse_type();
-    if (lhs) {
-        return_type_expr = this->parse_type_expression(0, std::move(lhs));
-        if (!return_type_expr) { return nullptr; }
-        return_type_expr->print();
+    DEPLANG_LOG(LOG_TRACE, LOG_PARSER, "Parsing type");
+    typename Builder::type_t var_type;
+    auto lhs = this->parse_type(builder);
+    if (lhs != Builder::NONE) {
+        var_type = this->parse_type_expression(builder, 0, lhs);
+        if (var_type == Builder::NONE) { return Builder::NONE; }
+        if (DEPLANG_LOG_ENABLED(LOG_TRACE, LOG_PARSER)) { builder.print_type(var_type); }
     } else {
-        return_type_expr = std::make_unique<TypeExrAST>("void");
+        var_type = builder.type(SYM_VOID);
     }
 
-    // this->get_next_token(); // Consume identifier
-
     peeked_token = this->peek_next_token();
-
-    if (peeked_token.token_type == TOK_SEMICOLON) {
-        return std::make_unique<VariableDeclarationExprAST>(var_name, std::move(return_type_expr));
-    }
+    if (peeked_token.token_type == TOK_SEMICOLON) { return builder.variable_declaration(var_name, var_type, Builder::NONE); }
 
     if (peeked_token.token_type == TOK_EQUAL) {
         this->get_next_token(); // Consume '='
-        auto expr = this->parse_expression();
-        if (!expr) { return nullptr; }
+        auto expr = this->parse_expression(builder);
+        if (expr == Builder::NONE) { return Builder::NONE; }
 
-        peeked_token = this->peek_next_token();
-        if (peeked_token.token_type == TOK_SEMICOLON) {
-            return std::make_unique<VariableDeclarationExprAST>(var_name, std::move(return_type_expr), std::move(expr));
-        }
+        if (this->peek_next_token().token_type == TOK_SEMICOLON) { return builder.variable_declaration(var_name, var_type, expr); }
     }
 
-    return nullptr;
+    return Builder::NONE;
 }
 
-int cParser::get_binop_precedence(std::string op) {
+int cParser::get_binop_precedence(std::string_view op) {
     if (op == ",") { return 10; }
     else if (op == ">" || op == "<" || op == ">=" || op == "<=") { return 20; }
     else if (op == "+" || op == "-") { return 30; }
@@ -1099,59 +1347,50 @@ int cParser::get_binop_precedence(std::string op) {
     else { return -1; }
 }
 
-int cParser::get_type_operator_precedence(std::string op) {
+int cParser::get_type_operator_precedence(std::string_view op) {
     if (op == "->") { return 10; }
     else if (op == "|") { return 20; }
     else if (op == "*") { return 30; }
     else { return -1; }
 }
 
-void cParser::parse() {
-    // this->m_current_token = this->m_tokens[0];
-    
-    llvm::Function* f;
-
+// Top level definitions until EOF, each handed to the builder as soon as it
+// is parsed
+template <typename Builder>
+bool cParser::parse_definitions(Builder& builder) {
     while (true) {
-        // this->get_next_token();
-        
         sToken peeked = this->peek_next_token();
-        std::string type = get_token_type_string(peeked.token_type);
-        // this->get_next_token();
-        // continue;
-    
-        if (peeked.token_type == TOK_EOF) { std::cout << "Found EOF" << std::endl; return ; }
+
+        if (peeked.token_type == TOK_EOF) { DEPLANG_LOG(LOG_DEBUG, LOG_PARSER, "Found EOF"); return true; }
         else if (peeked.token_type == TOK_SEMICOLON) { this->get_next_token(); }
         else if (peeked.token_type == TOK_TYPEDECL) {
-            std::unique_ptr<TypeDeclarationExprAST> type_decl = this->parse_type_declaration();
-            if (!type_decl) {
-                DEPLANG_PARSER_ERROR("ERROR");
-                return;
-            }
+            auto type_decl = this->parse_type_declaration(builder);
+            if (type_decl == Builder::NONE) { return false; }
 
-            peeked = this->peek_next_token(); // Consume ';'
+            peeked = this->peek_next_token();
             if (peeked.token_type != TOK_SEMICOLON) {
-                DEPLANG_PARSER_ERROR("Expected ';', got " << peeked.value);
-                return;
+                DEPLANG_PARSER_ERROR("Expected ';', got " << this->get_token_value(peeked));
+                return false;
             }
-
-            type_decl->codegen(this->m_code_generator);
-
+            if (!builder.add_type_declaration(type_decl)) { return false; }
         } else if (peeked.token_type == TOK_DEF) {
-            std::unique_ptr<FunctionDefinitionAST> func_def = this->parse_function_definition();
-            if (!func_def) {
-                DEPLANG_PARSER_ERROR("ERROR");
-                return;
-            }
-            // std::cout << "AST:" << std::endl;
-            // func_def->print();
-            // std::cout << "END AST:" << std::endl; 
-            f = func_def->codegen(this->m_code_generator);
-            f->print(llvm::errs());
+            auto func_def = this->parse_function_definition(builder);
+            if (func_def == Builder::NONE || !builder.add_function(func_def)) { return false; }
+        } else if (peeked.token_type == TOK_IMPORT) {
+            if (!this->parse_import(builder)) { return false; }
         } else {
-            DEPLANG_PARSER_ERROR("ERROR");
-            return;
+            DEPLANG_PARSER_ERROR("Unexpected " << this->get_token_value(peeked) << " at line " << peeked.line_number);
+            return false;
         }
     }
 }
 
+bool cParser::parse() {
+    sTreeBuilder builder = { this->m_arena, this->m_code_generator, {} };
+    return this->parse_definitions(builder) && builder.generate_functions();
+}
 
+bool cParser::parse_flat(cFlatAST& ast) {
+    sFlatBuilder builder = { ast };
+    return this->parse_definitions(builder);
+}
@@ -0,0 +1,139 @@
+#include "../include/profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+
+struct sOpenScope {
+    std::string name;
+    std::string detail;
+    const char* category;
+    uint64_t start_ns;
+};
+
+// Scopes opened by the current thread, innermost last
+static thread_local std::vector<sOpenScope> open_scopes;
+static thread_local uint32_t thread_index = UINT32_MAX;
+
+
+cProfiler& cProfiler::get() {
+    static cProfiler profiler;
+    return profiler;
+}
+
+cProfiler::cProfiler() : m_enabled(false), m_start(std::chrono::steady_clock::now()), m_thread_count(0) {}
+
+void cProfiler::enable() { this->m_enabled = true; }
+
+uint64_t cProfiler::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->m_start).count();
+}
+
+void cProfiler::begin(std::string_view name, std::string_view detail, const char* category) {
+    if (!this->m_enabled) { return; }
+    open_scopes.push_back({ std::string(name), std::string(detail), category, this->now() });
+}
+
+void cProfiler::end() {
+    if (!this->m_enabled || open_scopes.empty()) { return; }
+
+    uint64_t end_ns = this->now();
+    sOpenScope& scope = open_scopes.back();
+
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    if (thread_index == UINT32_MAX) { thread_index = this->m_thread_count++; }
+
+    this->m_events.push_back({ std::move(scope.name), std::move(scope.detail), scope.category, scope.start_ns, end_ns - scope.start_ns, thread_index });
+    open_scopes.pop_back();
+}
+
+static void write_json_string(std::ostream& out, std::string_view str) {
+    out << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') { out << '\\' << c; }
+        else if ((unsigned char)c < 0x20) { out << ' '; }
+        else { out << c; }
+    }
+    out << '"';
+}
+
+bool cProfiler::write_trace(const std::string& file_path) const {
+    std::ofstream out(file_path);
+    if (!out) {
+        std::cerr << "Could not open " << file_path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+
+    // Complete events, times in microseconds
+    out << "{\"traceEvents\":[";
+    out << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < this->m_events.size(); ++i) {
+        const sProfileEvent& event = this->m_events[i];
+        out << (i ? ",\n" : "\n") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << event.start_ns / 1000.0 << ",\"dur\":" << event.duration_ns / 1000.0
+            << ",\"cat\":\"" << event.category << "\",\"name\":";
+        write_json_string(out, event.name);
+        if (!event.detail.empty()) {
+            out << ",\"args\":{\"detail\":";
+            write_json_string(out, event.detail);
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return (bool)out;
+}
+
+void cProfiler::print_summary(std::ostream& out) const {
+    struct sTotal {
+        uint64_t total_ns = 0;
+        uint64_t count = 0;
+    };
+
+    std::map<std::string, sTotal> totals;
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        for (const sProfileEvent& event : this->m_events) {
+            if (event.category != std::string_view("compiler")) { continue; }
+            sTotal& total = totals[event.name];
+            total.total_ns += event.duration_ns;
+            total.count++;
+        }
+    }
+
+    std::vector<std::pair<std::string, sTotal>> rows(totals.begin(), totals.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.second.total_ns > b.second.total_ns; });
+
+    out << "---------------------------------- Time report ----------------------------------" << std::endl;
+    out << std::left << std::setw(32) << "Scope" << std::right << std::setw(14) << "Total (ms)" << std::setw(10) << "Count" << std::setw(14) << "Avg (us)" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (const auto& row : rows) {
+        out << std::left << std::setw(32) << row.first << std::right
+            << std::setw(14) << row.second.total_ns / 1.0e6
+            << std::setw(10) << row.second.count
+            << std::setw(14) << row.second.total_ns / 1.0e3 / row.second.count << std::endl;
+    }
+    out << std::defaultfloat;
+}
+
+
+cScopedTimer::cScopedTimer(std::string_view name, std::string_view detail) :
+    m_start(std::chrono::steady_clock::now()), m_recording(cProfiler::get().is_enabled()), m_stopped(false) {
+    if (this->m_recording) { cProfiler::get().begin(name, detail); }
+}
+
+cScopedTimer::~cScopedTimer() {
+    if (!this->m_stopped) { this->stop(); }
+}
+
+double cScopedTimer::stop() {
+    if (this->m_recording && !this->m_stopped) { cProfiler::get().end(); }
+    this->m_stopped = true;
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->m_start).count();
+}
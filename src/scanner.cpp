@@ -0,0 +1,228 @@
+#include "../include/scanner.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+// Table driven scanners, also used for the chars after the last full vector
+static inline size_t scan_whitespace_scalar(const char* data, size_t pos, size_t size, int& newline_count) {
+    while (pos < size && has_char_class(data[pos], CHAR_SPACE)) {
+        if (data[pos] == '\n') { ++newline_count; }
+        ++pos;
+    }
+    return pos;
+}
+
+static inline size_t scan_identifier_tail_scalar(const char* data, size_t pos, size_t size) {
+    while (pos < size && has_char_class(data[pos], CHAR_IDENT)) { ++pos; }
+    return pos;
+}
+
+static inline size_t scan_digits_scalar(const char* data, size_t pos, size_t size) {
+    while (pos < size && has_char_class(data[pos], CHAR_DIGIT)) { ++pos; }
+    return pos;
+}
+
+static inline size_t scan_line_end_scalar(const char* data, size_t pos, size_t size) {
+    while (pos < size && data[pos] != '\n') { ++pos; }
+    return pos;
+}
+
+static size_t scan_whitespace_table(const char* data, size_t pos, size_t size, int& newline_count) {
+    newline_count = 0;
+    return scan_whitespace_scalar(data, pos, size, newline_count);
+}
+
+static const sScanners SCALAR_SCANNERS = {
+    "scalar", scan_whitespace_table, scan_identifier_tail_scalar, scan_digits_scalar, scan_line_end_scalar,
+};
+
+
+#if defined(__SSE2__)
+// Classifiers of one vector of chars, each returns a bitmask with one bit per
+// byte set when the byte belongs to the class. Vectors never leave them, so
+// the loops below only see masks and the AVX2 ones can be compiled for AVX2
+// alone. Unsigned range checks use the saturating subtract trick:
+// (x - lo) -sat (hi - lo) == 0 <=> lo <= x <= hi.
+struct sSSE2Vector {
+    static const size_t SIZE = 16;
+    // Bits set for every byte of the vector
+    static const uint32_t FULL_MASK = 0xFFFF;
+
+    static inline __m128i in_range(__m128i chars, char lo, char hi) {
+        __m128i shifted = _mm_sub_epi8(chars, _mm_set1_epi8(lo));
+        __m128i over = _mm_subs_epu8(shifted, _mm_set1_epi8((char)(hi - lo)));
+        return _mm_cmpeq_epi8(over, _mm_setzero_si128());
+    }
+    static inline __m128i equals(__m128i chars, char ch) { return _mm_cmpeq_epi8(chars, _mm_set1_epi8(ch)); }
+
+    // Space class, the '\n' among them in newline_mask
+    static inline uint32_t space_mask(const char* ptr, uint32_t& newline_mask) {
+        __m128i chars = _mm_loadu_si128((const __m128i*)ptr);
+        newline_mask = (uint32_t)_mm_movemask_epi8(equals(chars, '\n'));
+        return (uint32_t)_mm_movemask_epi8(_mm_or_si128(equals(chars, ' '), in_range(chars, '\t', '\r')));
+    }
+
+    static inline uint32_t identifier_mask(const char* ptr) {
+        __m128i chars = _mm_loadu_si128((const __m128i*)ptr);
+        __m128i letters = in_range(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'z');
+        return (uint32_t)_mm_movemask_epi8(_mm_or_si128(letters, _mm_or_si128(in_range(chars, '0', '9'), equals(chars, '_'))));
+    }
+
+    static inline uint32_t digit_mask(const char* ptr) { return (uint32_t)_mm_movemask_epi8(in_range(_mm_loadu_si128((const __m128i*)ptr), '0', '9')); }
+    static inline uint32_t newline_mask(const char* ptr) { return (uint32_t)_mm_movemask_epi8(equals(_mm_loadu_si128((const __m128i*)ptr), '\n')); }
+};
+
+// Only called from the AVX2 scanners, which are only picked after a cpu check
+#define DEPLANG_AVX2 __attribute__((target("avx2")))
+
+struct sAVX2Vector {
+    static const size_t SIZE = 32;
+    static const uint32_t FULL_MASK = 0xFFFFFFFF;
+
+    DEPLANG_AVX2 static inline __m256i in_range(__m256i chars, char lo, char hi) {
+        __m256i shifted = _mm256_sub_epi8(chars, _mm256_set1_epi8(lo));
+        __m256i over = _mm256_subs_epu8(shifted, _mm256_set1_epi8((char)(hi - lo)));
+        return _mm256_cmpeq_epi8(over, _mm256_setzero_si256());
+    }
+    DEPLANG_AVX2 static inline __m256i equals(__m256i chars, char ch) { return _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(ch)); }
+
+    DEPLANG_AVX2 static inline uint32_t space_mask(const char* ptr, uint32_t& newline_mask) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*)ptr);
+        newline_mask = (uint32_t)_mm256_movemask_epi8(equals(chars, '\n'));
+        return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(equals(chars, ' '), in_range(chars, '\t', '\r')));
+    }
+
+    DEPLANG_AVX2 static inline uint32_t identifier_mask(const char* ptr) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*)ptr);
+        __m256i letters = in_range(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), 'a', 'z');
+        return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(letters, _mm256_or_si256(in_range(chars, '0', '9'), equals(chars, '_'))));
+    }
+
+    DEPLANG_AVX2 static inline uint32_t digit_mask(const char* ptr) { return (uint32_t)_mm256_movemask_epi8(in_range(_mm256_loadu_si256((const __m256i*)ptr), '0', '9')); }
+    DEPLANG_AVX2 static inline uint32_t newline_mask(const char* ptr) { return (uint32_t)_mm256_movemask_epi8(equals(_mm256_loadu_si256((const __m256i*)ptr), '\n')); }
+};
+
+
+// Full vectors first, then the remaining chars through the table
+template <typename Vector>
+static inline size_t scan_whitespace_vector(const char* data, size_t pos, size_t size, int& newline_count) {
+    newline_count = 0;
+
+    while (pos + Vector::SIZE <= size) {
+        uint32_t newline_mask;
+        uint32_t space_mask = Vector::space_mask(data + pos, newline_mask);
+
+        if (space_mask == Vector::FULL_MASK) {
+            newline_count += __builtin_popcount(newline_mask);
+            pos += Vector::SIZE;
+            continue;
+        }
+
+        unsigned run_length = __builtin_ctz(~space_mask);
+        newline_count += __builtin_popcount(newline_mask & ((1u << run_length) - 1));
+        return pos + run_length;
+    }
+
+    return scan_whitespace_scalar(data, pos, size, newline_count);
+}
+
+template <typename Vector>
+static inline size_t scan_identifier_tail_vector(const char* data, size_t pos, size_t size) {
+    while (pos + Vector::SIZE <= size) {
+        uint32_t mask = Vector::identifier_mask(data + pos);
+
+        if (mask != Vector::FULL_MASK) { return pos + __builtin_ctz(~mask); }
+        pos += Vector::SIZE;
+    }
+
+    return scan_identifier_tail_scalar(data, pos, size);
+}
+
+template <typename Vector>
+static inline size_t scan_digits_vector(const char* data, size_t pos, size_t size) {
+    while (pos + Vector::SIZE <= size) {
+        uint32_t mask = Vector::digit_mask(data + pos);
+
+        if (mask != Vector::FULL_MASK) { return pos + __builtin_ctz(~mask); }
+        pos += Vector::SIZE;
+    }
+
+    return scan_digits_scalar(data, pos, size);
+}
+
+template <typename Vector>
+static inline size_t scan_line_end_vector(const char* data, size_t pos, size_t size) {
+    while (pos + Vector::SIZE <= size) {
+        uint32_t mask = Vector::newline_mask(data + pos);
+
+        if (mask) { return pos + __builtin_ctz(mask); }
+        pos += Vector::SIZE;
+    }
+
+    return scan_line_end_scalar(data, pos, size);
+}
+
+
+static size_t scan_whitespace_sse2(const char* data, size_t pos, size_t size, int& newline_count) {
+    return scan_whitespace_vector<sSSE2Vector>(data, pos, size, newline_count);
+}
+static size_t scan_identifier_tail_sse2(const char* data, size_t pos, size_t size) { return scan_identifier_tail_vector<sSSE2Vector>(data, pos, size); }
+static size_t scan_digits_sse2(const char* data, size_t pos, size_t size) { return scan_digits_vector<sSSE2Vector>(data, pos, size); }
+static size_t scan_line_end_sse2(const char* data, size_t pos, size_t size) { return scan_line_end_vector<sSSE2Vector>(data, pos, size); }
+
+static const sScanners SSE2_SCANNERS = {
+    "sse2", scan_whitespace_sse2, scan_identifier_tail_sse2, scan_digits_sse2, scan_line_end_sse2,
+};
+
+// flatten inlines the loop and the classifiers in optimized builds
+#define DEPLANG_AVX2_ENTRY __attribute__((target("avx2"), flatten))
+
+DEPLANG_AVX2_ENTRY static size_t scan_whitespace_avx2(const char* data, size_t pos, size_t size, int& newline_count) {
+    return scan_whitespace_vector<sAVX2Vector>(data, pos, size, newline_count);
+}
+DEPLANG_AVX2_ENTRY static size_t scan_identifier_tail_avx2(const char* data, size_t pos, size_t size) { return scan_identifier_tail_vector<sAVX2Vector>(data, pos, size); }
+DEPLANG_AVX2_ENTRY static size_t scan_digits_avx2(const char* data, size_t pos, size_t size) { return scan_digits_vector<sAVX2Vector>(data, pos, size); }
+DEPLANG_AVX2_ENTRY static size_t scan_line_end_avx2(const char* data, size_t pos, size_t size) { return scan_line_end_vector<sAVX2Vector>(data, pos, size); }
+
+static const sScanners AVX2_SCANNERS = {
+    "avx2", scan_whitespace_avx2, scan_identifier_tail_avx2, scan_digits_avx2, scan_line_end_avx2,
+};
+#endif
+
+
+const sScanners* get_scalar_scanners() { return &SCALAR_SCANNERS; }
+
+const sScanners* get_sse2_scanners() {
+#if defined(__SSE2__)
+    return &SSE2_SCANNERS;
+#else
+    return nullptr;
+#endif
+}
+
+const sScanners* get_avx2_scanners() {
+#if defined(__SSE2__)
+    // Can run from a static initializer, before the cpu model is filled in
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { return &AVX2_SCANNERS; }
+#endif
+    return nullptr;
+}
+
+static const sScanners* select_scanners() {
+    if (const sScanners* scanners = get_avx2_scanners()) { return scanners; }
+    if (const sScanners* scanners = get_sse2_scanners()) { return scanners; }
+    return get_scalar_scanners();
+}
+
+// Picked once, before main
+static const sScanners* const SCANNERS = select_scanners();
+
+const sScanners& get_scanners() { return *SCANNERS; }
+
+size_t scan_whitespace(const char* data, size_t pos, size_t size, int& newline_count) { return SCANNERS->scan_whitespace(data, pos, size, newline_count); }
+size_t scan_identifier_tail(const char* data, size_t pos, size_t size) { return SCANNERS->scan_identifier_tail(data, pos, size); }
+size_t scan_digits(const char* data, size_t pos, size_t size) { return SCANNERS->scan_digits(data, pos, size); }
+size_t scan_line_end(const char* data, size_t pos, size_t size) { return SCANNERS->scan_line_end(data, pos, size); }
@@ -0,0 +1,52 @@
+#include "../include/source_file.h"
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+cSourceFile::cSourceFile(const std::string& file_path, const char* data, size_t size) :
+    m_path(file_path), m_data(data), m_size(size) {}
+
+std::unique_ptr<cSourceFile> cSourceFile::open(const std::string& file_path) {
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error opening file: " << file_path << std::endl;
+        return nullptr;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0) {
+        std::cerr << "Error reading file size: " << file_path << std::endl;
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = (size_t)file_stat.st_size;
+
+    // mmap doesn't accept empty mappings
+    if (size == 0) {
+        close(fd);
+        return std::unique_ptr<cSourceFile>(new cSourceFile(file_path, "", 0));
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        std::cerr << "Error mapping file: " << file_path << std::endl;
+        return nullptr;
+    }
+
+    // The lexer walks the buffer front to back
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    return std::unique_ptr<cSourceFile>(new cSourceFile(file_path, (const char*)data, size));
+}
+
+cSourceFile::~cSourceFile() {
+    if (this->m_size > 0) { munmap((void*)this->m_data, this->m_size); }
+}
@@ -0,0 +1,129 @@
+#include "../../include/types/dep_type.h"
+
+#include <algorithm>
+
+
+size_t cTypeTable::sDepTypeHash::operator()(const sDepType& type) const {
+    uint64_t hash = ((uint64_t)type.kind << 32 | type.name) * 0x9E3779B97F4A7C15ull;
+    hash ^= ((uint64_t)type.lhs << 32 | type.rhs) * 0xC2B2AE3D27D4EB4Full;
+    return hash ^ (hash >> 29);
+}
+
+
+cTypeTable& cTypeTable::get() {
+    static cTypeTable table;
+    return table;
+}
+
+cTypeTable::cTypeTable() {
+    // Must match eBuiltinType
+    for (symbol_t name : { SYM_INT, SYM_FLOAT, SYM_BOOL, SYM_VOID }) {
+        this->get_or_create(sDepType{ TYPE_PRIMITIVE, name, TYPE_NONE, TYPE_NONE });
+    }
+}
+
+// Caller holds the lock
+type_id_t cTypeTable::get_or_create(const sDepType& type) {
+    auto found = this->m_ids.find(type);
+    if (found != this->m_ids.end()) { return found->second; }
+
+    type_id_t id = (type_id_t)this->m_types.size();
+    this->m_types.push_back(type);
+    this->m_ids.emplace(type, id);
+    return id;
+}
+
+type_id_t cTypeTable::get_named(symbol_t name) {
+    switch (name) {
+    case SYM_INT:   return TYPE_INT;
+    case SYM_FLOAT: return TYPE_FLOAT;
+    case SYM_BOOL:  return TYPE_BOOL;
+    case SYM_VOID:  return TYPE_VOID;
+    default: break;
+    }
+
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return this->get_or_create(sDepType{ TYPE_NAMED, name, TYPE_NONE, TYPE_NONE });
+}
+
+type_id_t cTypeTable::get_product(type_id_t lhs, type_id_t rhs) {
+    if (lhs == TYPE_NONE || rhs == TYPE_NONE) { return TYPE_NONE; }
+
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return this->get_or_create(sDepType{ TYPE_PRODUCT, SYM_NONE, lhs, rhs });
+}
+
+type_id_t cTypeTable::get_function(type_id_t param, type_id_t result) {
+    if (param == TYPE_NONE || result == TYPE_NONE) { return TYPE_NONE; }
+
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return this->get_or_create(sDepType{ TYPE_FUNCTION, SYM_NONE, param, result });
+}
+
+type_id_t cTypeTable::get_dependent(symbol_t binder, type_id_t body) {
+    if (body == TYPE_NONE) { return TYPE_NONE; }
+
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return this->get_or_create(sDepType{ TYPE_DEPENDENT, binder, TYPE_NONE, body });
+}
+
+// Caller holds the lock
+void cTypeTable::collect_sum_operands(type_id_t type, std::vector<type_id_t>& operands) const {
+    // Sums are already normalized chains, only walk the spine
+    while (this->m_types[type].kind == TYPE_SUM) {
+        operands.push_back(this->m_types[type].lhs);
+        type = this->m_types[type].rhs;
+    }
+    operands.push_back(type);
+}
+
+type_id_t cTypeTable::get_sum(type_id_t lhs, type_id_t rhs) {
+    if (lhs == TYPE_NONE || rhs == TYPE_NONE) { return TYPE_NONE; }
+
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+
+    std::vector<type_id_t> operands;
+    this->collect_sum_operands(lhs, operands);
+    this->collect_sum_operands(rhs, operands);
+
+    std::sort(operands.begin(), operands.end());
+    operands.erase(std::unique(operands.begin(), operands.end()), operands.end());
+
+    type_id_t sum = operands.back();
+    for (size_t i = operands.size() - 1; i-- > 0;) {
+        sum = this->get_or_create(sDepType{ TYPE_SUM, SYM_NONE, operands[i], sum });
+    }
+    return sum;
+}
+
+sDepType cTypeTable::get_type(type_id_t type) const {
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    if (type >= this->m_types.size()) { return sDepType{ TYPE_PRIMITIVE, SYM_NONE, TYPE_NONE, TYPE_NONE }; }
+    return this->m_types[type];
+}
+
+std::string cTypeTable::to_string(type_id_t type) const {
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return this->to_string_unlocked(type);
+}
+
+std::string cTypeTable::to_string_unlocked(type_id_t type) const {
+    if (type >= this->m_types.size()) { return "<unknown type>"; }
+
+    const sDepType& dep_type = this->m_types[type];
+    switch (dep_type.kind) {
+    case TYPE_PRIMITIVE:
+    case TYPE_NAMED:     return std::string(get_symbol_string(dep_type.name));
+    case TYPE_PRODUCT:   return "(" + this->to_string_unlocked(dep_type.lhs) + " * " + this->to_string_unlocked(dep_type.rhs) + ")";
+    case TYPE_SUM:       return "(" + this->to_string_unlocked(dep_type.lhs) + " | " + this->to_string_unlocked(dep_type.rhs) + ")";
+    case TYPE_FUNCTION:  return "(" + this->to_string_unlocked(dep_type.lhs) + " -> " + this->to_string_unlocked(dep_type.rhs) + ")";
+    case TYPE_DEPENDENT: return "(forall " + std::string(get_symbol_string(dep_type.name)) + ". " + this->to_string_unlocked(dep_type.rhs) + ")";
+    }
+
+    return "<unknown type>";
+}
+
+size_t cTypeTable::size() const {
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return this->m_types.size();
+}
@@ -0,0 +1,263 @@
+// Round trips of the AST cache: what is loaded back prints the same AST,
+// lowers to the same module and has the same tokens as a fresh lex and
+// parse, and damaged or stale files are never loaded.
+#include "../include/ast_cache.h"
+#include "../include/compilation_unit.h"
+#include "../include/flat_ast.h"
+#include "../include/lexer.h"
+#include "../include/log.h"
+#include "../include/parser.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition " failed" << std::endl; \
+            ++failures;                                                                     \
+        }                                                                                   \
+    } while (0)
+
+static const char* SOURCES[] = {
+    // Every root and node kind the parser builds
+    "import math;\n"
+    "type Complex = float * float;\n"
+    "\n"
+    "// comments are not tokens\n"
+    "func sq(a: int) -> int {\n"
+    "    return a * a;\n"
+    "}\n"
+    "\n"
+    "func mul3(a: int, b: int, c: int) -> int {\n"
+    "    let x: int = a * b;\n"
+    "    let y: int;\n"
+    "    y = x * c + 1;\n"
+    "    return y;\n"
+    "}\n"
+    "\n"
+    "func half(a: float) -> float {\n"
+    "    return (a * 0.5) - 1.25;\n"
+    "}\n"
+    "\n"
+    "func main() -> int {\n"
+    "    let y: int = sq(7);\n"
+    "    return sq(y);\n"
+    "}\n",
+
+    "func f(a: int) -> int { return a; }",
+
+    "",
+};
+
+static std::string print_to_string(const cFlatAST& ast) {
+    std::ostringstream out;
+    std::streambuf* previous = std::cout.rdbuf(out.rdbuf());
+    print_flat(ast);
+    std::cout.rdbuf(previous);
+    return out.str();
+}
+
+// Textual IR of the functions and types of the AST, empty if it can't be
+// lowered
+static std::string lower_to_string(const cFlatAST& ast) {
+    std::shared_ptr<cCodeGenerator> code_generator = std::make_shared<cCodeGenerator>();
+    code_generator->configure(sCompilerOptions());
+    if (!codegen_flat(ast, code_generator)) { return {}; }
+
+    std::string ir;
+    llvm::raw_string_ostream out(ir);
+    code_generator->m_Module->print(out, nullptr);
+    return out.str();
+}
+
+static bool same_tokens(const std::vector<sToken>& a, const std::vector<sToken>& b) {
+    if (a.size() != b.size()) { return false; }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].token_type != b[i].token_type || a[i].offset != b[i].offset || a[i].length != b[i].length
+            || a[i].line_number != b[i].line_number || a[i].symbol != b[i].symbol) { return false; }
+    }
+    return true;
+}
+
+static std::string temporary_file_name() {
+    llvm::SmallString<256> path;
+    llvm::sys::fs::createTemporaryFile("ast_cache_test", "dpa", path);
+    return std::string(path);
+}
+
+static std::string read_file(const std::string& file_name) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> content = llvm::MemoryBuffer::getFile(file_name);
+    return content ? (*content)->getBuffer().str() : std::string();
+}
+
+static void write_file(const std::string& file_name, const std::string& content) {
+    std::error_code error;
+    llvm::raw_fd_ostream out(file_name, error);
+    out << content;
+}
+
+
+// Written from a fresh lex and parse, loaded back
+static void test_round_trip(std::string_view source) {
+    cLexer lexer(source);
+    lexer.lex();
+    std::vector<sToken> tokens = lexer.get_tokens();
+
+    cParser parser(source, tokens);
+    cFlatAST ast;
+    CHECK(parser.parse_flat(ast));
+
+    std::string file_name = temporary_file_name();
+    CHECK(cASTCacheFile::write(file_name, source, tokens, ast));
+
+    std::unique_ptr<cASTCacheFile> cache = cASTCacheFile::open(file_name);
+    CHECK(cache);
+    if (cache) {
+        CHECK(cache->matches(source));
+        CHECK(cache->get_node_count() == ast.size());
+        CHECK(cache->get_token_count() == tokens.size());
+
+        cFlatAST loaded;
+        cache->load(loaded);
+        CHECK(loaded.size() == ast.size());
+        CHECK(loaded.get_roots() == ast.get_roots());
+        CHECK(print_to_string(loaded) == print_to_string(ast));
+        std::string ir = lower_to_string(ast);
+        CHECK(!ir.empty());
+        CHECK(lower_to_string(loaded) == ir);
+
+        std::vector<sToken> loaded_tokens;
+        CHECK(cache->load_tokens(loaded_tokens));
+        CHECK(same_tokens(loaded_tokens, tokens));
+    }
+
+    llvm::sys::fs::remove(file_name);
+}
+
+// The first unit writes the cache, the second loads it
+static void test_compilation_unit(std::string_view source) {
+    std::string file_name = temporary_file_name();
+    llvm::sys::fs::remove(file_name);
+
+    cCompilationUnit parsed(source, sCompilerOptions());
+    parsed.set_ast_cache(file_name);
+    CHECK(parsed.parse());
+    CHECK(llvm::sys::fs::exists(file_name));
+
+    cCompilationUnit loaded(source, sCompilerOptions());
+    loaded.set_ast_cache(file_name);
+    CHECK(loaded.parse());
+
+    cLexer lexer(source);
+    lexer.lex();
+    CHECK(same_tokens(parsed.get_tokens(), lexer.get_tokens()));
+    CHECK(same_tokens(loaded.get_tokens(), lexer.get_tokens()));
+    CHECK(print_to_string(loaded.get_ast()) == print_to_string(parsed.get_ast()));
+
+    llvm::sys::fs::remove(file_name);
+}
+
+static void test_stale_source() {
+    std::string_view source = SOURCES[1];
+    std::string file_name = temporary_file_name();
+
+    cLexer lexer(source);
+    lexer.lex();
+    cParser parser(source, lexer.get_tokens());
+    cFlatAST ast;
+    CHECK(parser.parse_flat(ast));
+    CHECK(cASTCacheFile::write(file_name, source, lexer.get_tokens(), ast));
+
+    std::unique_ptr<cASTCacheFile> cache = cASTCacheFile::open(file_name);
+    CHECK(cache && !cache->matches("func f(a: int) -> int { return a; } "));
+    CHECK(cache && !cache->matches("func g(a: int) -> int { return a; }"));
+
+    llvm::sys::fs::remove(file_name);
+}
+
+// Files damaged after a valid write, every one is rejected by open
+static void test_damaged_files() {
+    // Node 0 is the type of a, the last node is the function, a root
+    std::string_view source = SOURCES[1];
+    std::string file_name = temporary_file_name();
+
+    cLexer lexer(source);
+    lexer.lex();
+    cParser parser(source, lexer.get_tokens());
+    cFlatAST ast;
+    CHECK(parser.parse_flat(ast));
+    CHECK(ast.get_kind(0) == NODE_TYPE && ast.get_kind(ast.size() - 1) == NODE_FUNCTION);
+    CHECK(cASTCacheFile::write(file_name, source, lexer.get_tokens(), ast));
+
+    std::string valid = read_file(file_name);
+    sASTCacheHeader header;
+    memcpy(&header, valid.data(), sizeof(header));
+    size_t kinds = (sizeof(sASTCacheHeader) + header.token_bytes + 3) & ~(size_t)3;
+
+    auto rejected = [&file_name](const std::string& content) {
+        write_file(file_name, content);
+        return !cASTCacheFile::open(file_name);
+    };
+
+    CHECK(!rejected(valid));
+    CHECK(rejected(valid.substr(0, valid.size() - 1)));
+    CHECK(rejected(valid + '\0'));
+    CHECK(rejected(valid.substr(0, sizeof(header) - 1)));
+
+    std::string bad_version = valid;
+    bad_version[4] ^= 1;
+    CHECK(rejected(bad_version));
+
+    std::string bad_root = valid;
+    bad_root[kinds + header.node_count - 1] = NODE_INT;
+    CHECK(rejected(bad_root));
+
+    std::string bad_child = valid;
+    bad_child[kinds] = NODE_INT;
+    CHECK(rejected(bad_child));
+
+    std::string bad_kind = valid;
+    bad_kind[kinds] = NODE_EXTERN + 1;
+    CHECK(rejected(bad_kind));
+
+    // Only checked when the tokens are decoded
+    std::string bad_tokens = valid;
+    sASTCacheHeader more_tokens = header;
+    ++more_tokens.token_count;
+    memcpy(&bad_tokens[0], &more_tokens, sizeof(more_tokens));
+    write_file(file_name, bad_tokens);
+    std::unique_ptr<cASTCacheFile> cache = cASTCacheFile::open(file_name);
+    std::vector<sToken> tokens;
+    CHECK(cache && !cache->load_tokens(tokens) && tokens.empty());
+
+    llvm::sys::fs::remove(file_name);
+}
+
+
+int main() {
+    cLogger::get().set_level(LOG_WARNING);
+
+    for (const char* source : SOURCES) {
+        test_round_trip(source);
+        test_compilation_unit(source);
+    }
+    test_stale_source();
+    test_damaged_files();
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "AST cache tests passed" << std::endl;
+    return 0;
+}
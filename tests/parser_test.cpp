@@ -0,0 +1,110 @@
+// Both frontends accept the same programs: the tree parser, with the tokens
+// lexed first or streamed, and the compilation unit over the flat AST. Each
+// program is run in the JIT and must return the same value on every path.
+#include "../include/compilation_unit.h"
+#include "../include/jit.h"
+#include "../include/lexer.h"
+#include "../include/log.h"
+#include "../include/parser.h"
+
+#include <iostream>
+#include <memory>
+#include <string_view>
+
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition " failed" << std::endl; \
+            ++failures;                                                                     \
+        }                                                                                   \
+    } while (0)
+
+struct sProgram {
+    const char* source;
+    int result;
+};
+
+static const sProgram PROGRAMS[] = {
+    // Called before its definition
+    { "func main() -> int {\n"
+      "    return later(50);\n"
+      "}\n"
+      "\n"
+      "func later(a: int) -> int {\n"
+      "    return a + 1;\n"
+      "}\n", 51 },
+
+    // Mutual calls, in both orders
+    { "func first(a: int) -> int { return a * 2; }\n"
+      "func main() -> int { let x: int = first(5); return second(x); }\n"
+      "func second(a: int) -> int { let y: int = first(a); return y + 1; }\n", 21 },
+
+    // Zero until assigned
+    { "func main() -> int {\n"
+      "    let x: int;\n"
+      "    let y: int = x + 7;\n"
+      "    return y;\n"
+      "}\n", 7 },
+
+    { "func main() -> int {\n"
+      "    let x: int;\n"
+      "    x = 5;\n"
+      "    return x + 2;\n"
+      "}\n", 7 },
+
+    // Tuples are lowered to a struct on the stack
+    { "func main() -> int {\n"
+      "    let t: int * int = (1, 2);\n"
+      "    return 3;\n"
+      "}\n", 3 },
+};
+
+// Runs main, -1 if the module can't be run
+static int run_main(std::shared_ptr<cCodeGenerator> code_generator) {
+    std::unique_ptr<cJIT> engine = cJIT::create(*code_generator->m_TargetMachine);
+    if (!engine || !engine->add_module(code_generator)) { return -1; }
+
+    void* address = engine->lookup("main");
+    if (!address) { return -1; }
+    return ((int (*)())address)();
+}
+
+static int run_tree(std::string_view source, bool stream_tokens) {
+    cLexer lexer(source);
+    if (!stream_tokens) { lexer.lex(); }
+
+    std::unique_ptr<cParser> parser = stream_tokens
+        ? std::make_unique<cParser>(&lexer)
+        : std::make_unique<cParser>(source, lexer.take_tokens());
+    parser->m_code_generator->configure(sCompilerOptions());
+    if (!parser->parse()) { return -1; }
+
+    return run_main(parser->m_code_generator);
+}
+
+static int run_flat(std::string_view source) {
+    cCompilationUnit unit(source, sCompilerOptions());
+    if (!unit.run(STAGE_LOWER, "")) { return -1; }
+
+    return run_main(unit.get_code_generator());
+}
+
+int main() {
+    cLogger::get().set_level(LOG_WARNING);
+
+    for (const sProgram& program : PROGRAMS) {
+        CHECK(run_tree(program.source, false) == program.result);
+        CHECK(run_tree(program.source, true) == program.result);
+        CHECK(run_flat(program.source) == program.result);
+    }
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Parser tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Every scanner implementation the cpu can run gives the same positions and
+// newline counts as the scalar one, on runs that end before, on and after
+// the vector boundaries.
+#include "../include/scanner.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition " failed" << std::endl; \
+            ++failures;                                                                     \
+        }                                                                                   \
+    } while (0)
+
+// Chars of every class plus some outside all of them
+static const char ALPHABET[] = " \t\n\r\v\fazAZ_09()+;\x80\xff";
+
+static std::vector<std::string> make_inputs() {
+    std::vector<std::string> inputs;
+    std::mt19937 random(42);
+
+    // One run of a class followed by a stopper, for every length around 16 and 32
+    const char* runs[] = {" ", "\n", " \t\n", "a", "Z9_", "7"};
+    for (const char* run : runs) {
+        for (size_t length = 0; length <= 100; ++length) {
+            std::string input;
+            for (size_t i = 0; i < length; ++i) { input += run[i % std::char_traits<char>::length(run)]; }
+            inputs.push_back(input + "(" + input);
+            inputs.push_back(input);
+        }
+    }
+
+    // Random mixes, mostly long runs of one char
+    for (int i = 0; i < 2000; ++i) {
+        std::string input;
+        size_t length = random() % 160;
+        while (input.size() < length) { input.append(1 + random() % 40, ALPHABET[random() % (sizeof(ALPHABET) - 1)]); }
+        inputs.push_back(input);
+    }
+
+    return inputs;
+}
+
+static void test_scanners(const sScanners& scanners, const std::vector<std::string>& inputs) {
+    const sScanners* scalar = get_scalar_scanners();
+
+    for (const std::string& input : inputs) {
+        const char* data = input.data();
+        size_t size = input.size();
+
+        for (size_t pos = 0; pos <= size; ++pos) {
+            int expected_newlines = 0;
+            int newlines = 0;
+            CHECK(scanners.scan_whitespace(data, pos, size, newlines) == scalar->scan_whitespace(data, pos, size, expected_newlines));
+            CHECK(newlines == expected_newlines);
+            CHECK(scanners.scan_identifier_tail(data, pos, size) == scalar->scan_identifier_tail(data, pos, size));
+            CHECK(scanners.scan_digits(data, pos, size) == scalar->scan_digits(data, pos, size));
+            CHECK(scanners.scan_line_end(data, pos, size) == scalar->scan_line_end(data, pos, size));
+        }
+    }
+}
+
+int main() {
+    std::vector<std::string> inputs = make_inputs();
+
+    const sScanners* implementations[] = {get_sse2_scanners(), get_avx2_scanners()};
+    const char* names[] = {"sse2", "avx2"};
+
+    for (size_t i = 0; i < 2; ++i) {
+        if (!implementations[i]) {
+            std::cout << "Skipping the " << names[i] << " scanners, not supported" << std::endl;
+            continue;
+        }
+        test_scanners(*implementations[i], inputs);
+    }
+    CHECK(&get_scanners() != get_scalar_scanners() || !get_sse2_scanners());
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Scanner tests passed, using " << get_scanners().name << std::endl;
+    return 0;
+}